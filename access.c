@@ -0,0 +1,105 @@
+///author: jmp1617
+///purpose: load and store bytes, halfwords, words and doublewords of a section in either byte order
+///one kernel is made for each width and byte order and a command picks its kernel once, so the loops over
+///the units have no branches on the type in them and compile to straight copies and swaps
+#include <string.h>
+#include <endian.h>
+#include <byteswap.h>
+#include "lmedit.h"
+
+#define IN_ORDER(value) (value)
+
+///the kernels of one width in one byte order
+///order converts between the section's order and host order, swapping is its own inverse so it serves both ways
+#define ACCESS_KERNELS(name,type,order) \
+static uint64_t load_##name(const uint8_t* at){ \
+    type value; \
+    memcpy(&value,at,sizeof(type)); \
+    return order(value); \
+} \
+static void fill_##name(uint8_t* at, uint64_t value, uint32_t count){ \
+    type stored = order((type)value); \
+    for(uint32_t unit=0;unit<count;unit++){ \
+        memcpy(at+(size_t)unit*sizeof(type),&stored,sizeof(type)); \
+    } \
+} \
+static void gather_##name(const uint8_t* at, uint64_t* values, uint32_t count){ \
+    for(uint32_t unit=0;unit<count;unit++){ \
+        type value; \
+        memcpy(&value,at+(size_t)unit*sizeof(type),sizeof(type)); \
+        values[unit] = order(value); \
+    } \
+}
+
+ACCESS_KERNELS(byte,uint8_t,IN_ORDER)
+ACCESS_KERNELS(be16,uint16_t,be16toh)
+ACCESS_KERNELS(be32,uint32_t,be32toh)
+ACCESS_KERNELS(be64,uint64_t,be64toh)
+ACCESS_KERNELS(le16,uint16_t,le16toh)
+ACCESS_KERNELS(le32,uint32_t,le32toh)
+ACCESS_KERNELS(le64,uint64_t,le64toh)
+
+///kernels by byte order, then by width
+static const access_t kernels[2][4] = {
+    {
+        {1,'b',0xff,load_byte,fill_byte,gather_byte},
+        {2,'h',0xffff,load_be16,fill_be16,gather_be16},
+        {4,'w',0xffffffff,load_be32,fill_be32,gather_be32},
+        {8,'d',UINT64_MAX,load_be64,fill_be64,gather_be64}
+    },
+    {
+        {1,'b',0xff,load_byte,fill_byte,gather_byte},
+        {2,'h',0xffff,load_le16,fill_le16,gather_le16},
+        {4,'w',0xffffffff,load_le32,fill_le32,gather_le32},
+        {8,'d',UINT64_MAX,load_le64,fill_le64,gather_le64}
+    }
+};
+
+///get the kernels for a type of a command
+///param: type b, h, w or d, little 1 for a little endian module
+///return: the kernels, NULL if type is not one of them
+const access_t* get_access(char type, int little){
+    switch(type){
+        case 'b': return &kernels[!!little][0];
+        case 'h': return &kernels[!!little][1];
+        case 'w': return &kernels[!!little][2];
+        case 'd': return &kernels[!!little][3];
+        default: return NULL;
+    }
+}
+
+///get the width of a type of a command
+///param: type
+///return: bytes in one unit of the type, 0 if it is not a type
+uint32_t type_width(char type){
+    const access_t* access = get_access(type,0);
+    return access?access->width:0;
+}
+
+///convert a header, all but the magic number, between big and little endian
+///param: header
+void swap_header(exec_t* header){
+    header->version = bswap_16(header->version);
+    header->flags = bswap_32(header->flags);
+    header->entry = bswap_32(header->entry);
+    for(int sec=0;sec<N_EH;sec++){
+        header->data[sec] = bswap_32(header->data[sec]);
+    }
+}
+
+///convert the word fields of table entries laid out as in the file between big and little endian
+///the words lead every entry: addr of a rel, addr and sym of a ref, flags, value and sym of a sym
+///param: entries, sec EH_IX_REL, EH_IX_REF or EH_IX_SYM, count of entries
+void swap_entries(void* entries, int sec, uint32_t count){
+    uint8_t* at = entries;
+    size_t unit = get_unit(sec);
+    int words = sec==EH_IX_REL?1:sec==EH_IX_REF?2:3;
+    for(uint32_t entry=0;entry<count;entry++,at+=unit){
+        for(int w=0;w<words;w++){
+            uint32_t word;
+            memcpy(&word,at+w*4,sizeof(uint32_t));
+            word = bswap_32(word);
+            memcpy(at+w*4,&word,sizeof(uint32_t));
+        }
+    }
+}
@@ -0,0 +1,437 @@
+///author: jmp1617
+///purpose: assemble R2000 instructions for the address:i=instruction edit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///longest instruction the assembler reads
+#define ASM_LINE 128
+#define ASM_MAX_OPERANDS 3
+
+///operand layouts of the instructions
+enum asm_form{
+    FORM_NONE,//nop
+    FORM_RD_RS_RT,//add rd,rs,rt
+    FORM_RD_RT_SA,//sll rd,rt,sa
+    FORM_RD_RT_RS,//sllv rd,rt,rs
+    FORM_RD_RS,//move rd,rs
+    FORM_RS,//jr rs
+    FORM_RD,//mfhi rd
+    FORM_RS_RT,//mult rs,rt
+    FORM_JALR,//jalr rs or jalr rd,rs
+    FORM_CODE,//syscall or break with an optional code
+    FORM_RT_RS_IMM,//addiu rt,rs,imm signed
+    FORM_RT_RS_UIMM,//ori rt,rs,imm unsigned
+    FORM_RT_UIMM,//lui rt,imm
+    FORM_MEM,//lw rt,offset(rs)
+    FORM_BRANCH_RS_RT,//beq rs,rt,target
+    FORM_BRANCH_RS,//blez rs,target
+    FORM_BRANCH,//b target
+    FORM_JUMP//j target
+};
+
+///struct to hold one mnemonic and how it is encoded
+typedef struct asm_op{
+    char name[8];
+    uint8_t form;
+    uint8_t op;//opcode field
+    uint8_t fn;//funct field, or the rt field of the regimm branches
+}asm_op_t;
+
+///mnemonics sorted by name for bsearch
+static const asm_op_t ops[] = {
+    {"add",FORM_RD_RS_RT,0,32},{"addi",FORM_RT_RS_IMM,8,0},{"addiu",FORM_RT_RS_IMM,9,0},
+    {"addu",FORM_RD_RS_RT,0,33},{"and",FORM_RD_RS_RT,0,36},{"andi",FORM_RT_RS_UIMM,12,0},
+    {"b",FORM_BRANCH,4,0},{"beq",FORM_BRANCH_RS_RT,4,0},{"bgez",FORM_BRANCH_RS,1,1},
+    {"bgezal",FORM_BRANCH_RS,1,17},{"bgtz",FORM_BRANCH_RS,7,0},{"blez",FORM_BRANCH_RS,6,0},
+    {"bltz",FORM_BRANCH_RS,1,0},{"bltzal",FORM_BRANCH_RS,1,16},{"bne",FORM_BRANCH_RS_RT,5,0},
+    {"break",FORM_CODE,0,13},{"div",FORM_RS_RT,0,26},{"divu",FORM_RS_RT,0,27},
+    {"j",FORM_JUMP,2,0},{"jal",FORM_JUMP,3,0},{"jalr",FORM_JALR,0,9},{"jr",FORM_RS,0,8},
+    {"lb",FORM_MEM,32,0},{"lbu",FORM_MEM,36,0},{"lh",FORM_MEM,33,0},{"lhu",FORM_MEM,37,0},
+    {"lui",FORM_RT_UIMM,15,0},{"lw",FORM_MEM,35,0},{"lwl",FORM_MEM,34,0},{"lwr",FORM_MEM,38,0},
+    {"mfhi",FORM_RD,0,16},{"mflo",FORM_RD,0,18},{"move",FORM_RD_RS,0,33},{"mthi",FORM_RS,0,17},
+    {"mtlo",FORM_RS,0,19},{"mult",FORM_RS_RT,0,24},{"multu",FORM_RS_RT,0,25},{"nop",FORM_NONE,0,0},
+    {"nor",FORM_RD_RS_RT,0,39},{"or",FORM_RD_RS_RT,0,37},{"ori",FORM_RT_RS_UIMM,13,0},
+    {"sb",FORM_MEM,40,0},{"sh",FORM_MEM,41,0},{"sll",FORM_RD_RT_SA,0,0},{"sllv",FORM_RD_RT_RS,0,4},
+    {"slt",FORM_RD_RS_RT,0,42},{"slti",FORM_RT_RS_IMM,10,0},{"sltiu",FORM_RT_RS_IMM,11,0},
+    {"sltu",FORM_RD_RS_RT,0,43},{"sra",FORM_RD_RT_SA,0,3},{"srav",FORM_RD_RT_RS,0,7},
+    {"srl",FORM_RD_RT_SA,0,2},{"srlv",FORM_RD_RT_RS,0,6},{"sub",FORM_RD_RS_RT,0,34},
+    {"subu",FORM_RD_RS_RT,0,35},{"sw",FORM_MEM,43,0},{"swl",FORM_MEM,42,0},{"swr",FORM_MEM,46,0},
+    {"syscall",FORM_CODE,0,12},{"xor",FORM_RD_RS_RT,0,38},{"xori",FORM_RT_RS_UIMM,14,0}
+};
+
+///number of operands each form takes, the optional ones are not counted
+static const uint8_t operand_count[] = {
+    [FORM_NONE]=0,[FORM_RD_RS_RT]=3,[FORM_RD_RT_SA]=3,[FORM_RD_RT_RS]=3,[FORM_RD_RS]=2,[FORM_RS]=1,
+    [FORM_RD]=1,[FORM_RS_RT]=2,[FORM_JALR]=1,[FORM_CODE]=0,[FORM_RT_RS_IMM]=3,[FORM_RT_RS_UIMM]=3,
+    [FORM_RT_UIMM]=2,[FORM_MEM]=2,[FORM_BRANCH_RS_RT]=3,[FORM_BRANCH_RS]=2,[FORM_BRANCH]=1,[FORM_JUMP]=1
+};
+
+///register names by number
+static const char* registers[32] = {
+    "zero","at","v0","v1","a0","a1","a2","a3","t0","t1","t2","t3","t4","t5","t6","t7",
+    "s0","s1","s2","s3","s4","s5","s6","s7","t8","t9","k0","k1","gp","sp","fp","ra"
+};
+
+///compare a mnemonic with a table entry
+static int compare_ops(const void* key, const void* entry){
+    return strcmp(key,((const asm_op_t*)entry)->name);
+}
+
+///parse a register operand
+///param: text of the operand, reg set to its number
+///return: 0 on success 1 if it is not a register
+static int parse_register(char* text, uint32_t* reg){
+    if(text[0]!='$'){
+        fprintf(ERR,"error: '%s' is not a register, registers start with $\n",text);
+        return 1;
+    }
+    char* end;
+    unsigned long number = strtoul(text+1,&end,10);
+    if(isdigit((unsigned char)text[1])&&*end=='\0'&&number<32){
+        *reg = number;
+        return 0;
+    }
+    for(uint32_t r=0;r<32;r++){
+        if(!strcmp(text+1,registers[r])){
+            *reg = r;
+            return 0;
+        }
+    }
+    if(!strcmp(text+1,"s8")){
+        *reg = 30;
+        return 0;
+    }
+    fprintf(ERR,"error: '%s' is not a register\n",text);
+    return 1;
+}
+
+///parse a number, a symbol, or a symbol with an offset
+///param: MODULE to look symbols up in, NULL if it has none, text of the operand, value set to what it stands for
+///return: 0 on success 1 if it could not be understood
+static int parse_value(module_t* MODULE, char* text, int64_t* value){
+    char* end;
+    if(isdigit((unsigned char)text[0])||((text[0]=='-'||text[0]=='+')&&isdigit((unsigned char)text[1]))){
+        *value = strtoll(text,&end,0);
+        if(*end!='\0'){
+            fprintf(ERR,"error: '%s' is not a number\n",text);
+            return 1;
+        }
+        return 0;
+    }
+    char name[ASM_LINE];
+    size_t len = strcspn(text,"+-");
+    int64_t offset = 0;
+    if(text[len]){//symbol+offset or symbol-offset
+        offset = strtoll(text+len,&end,0);
+        if(*end!='\0'||len==0){
+            fprintf(ERR,"error: '%s' is not a number or a symbol\n",text);
+            return 1;
+        }
+    }
+    snprintf(name,sizeof(name),"%.*s",(int)len,text);
+    if(!MODULE){
+        fprintf(ERR,"error: symbols cannot be looked up here, give '%s' as a number\n",name);
+        return 1;
+    }
+    int64_t entry = find_symbol(MODULE,name);
+    if(entry<0){
+        fprintf(ERR,"error: '%s' is not a number or a symbol in the symtab\n",name);
+        return 1;
+    }
+    *value = (int64_t)ntohl(MODULE->SYMTAB[entry].value)+offset;
+    return 0;
+}
+
+///parse an immediate, which may also be %hi(value) or %lo(value)
+///param: MODULE, text of the operand, value set to the field, is_signed if the field is sign extended
+///return: 0 on success 1 if it could not be understood or does not fit
+static int parse_immediate(module_t* MODULE, char* text, uint32_t* field, int is_signed){
+    int64_t value;
+    size_t len = strlen(text);
+    int hi = !strncmp(text,"%hi(",4), lo = !strncmp(text,"%lo(",4);
+    if(hi||lo){
+        if(text[len-1]!=')'){
+            fprintf(ERR,"error: '%s' is missing a ')'\n",text);
+            return 1;
+        }
+        text[len-1] = '\0';
+        if(parse_value(MODULE,text+4,&value)){
+            return 1;
+        }
+        //%hi is rounded so that adding the sign extended %lo gives the value back
+        *field = hi?(((uint32_t)value+0x8000)>>16)&0xffff:(uint32_t)value&0xffff;
+        return 0;
+    }
+    if(parse_value(MODULE,text,&value)){
+        return 1;
+    }
+    if(is_signed?(value<-32768||value>32767):(value<0||value>0xffff)){
+        fprintf(ERR,"error: %s does not fit in a %s 16 bit immediate\n",text,is_signed?"signed":"unsigned");
+        return 1;
+    }
+    *field = (uint32_t)value&0xffff;
+    return 0;
+}
+
+///parse a memory operand, offset(rs), (rs) or offset
+///param: MODULE, text of the operand, offset and base set to the fields
+///return: 0 on success 1 if it could not be understood
+static int parse_memory(module_t* MODULE, char* text, uint32_t* offset, uint32_t* base){
+    char* open = strrchr(text,'(');//the last one, the offset may be %lo(x)
+    *offset = 0;
+    *base = 0;
+    if(!open){
+        return parse_immediate(MODULE,text,offset,1);
+    }
+    size_t len = strlen(open);
+    if(open[len-1]!=')'){
+        fprintf(ERR,"error: '%s' is missing a ')'\n",text);
+        return 1;
+    }
+    open[len-1] = '\0';
+    *open = '\0';
+    if(parse_register(open+1,base)){
+        return 1;
+    }
+    return text[0]&&parse_immediate(MODULE,text,offset,1);
+}
+
+///parse the target of a branch or jump
+///param: MODULE, text of the operand, address of the instruction, jump 1 for j and jal, field set to the encoded target
+///return: 0 on success 1 if it cannot be reached
+static int parse_target(module_t* MODULE, char* text, uint32_t address, int jump, uint32_t* field){
+    int64_t target;
+    if(parse_value(MODULE,text,&target)){
+        return 1;
+    }
+    if(target<0||target>0xffffffffll||(target&3)){
+        fprintf(ERR,"error: %s is not a word aligned address\n",text);
+        return 1;
+    }
+    uint32_t next = address+4;//targets are taken from the delay slot
+    if(jump){
+        if((next&0xf0000000)!=((uint32_t)target&0xf0000000)){
+            fprintf(ERR,"error: %s is outside the 256MB region of %#010x, use jr\n",text,address);
+            return 1;
+        }
+        *field = ((uint32_t)target>>2)&0x03ffffff;
+        return 0;
+    }
+    int64_t words = (target-(int64_t)next)/4;
+    if(words<-32768||words>32767){
+        fprintf(ERR,"error: %s is too far from %#010x for a branch\n",text,address);
+        return 1;
+    }
+    *field = (uint32_t)words&0xffff;
+    return 0;
+}
+
+///split an instruction into its mnemonic and operands, in place
+///param: line to split, operands set to the operand texts
+///return: number of operands, -1 if there are too many
+static int split_instruction(char* line, char** mnemonic, char* operands[ASM_MAX_OPERANDS]){
+    while(isspace((unsigned char)*line)){
+        line++;
+    }
+    *mnemonic = line;
+    while(*line&&!isspace((unsigned char)*line)){
+        *line = tolower((unsigned char)*line);
+        line++;
+    }
+    if(*line){
+        *line++ = '\0';
+    }
+    int count = 0;
+    while(*line){
+        char* end = strchr(line,',');
+        if(end){
+            *end = '\0';
+        }
+        while(isspace((unsigned char)*line)){
+            line++;
+        }
+        char* last = line+strlen(line);
+        while(last>line&&isspace((unsigned char)last[-1])){
+            *--last = '\0';
+        }
+        if(count==ASM_MAX_OPERANDS){
+            return -1;
+        }
+        operands[count++] = line;
+        if(!end){
+            break;
+        }
+        line = end+1;
+    }
+    return count;
+}
+
+///assemble one instruction
+///param: MODULE to resolve symbols in (NULL if there is none), address the instruction is placed at,
+///       text of the instruction, word set to the encoding, relative set to 1 if it depends on the address
+///return: 0 on success 1 if it could not be assembled
+int assemble(module_t* MODULE, uint32_t address, char* text, uint32_t* word, int* relative){
+    char line[ASM_LINE];
+    char* mnemonic;
+    char* operand[ASM_MAX_OPERANDS];
+    snprintf(line,sizeof(line),"%s",text);
+    int count = split_instruction(line,&mnemonic,operand);
+    const asm_op_t* op = bsearch(mnemonic,ops,sizeof(ops)/sizeof(ops[0]),sizeof(asm_op_t),compare_ops);
+    if(!op){
+        fprintf(ERR,"error: '%s' is not an R2000 instruction\n",mnemonic);
+        return 1;
+    }
+    //jalr and the syscall codes take an optional extra operand
+    int optional = op->form==FORM_JALR||op->form==FORM_CODE;
+    if(count<operand_count[op->form]||count>operand_count[op->form]+optional){
+        fprintf(ERR,"error: %s takes %d operand%s\n",op->name,operand_count[op->form],
+                operand_count[op->form]==1?"":"s");
+        return 1;
+    }
+    uint32_t rs = 0, rt = 0, rd = 0, field = 0;
+    int bad = 0;
+    *relative = 0;
+    switch(op->form){
+        case FORM_NONE:
+            break;
+        case FORM_RD_RS_RT:
+            bad = parse_register(operand[0],&rd)||parse_register(operand[1],&rs)||parse_register(operand[2],&rt);
+            break;
+        case FORM_RD_RT_RS:
+            bad = parse_register(operand[0],&rd)||parse_register(operand[1],&rt)||parse_register(operand[2],&rs);
+            break;
+        case FORM_RD_RT_SA:{
+            int64_t shift = 0;
+            bad = parse_register(operand[0],&rd)||parse_register(operand[1],&rt)||parse_value(MODULE,operand[2],&shift);
+            if(!bad&&(shift<0||shift>31)){
+                fprintf(ERR,"error: shift amount %s is not between 0 and 31\n",operand[2]);
+                bad = 1;
+            }
+            field = (uint32_t)shift<<6;
+            break;
+        }
+        case FORM_RD_RS:
+            bad = parse_register(operand[0],&rd)||parse_register(operand[1],&rs);
+            break;
+        case FORM_RS:
+            bad = parse_register(operand[0],&rs);
+            break;
+        case FORM_RD:
+            bad = parse_register(operand[0],&rd);
+            break;
+        case FORM_RS_RT:
+            bad = parse_register(operand[0],&rs)||parse_register(operand[1],&rt);
+            break;
+        case FORM_JALR:
+            rd = 31;//the return address goes to $ra unless another register is named
+            bad = count==2?parse_register(operand[0],&rd)||parse_register(operand[1],&rs):parse_register(operand[0],&rs);
+            break;
+        case FORM_CODE:{
+            int64_t code = 0;
+            bad = count&&parse_value(MODULE,operand[0],&code);
+            if(!bad&&(code<0||code>0xfffff)){
+                fprintf(ERR,"error: code %s does not fit in 20 bits\n",operand[0]);
+                bad = 1;
+            }
+            field = (uint32_t)code<<6;
+            break;
+        }
+        case FORM_RT_RS_IMM:
+        case FORM_RT_RS_UIMM:
+            bad = parse_register(operand[0],&rt)||parse_register(operand[1],&rs)
+                ||parse_immediate(MODULE,operand[2],&field,op->form==FORM_RT_RS_IMM);
+            break;
+        case FORM_RT_UIMM:
+            bad = parse_register(operand[0],&rt)||parse_immediate(MODULE,operand[1],&field,0);
+            break;
+        case FORM_MEM:
+            bad = parse_register(operand[0],&rt)||parse_memory(MODULE,operand[1],&field,&rs);
+            break;
+        case FORM_BRANCH_RS_RT:
+            *relative = 1;
+            bad = parse_register(operand[0],&rs)||parse_register(operand[1],&rt)
+                ||parse_target(MODULE,operand[2],address,0,&field);
+            break;
+        case FORM_BRANCH_RS:
+            *relative = 1;
+            bad = parse_register(operand[0],&rs)||parse_target(MODULE,operand[1],address,0,&field);
+            rt = op->op==1?op->fn:0;//regimm branches are told apart by rt
+            break;
+        case FORM_BRANCH:
+            *relative = 1;
+            bad = parse_target(MODULE,operand[0],address,0,&field);
+            break;
+        case FORM_JUMP:
+            bad = parse_target(MODULE,operand[0],address,1,&field);
+            break;
+    }
+    if(bad){
+        return 1;
+    }
+    *word = (uint32_t)op->op<<26|rs<<21|rt<<16|field;
+    if(op->op==0){//special, the funct field picks the instruction
+        *word |= rd<<11|op->fn;
+    }
+    return 0;
+}
+
+///turn an address:i=instruction or address,count:i=instruction command into the word edit it stands for
+///param: MODULE to resolve symbols in (NULL if there is none), buf the command, section being edited,
+///       commands set to the edit as proccess_x_command would give it
+///return: 0 if it assembled, 1 if not
+int assemble_command(module_t* MODULE, char* buf, char* section, unsigned int commands[6]){
+    char* end;
+    unsigned long address = strtoul(buf,&end,0), count = 1;
+    if(end!=buf&&*end==','){
+        count = strtoul(end+1,&end,10);
+    }
+    if(end==buf||strncmp(end,":i=",3)||count==0){
+        fprintf(ERR,"error: use address:i=instruction or address,count:i=instruction\n");
+        return 1;
+    }
+    if(strcmp(section,"text")){
+        fprintf(ERR,"error: instructions are assembled into text, the current section is %s\n",section);
+        return 1;
+    }
+    if(address&3){
+        fprintf(ERR,"error: %#010lx is not word aligned, instructions start on a multiple of 4\n",address);
+        return 1;
+    }
+    uint32_t word;
+    int relative;
+    if(assemble(MODULE,address,end+3,&word,&relative)){
+        return 1;
+    }
+    if(relative&&count>1){
+        fprintf(ERR,"error: a branch is encoded for its own address, it cannot be repeated\n");
+        return 1;
+    }
+    commands[0] = address;
+    commands[1] = count;
+    commands[2] = 'w';
+    commands[3] = word;
+    commands[4] = 3;
+    commands[5] = 0;
+    return 0;
+}
+
+///name the instruction a word encodes, ignoring the operands
+///param: word the instruction
+///return: the mnemonic, NULL if the opcode is reserved
+const char* instruction_name(uint32_t word){
+    uint32_t op = word>>26;
+    for(size_t entry=0;entry<sizeof(ops)/sizeof(ops[0]);entry++){
+        const asm_op_t* candidate = &ops[entry];
+        if(candidate->form==FORM_NONE||candidate->form==FORM_RD_RS||candidate->form==FORM_BRANCH){
+            continue;//nop, move and b are other names for sll, addu and beq
+        }
+        if(candidate->op==op&&(op==0?candidate->fn==(word&0x3f):op==1?candidate->fn==((word>>16)&0x1f):1)){
+            return candidate->name;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,311 @@
+///author: jmp1617
+///purpose: time scripted lmedit sessions on a module and report throughput and peak memory
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include "exec.h"
+
+///struct to hold one result, printed as a line of JSON
+typedef struct result{
+    char* name;
+    uint64_t bytes;//bytes loaded, printed, edited or written
+    uint64_t ops;//commands or entries processed
+    double seconds;
+    long max_rss_kb;
+    int status;//exit status, -1 if lmedit could not be run or printed an error
+}result_t;
+
+///struct to hold what the benchmark needs to know about the module
+typedef struct target{
+    char* lmedit;
+    char* module;
+    char* scratch;//directory for scripts and the copy that gets written
+    exec_t header;//host byte order
+    uint64_t length;
+}target_t;
+
+///get the address lmedit uses for the start of a section
+///param: target, sec the EH_IX_ index of the section
+///return: the address, or 0 in an object module and for the tables, which are indexed by entry
+static uint32_t section_start(target_t* target, int sec){
+    if(!target->header.entry||sec>=EH_IX_REL){
+        return 0;
+    }
+    if(sec==EH_IX_TEXT){
+        return TEXT_BEGIN;
+    }
+    uint32_t start = DATA_BEGIN;
+    for(int prev=EH_IX_RDATA;prev<sec;prev++){
+        start += (target->header.data[prev]+7)&~7u;
+    }
+    return start;
+}
+
+///read the module header into host byte order
+///param: target to fill in
+///return: 0 on success 1 on error
+static int read_header(target_t* target){
+    FILE* fp = fopen(target->module,"rb");
+    struct stat st;
+    if(!fp||fstat(fileno(fp),&st)){
+        perror(target->module);
+        return 1;
+    }
+    uint8_t raw[52];
+    if(fread(raw,sizeof(raw),1,fp)!=1){
+        fprintf(stderr,"error: %s: the header is truncated\n",target->module);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    uint16_t half;
+    uint32_t word;
+    memcpy(&half,raw,2);
+    target->header.magic = ntohs(half);
+    memcpy(&half,raw+2,2);
+    target->header.version = ntohs(half);
+    memcpy(&word,raw+4,4);
+    target->header.flags = ntohl(word);
+    memcpy(&word,raw+8,4);
+    target->header.entry = ntohl(word);
+    for(int sec=0;sec<N_EH;sec++){
+        memcpy(&word,raw+12+sec*4,4);
+        target->header.data[sec] = ntohl(word);
+    }
+    if(target->header.magic!=HDR_MAGIC){
+        fprintf(stderr,"error: %s is not an R2K module\n",target->module);
+        return 1;
+    }
+    target->length = st.st_size;
+    return 0;
+}
+
+///look for an error lmedit printed, a command it rejected still exits 0
+///param: result, errors the file lmedit's stderr went to
+///return: 1 if there is an error 0 if not
+static int check_errors(result_t* result, char* errors){
+    FILE* fp = fopen(errors,"r");
+    char line[4096];
+    int found = 0;
+    while(fp&&!found&&fgets(line,sizeof(line),fp)){
+        if(!strncmp(line,"error:",6)){
+            fprintf(stderr,"bench: %s: %s",result->name,line);
+            found = 1;
+        }
+    }
+    if(fp){
+        fclose(fp);
+    }
+    unlink(errors);
+    return found;
+}
+
+///run lmedit on a module with a script on stdin, its output thrown away and its errors checked
+///param: target, module to open, script file, result to fill in
+static void run_script(target_t* target, char* module, char* script, result_t* result){
+    struct timespec begin, end;
+    struct rusage usage;
+    int status = 0;
+    char errors[4096];
+    snprintf(errors,sizeof(errors),"%s/%s.err",target->scratch,result->name);
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    pid_t pid = fork();
+    if(pid==0){
+        int in = open(script,O_RDONLY);
+        int null = open("/dev/null",O_WRONLY);
+        int err = open(errors,O_WRONLY|O_CREAT|O_TRUNC,0644);
+        dup2(in,STDIN_FILENO);
+        dup2(null,STDOUT_FILENO);
+        dup2(err,STDERR_FILENO);
+        execl(target->lmedit,target->lmedit,module,(char*)NULL);
+        _exit(127);
+    }
+    if(pid<0||wait4(pid,&status,0,&usage)<0){
+        perror("bench");
+        result->status = -1;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    result->seconds = (end.tv_sec-begin.tv_sec)+(end.tv_nsec-begin.tv_nsec)/1e9;
+    result->max_rss_kb = usage.ru_maxrss;
+    result->status = WIFEXITED(status)?WEXITSTATUS(status):128+WTERMSIG(status);
+    if(check_errors(result,errors)){
+        result->status = -1;
+    }
+}
+
+///open a script file in the scratch directory
+///param: target, name of the benchmark, path set to the script's path
+///return: the open file
+static FILE* open_script(target_t* target, char* name, char path[4096]){
+    snprintf(path,4096,"%s/%s.cmd",target->scratch,name);
+    FILE* fp = fopen(path,"w");
+    if(!fp){
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+///copy a file so the save benchmark does not change the original
+///param: from, to
+///return: 0 on success 1 on error
+static int copy_file(char* from, char* to){
+    FILE* in = fopen(from,"rb");
+    FILE* out = fopen(to,"wb");
+    char buf[1<<16];
+    size_t n;
+    int failed = !in||!out;
+    while(!failed&&(n=fread(buf,1,sizeof(buf),in))>0){
+        failed = fwrite(buf,1,n,out)!=n;
+    }
+    if(in){
+        fclose(in);
+    }
+    if(out&&fclose(out)){
+        failed = 1;
+    }
+    if(failed){
+        fprintf(stderr,"error: could not copy %s to %s\n",from,to);
+    }
+    return failed;
+}
+
+///pick the largest section that can be edited
+///param: target
+///return: the EH_IX_ index of the section
+static int edit_section(target_t* target){
+    int best = EH_IX_TEXT;
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_SDATA;sec++){
+        if(target->header.data[sec]>target->header.data[best]){
+            best = sec;
+        }
+    }
+    return best;
+}
+
+///print a result as one line of JSON
+///param: target, result
+static void print_result(target_t* target, result_t* result){
+    printf("{\"bench\":\"%s\",\"module\":\"%s\",\"bytes\":%llu,\"ops\":%llu,\"seconds\":%.6f,"
+           "\"mb_per_s\":%.3f,\"ops_per_s\":%.1f,\"max_rss_kb\":%ld,\"status\":%d}\n",
+           result->name,target->module,(unsigned long long)result->bytes,(unsigned long long)result->ops,
+           result->seconds,result->seconds>0?result->bytes/result->seconds/1e6:0.0,
+           result->seconds>0?result->ops/result->seconds:0.0,result->max_rss_kb,result->status);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]){
+    static char* names[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    target_t target = {"./lmedit",NULL,"/tmp",{0},0};
+    uint64_t nedits = 100000;
+    unsigned int repeat = 1;
+    int opt;
+    while((opt=getopt(argc,argv,"l:e:n:w:"))!=-1){
+        switch(opt){
+            case 'l': target.lmedit = optarg; break;
+            case 'e': nedits = strtoull(optarg,NULL,0); break;
+            case 'n': repeat = strtoul(optarg,NULL,0); break;
+            case 'w': target.scratch = optarg; break;
+            default:
+                fprintf(stderr,"usage: bench [-l lmedit] [-e random edits] [-n repeats] [-w scratch dir] module\n");
+                return 1;
+        }
+    }
+    if(optind!=argc-1){
+        fprintf(stderr,"error: one module is needed\n");
+        return 1;
+    }
+    target.module = argv[optind];
+    if(read_header(&target)){
+        return 1;
+    }
+    int sec = edit_section(&target);
+    uint32_t start = section_start(&target,sec);
+    uint32_t words = target.header.data[sec]/4;
+    char path[4096], copy[4096];
+    int failed = 0;
+    snprintf(copy,sizeof(copy),"%s/bench-copy.obj",target.scratch);
+    for(unsigned int round=0;round<repeat;round++){
+        result_t result;
+        FILE* fp;
+        //load: read the module, print the summary and quit
+        result = (result_t){"load",target.length,1,0,0,0};
+        fp = open_script(&target,"load",path);
+        fprintf(fp,"quit\n");
+        fclose(fp);
+        run_script(&target,target.module,path,&result);
+        print_result(&target,&result);
+        failed |= result.status!=0;
+        //dump: print every section and table entry
+        result = (result_t){"dump",0,0,0,0,0};
+        fp = open_script(&target,"dump",path);
+        for(int dump=0;dump<N_EH;dump++){
+            uint32_t size = target.header.data[dump];
+            if(!size||dump==EH_IX_STR){
+                continue;
+            }
+            fprintf(fp,"section %s\n",names[dump]);
+            if(dump==EH_IX_TEXT){
+                fprintf(fp,"%#x,%u:w\n",section_start(&target,dump),size/4);
+            }
+            else{
+                fprintf(fp,"%#x,%u%s\n",section_start(&target,dump),size,dump<EH_IX_REL?":b":"");
+            }
+            result.bytes += dump<EH_IX_REL?size:(uint64_t)size*(dump==EH_IX_REL?8:12);
+            result.ops += dump==EH_IX_TEXT?size/4:size;
+        }
+        fprintf(fp,"quit\n");
+        fclose(fp);
+        run_script(&target,target.module,path,&result);
+        print_result(&target,&result);
+        failed |= result.status!=0;
+        if(!words){
+            continue;
+        }
+        //random: single word edits at random addresses of the largest section
+        result = (result_t){"random_edits",nedits*4,nedits,0,0,0};
+        fp = open_script(&target,"random",path);
+        fprintf(fp,"guard off\nsection %s\n",names[sec]);
+        uint64_t state = 0x9e3779b97f4a7c15ull+round;
+        for(uint64_t edit=0;edit<nedits;edit++){
+            state ^= state<<13;
+            state ^= state>>7;
+            state ^= state<<17;
+            fprintf(fp,"%#x:w=%u\n",start+(uint32_t)(state%words)*4,(uint32_t)(state>>32));
+        }
+        fprintf(fp,"quit\nyes\n");
+        fclose(fp);
+        run_script(&target,target.module,path,&result);
+        print_result(&target,&result);
+        failed |= result.status!=0;
+        //bulk: one command rewriting the whole section
+        result = (result_t){"bulk_edit",(uint64_t)words*4,words,0,0,0};
+        fp = open_script(&target,"bulk",path);
+        fprintf(fp,"guard off\nsection %s\n%#x,%u:w=0x01020304\nquit\nyes\n",names[sec],start,words);
+        fclose(fp);
+        run_script(&target,target.module,path,&result);
+        print_result(&target,&result);
+        failed |= result.status!=0;
+        //save: a bulk edit written back to a copy of the module
+        result = (result_t){"save",target.length,1,0,0,0};
+        if(copy_file(target.module,copy)){
+            return 1;
+        }
+        fp = open_script(&target,"save",path);
+        fprintf(fp,"guard off\nsection %s\n%#x,%u:w=0x01020304\nwrite\nquit\n",names[sec],start,words);
+        fclose(fp);
+        run_script(&target,copy,path,&result);
+        print_result(&target,&result);
+        failed |= result.status!=0;
+        unlink(copy);
+    }
+    return failed;
+}
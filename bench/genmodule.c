@@ -0,0 +1,286 @@
+///author: jmp1617
+///purpose: write synthetic R2K modules of any size for benchmarking lmedit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "exec.h"
+
+///instructions in one generated group: lui, ori, jal, nop
+#define GROUP_WORDS 4
+
+///struct to hold the requested shape of the module
+typedef struct shape{
+    uint32_t size[N_EH];//bytes for sections, entries for tables
+    int load;//1 for a load module, 0 for an object module
+    uint64_t seed;
+}shape_t;
+
+///struct to hold a buffered big endian writer
+typedef struct out{
+    FILE* fp;
+    uint64_t written;
+}out_t;
+
+///next value of a xorshift64 generator
+///param: state to advance
+///return: the next value
+static uint64_t next_random(uint64_t* state){
+    uint64_t x = *state;
+    x ^= x<<13;
+    x ^= x>>7;
+    x ^= x<<17;
+    return *state = x;
+}
+
+///write bytes, exiting if the disk is full
+///param: out, data, length
+static void put(out_t* out, const void* data, size_t length){
+    if(length&&fwrite(data,length,1,out->fp)!=1){
+        perror("genmodule");
+        exit(EXIT_FAILURE);
+    }
+    out->written += length;
+}
+
+///write a big endian word
+///param: out, word
+static void put_word(out_t* out, uint32_t word){
+    word = htonl(word);
+    put(out,&word,sizeof(uint32_t));
+}
+
+///parse a size with an optional K, M or G suffix
+///param: text to parse
+///return: the size, exits if it does not fit in 32 bits
+static uint32_t parse_size(char* text){
+    char* end;
+    unsigned long long size = strtoull(text,&end,0);
+    switch(*end){
+        case 'k': case 'K': size <<= 10; end++; break;
+        case 'm': case 'M': size <<= 20; end++; break;
+        case 'g': case 'G': size <<= 30; end++; break;
+    }
+    if(*end!='\0'||size>0xffffffffull){
+        fprintf(stderr,"error: '%s' is not a size that fits in a module\n",text);
+        exit(EXIT_FAILURE);
+    }
+    return size;
+}
+
+///get the address a section starts at, the same layout lmedit uses
+///param: shape, sec the EH_IX_ index of the section
+///return: the address, or the offset in an object module
+static uint32_t section_start(shape_t* shape, int sec){
+    if(sec==EH_IX_TEXT){
+        return shape->load?TEXT_BEGIN:0;
+    }
+    uint32_t start = DATA_BEGIN;
+    for(int prev=EH_IX_RDATA;prev<sec;prev++){
+        start += (shape->size[prev]+7)&~7u;
+    }
+    return shape->load?start:0;
+}
+
+///write the text section as groups that form a data address and call another group
+///param: out, shape
+static void write_text(out_t* out, shape_t* shape){
+    uint64_t state = shape->seed;
+    uint32_t ngroups = shape->size[EH_IX_TEXT]/(GROUP_WORDS*4);
+    uint32_t data_size = shape->size[EH_IX_RDATA]+shape->size[EH_IX_DATA];
+    for(uint32_t group=0;group<ngroups;group++){
+        uint32_t addr = DATA_BEGIN+(data_size?(next_random(&state)%data_size)&~3u:0);
+        uint32_t target = section_start(shape,EH_IX_TEXT)+(next_random(&state)%ngroups)*GROUP_WORDS*4;
+        put_word(out,0x3c080000|(addr>>16));//lui $t0,hi
+        put_word(out,0x35080000|(addr&0xffff));//ori $t0,$t0,lo
+        put_word(out,0x0c000000|((target>>2)&0x03ffffff));//jal target
+        put_word(out,0x00000000);//nop
+    }
+    for(uint32_t word=ngroups*GROUP_WORDS;word<shape->size[EH_IX_TEXT]/4;word++){
+        put_word(out,0x00000000);
+    }
+}
+
+///write random bytes
+///param: out, length, state of the generator
+static void write_random(out_t* out, uint32_t length, uint64_t* state){
+    uint64_t chunk[512];
+    while(length){
+        uint32_t n = length<sizeof(chunk)?length:sizeof(chunk);
+        for(uint32_t word=0;word<(n+7)/8;word++){
+            chunk[word] = next_random(state);
+        }
+        put(out,chunk,n);
+        length -= n;
+    }
+}
+
+///pick the slot for entry i of n spread evenly over nslots
+///param: i, n, nslots
+///return: the slot
+static uint32_t spread(uint32_t i, uint32_t n, uint32_t nslots){
+    return n?(uint32_t)((uint64_t)i*nslots/n):0;
+}
+
+///write the relocation table: REL_IMM_2 on the lui, REL_JUMP on the jal and REL_WORD in data
+///param: out, shape
+static void write_reltab(out_t* out, shape_t* shape){
+    uint32_t nrel = shape->size[EH_IX_REL];
+    uint32_t ngroups = shape->size[EH_IX_TEXT]/(GROUP_WORDS*4);
+    uint32_t nwords = shape->size[EH_IX_DATA]/4;
+    uint32_t per_kind = (nrel+2)/3;
+    for(uint32_t entry=0;entry<nrel;entry++){
+        uint32_t kind = entry%3, nth = entry/3;
+        uint8_t rel[8] = {0};
+        uint32_t addr;
+        if(kind==2&&nwords){
+            addr = section_start(shape,EH_IX_DATA)+spread(nth,per_kind,nwords)*4;
+            rel[4] = EH_IX_DATA+1;
+            rel[5] = REL_WORD;
+        }
+        else{
+            uint32_t group = spread(nth,per_kind,ngroups);
+            addr = section_start(shape,EH_IX_TEXT)+group*GROUP_WORDS*4+(kind==1?8:0);
+            rel[4] = EH_IX_TEXT+1;
+            rel[5] = kind==1?REL_JUMP:REL_IMM_2;
+        }
+        addr = htonl(addr);
+        memcpy(rel,&addr,sizeof(uint32_t));
+        put(out,rel,sizeof(rel));
+    }
+}
+
+///write the reference table: each jal calls an external symbol
+///param: out, shape, offset of the first external name in the strings, number of external names
+static void write_reftab(out_t* out, shape_t* shape, uint32_t names, uint32_t nnames){
+    uint32_t nref = shape->size[EH_IX_REF];
+    uint32_t ngroups = shape->size[EH_IX_TEXT]/(GROUP_WORDS*4);
+    for(uint32_t entry=0;entry<nref;entry++){
+        uint8_t ref[12] = {0};
+        uint32_t addr = htonl(section_start(shape,EH_IX_TEXT)+spread(entry,nref,ngroups)*GROUP_WORDS*4+8);
+        uint32_t sym = htonl(names+(entry%nnames)*11);//every external name is 10 characters and a NUL
+        memcpy(ref,&addr,sizeof(uint32_t));
+        memcpy(ref+4,&sym,sizeof(uint32_t));
+        ref[8] = EH_IX_TEXT+1;
+        ref[9] = REL_JUMP;
+        put(out,ref,sizeof(ref));
+    }
+}
+
+///write the symbol table: symbols alternate between group starts and data words
+///param: out, shape
+static void write_symtab(out_t* out, shape_t* shape){
+    uint32_t nsym = shape->size[EH_IX_SYM];
+    uint32_t ngroups = shape->size[EH_IX_TEXT]/(GROUP_WORDS*4);
+    uint32_t nwords = shape->size[EH_IX_DATA]/4;
+    for(uint32_t entry=0;entry<nsym;entry++){
+        uint32_t value;
+        if(entry%2&&nwords){
+            value = section_start(shape,EH_IX_DATA)+spread(entry/2,(nsym+1)/2,nwords)*4;
+        }
+        else{
+            value = section_start(shape,EH_IX_TEXT)+spread(entry/2,(nsym+1)/2,ngroups)*GROUP_WORDS*4;
+        }
+        put_word(out,1);//flags
+        put_word(out,value);
+        put_word(out,1+entry*11);//every symbol name is 10 characters and a NUL
+    }
+}
+
+int main(int argc, char* argv[]){
+    shape_t shape = {{0},0,0x2545f4914f6cdd1dull};
+    int opt;
+    //a small module with every section present unless told otherwise
+    shape.size[EH_IX_TEXT] = 1<<20;
+    shape.size[EH_IX_RDATA] = 64<<10;
+    shape.size[EH_IX_DATA] = 256<<10;
+    shape.size[EH_IX_SDATA] = 4<<10;
+    shape.size[EH_IX_SBSS] = 4<<10;
+    shape.size[EH_IX_BSS] = 1<<20;
+    shape.size[EH_IX_REL] = 10000;
+    shape.size[EH_IX_REF] = 10000;
+    shape.size[EH_IX_SYM] = 10000;
+    while((opt=getopt(argc,argv,"t:r:d:s:S:b:R:F:Y:x:l"))!=-1){
+        switch(opt){
+            case 't': shape.size[EH_IX_TEXT] = parse_size(optarg)&~3u; break;
+            case 'r': shape.size[EH_IX_RDATA] = parse_size(optarg); break;
+            case 'd': shape.size[EH_IX_DATA] = parse_size(optarg); break;
+            case 's': shape.size[EH_IX_SDATA] = parse_size(optarg); break;
+            case 'S': shape.size[EH_IX_SBSS] = parse_size(optarg); break;
+            case 'b': shape.size[EH_IX_BSS] = parse_size(optarg); break;
+            case 'R': shape.size[EH_IX_REL] = parse_size(optarg); break;
+            case 'F': shape.size[EH_IX_REF] = parse_size(optarg); break;
+            case 'Y': shape.size[EH_IX_SYM] = parse_size(optarg); break;
+            case 'x': shape.seed = strtoull(optarg,NULL,0)|1; break;
+            case 'l': shape.load = 1; break;
+            default:
+                fprintf(stderr,"usage: genmodule [-t text] [-r rdata] [-d data] [-s sdata] [-S sbss] [-b bss]\n"
+                               "                 [-R reltab] [-F reftab] [-Y symtab] [-x seed] [-l] file\n"
+                               "sizes are bytes for sections and entries for tables, with an optional K, M or G\n"
+                               "-l writes a load module, otherwise an object module\n");
+                return 1;
+        }
+    }
+    if(optind!=argc-1){
+        fprintf(stderr,"error: one output file is needed\n");
+        return 1;
+    }
+    uint32_t ngroups = shape.size[EH_IX_TEXT]/(GROUP_WORDS*4);
+    if((shape.size[EH_IX_REL]||shape.size[EH_IX_REF]||shape.size[EH_IX_SYM])&&!ngroups){
+        fprintf(stderr,"error: tables need at least %d bytes of text\n",GROUP_WORDS*4);
+        return 1;
+    }
+    //names: "" then sym%07u for each symbol then ext%07u for up to 65536 external symbols
+    uint32_t nnames = shape.size[EH_IX_REF]<65536?shape.size[EH_IX_REF]:65536;
+    uint32_t names = 1+shape.size[EH_IX_SYM]*11;
+    if(shape.size[EH_IX_SYM]>10000000){
+        fprintf(stderr,"error: at most 10000000 symbols can be named\n");
+        return 1;
+    }
+    shape.size[EH_IX_STR] = names+nnames*11;
+    out_t out = {fopen(argv[optind],"wb"),0};
+    if(!out.fp){
+        perror(argv[optind]);
+        return 1;
+    }
+    setvbuf(out.fp,NULL,_IOFBF,1<<20);
+    uint16_t half[2] = {htons(HDR_MAGIC),htons(HDR_VERSION)};
+    put(&out,half,sizeof(half));
+    put_word(&out,0);//flags
+    put_word(&out,shape.load?TEXT_BEGIN:0);//entry
+    for(int sec=0;sec<N_EH;sec++){
+        put_word(&out,shape.size[sec]);
+    }
+    uint64_t state = shape.seed^0x9e3779b97f4a7c15ull;
+    write_text(&out,&shape);
+    write_random(&out,shape.size[EH_IX_RDATA],&state);
+    write_random(&out,shape.size[EH_IX_DATA],&state);
+    write_random(&out,shape.size[EH_IX_SDATA],&state);
+    //sbss and bss are zero, leave a hole in the file
+    uint64_t zero = (uint64_t)shape.size[EH_IX_SBSS]+shape.size[EH_IX_BSS];
+    if(fseeko(out.fp,zero,SEEK_CUR)){
+        perror(argv[optind]);
+        return 1;
+    }
+    out.written += zero;
+    write_reltab(&out,&shape);
+    write_reftab(&out,&shape,names,nnames);
+    write_symtab(&out,&shape);
+    char name[16];
+    put(&out,"",1);
+    for(uint32_t sym=0;sym<shape.size[EH_IX_SYM];sym++){
+        snprintf(name,sizeof(name),"sym%07u",sym);
+        put(&out,name,11);
+    }
+    for(uint32_t ext=0;ext<nnames;ext++){
+        snprintf(name,sizeof(name),"ext%07u",ext);
+        put(&out,name,11);
+    }
+    if(fclose(out.fp)){
+        perror(argv[optind]);
+        return 1;
+    }
+    printf("{\"module\":\"%s\",\"bytes\":%llu,\"load\":%d}\n",argv[optind],(unsigned long long)out.written,shape.load);
+    return 0;
+}
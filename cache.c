@@ -0,0 +1,286 @@
+///author: jmp1617
+///purpose: sidecar file holding the indexes built from a module, so reopening it skips building them
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///the sidecar is the module's name with this added
+#define CACHE_SUFFIX ".lmx"
+#define CACHE_MAGIC "LMX3"
+///written in host byte order, a cache from a host of the other order reads it back differently
+#define CACHE_ORDER 0x01020304u
+#define CACHE_ALIGN 8
+
+///struct to hold the start of the sidecar, every offset is from the start of the file
+///the arrays are in host byte order and are used in place through a read only mapping
+typedef struct cache_header{
+    char magic[4];
+    uint32_t order;
+    uint64_t length;//of the module file
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;//of the module header and the ends of its tables, see hash_key
+    uint64_t check;//of everything after this header, only checked by validate
+    uint64_t size;//of the sidecar
+    uint64_t spans[EH_IX_BSS+1];//reloc index of each section
+    uint64_t span_bytes[EH_IX_BSS+1];
+    uint64_t by_value;//symtab entries sorted by value
+    uint64_t buckets;//symtab entries hashed by name
+    uint32_t nsyms;
+    uint32_t nbuckets;
+}cache_header_t;
+
+///hash bytes a word at a time, FNV-1a style
+///param: hash to continue, data, n bytes
+///return: the hash
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t n){
+    const uint8_t* at = data;
+    for(;n>=8;at+=8,n-=8){
+        uint64_t word;
+        memcpy(&word,at,8);
+        hash = (hash^word)*0x100000001b3ull;
+        hash ^= hash>>29;
+    }
+    while(n--){
+        hash = (hash^*at++)*0x100000001b3ull;
+    }
+    return hash;
+}
+
+///hash what ties the sidecar to the module beyond its length and modification time: the header, which holds
+///the table lengths, and the first and last page of each table, so a reopen reads at most two pages of each
+///param: MODULE with its tables loaded
+///return: the hash
+static uint64_t hash_key(module_t* MODULE){
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ull,MODULE->HEADER,sizeof(exec_t));
+    hash = hash_bytes(hash,&MODULE->LITTLE,sizeof(MODULE->LITTLE));
+    for(int sec=EH_IX_REL;sec<N_EH;sec++){
+        uint8_t* table = *get_section(MODULE,sec);
+        uint64_t bytes = (uint64_t)ntohl(MODULE->HEADER->data[sec])*get_unit(sec);
+        uint64_t ends = bytes<MODULE_PAGE?bytes:MODULE_PAGE;
+        if(ends){
+            hash = hash_bytes(hash,table,ends);
+            hash = hash_bytes(hash,table+bytes-ends,ends);
+        }
+    }
+    return hash;
+}
+
+///get the name of a module's sidecar
+///param: file of the module, path set to the sidecar's name
+static void cache_path(char* file, char path[PATH_MAX]){
+    snprintf(path,PATH_MAX,"%s" CACHE_SUFFIX,file);
+}
+
+///check if a module has a sidecar
+///param: file of the module
+///return: 1 if it does
+int has_cache(char* file){
+    char path[PATH_MAX];
+    cache_path(file,path);
+    return !access(path,F_OK);
+}
+
+///map a module's sidecar
+///param: file of the module, size set to the length of the mapping
+///return: the mapping, NULL if there is no sidecar or it is too short to hold a header
+static uint8_t* map_cache(char* file, size_t* size){
+    char path[PATH_MAX];
+    struct stat cst;
+    cache_path(file,path);
+    int fd = open(path,O_RDONLY);
+    if(fd<0){
+        return NULL;
+    }
+    if(fstat(fd,&cst)||cst.st_size<(off_t)sizeof(cache_header_t)){
+        close(fd);
+        return NULL;
+    }
+    uint8_t* cache = mmap(NULL,cst.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    *size = cst.st_size;
+    return cache==MAP_FAILED?NULL:cache;
+}
+
+///check that a sidecar was written for the module as it is and that its arrays lie inside it
+///this reads the header only, the values in the arrays are checked where they are used
+///param: MODULE with its tables loaded, header of the sidecar, size of the sidecar, st the module file's stat
+///return: 1 if it does not match or does not fit, 0 if it can be used
+static int cache_stale(module_t* MODULE, cache_header_t* header, size_t size, struct stat* st){
+    int stale = memcmp(header->magic,CACHE_MAGIC,4)||header->order!=CACHE_ORDER||header->size!=size
+             ||header->length!=(uint64_t)st->st_size||header->mtime_sec!=st->st_mtim.tv_sec
+             ||header->mtime_nsec!=st->st_mtim.tv_nsec||header->nsyms!=(uint32_t)get_size("symtab",MODULE)
+             ||!header->nbuckets||(header->nbuckets&(header->nbuckets-1));
+    for(int sec=0;sec<=EH_IX_BSS&&!stale;sec++){
+        stale = header->spans[sec]%CACHE_ALIGN||header->spans[sec]>header->size
+              ||header->span_bytes[sec]>header->size-header->spans[sec];
+    }
+    stale = stale||header->by_value%CACHE_ALIGN||header->by_value>header->size
+          ||(uint64_t)header->nsyms*4>header->size-header->by_value
+          ||header->buckets%CACHE_ALIGN||header->buckets>header->size
+          ||(uint64_t)header->nbuckets*4>header->size-header->buckets;
+    return stale||header->hash!=hash_key(MODULE);
+}
+
+///adopt the indexes in a module's sidecar if it matches the module as loaded
+///a missing or stale sidecar is passed over and the indexes are built as usual
+///param: MODULE just loaded, file of the module, st its stat
+///return: 0 if the indexes were adopted, 1 if not
+int load_cache(module_t* MODULE, char* file, struct stat* st){
+    size_t size;
+    uint8_t* cache = map_cache(file,&size);
+    if(!cache){
+        return 1;
+    }
+    cache_header_t* header = (cache_header_t*)cache;
+    if(cache_stale(MODULE,header,size,st)){
+        munmap(cache,size);
+        return 1;
+    }
+    void* spans[EH_IX_BSS+1];
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        spans[sec] = cache+header->spans[sec];
+    }
+    destroy_reloc_index(MODULE->RELOCS);
+    destroy_symindex(MODULE->SYMBOLS);
+    MODULE->RELOCS = adopt_reloc_index(spans,header->span_bytes);
+    MODULE->SYMBOLS = adopt_symindex(header->nsyms,(uint32_t*)(cache+header->by_value),header->nbuckets,
+                                     (uint32_t*)(cache+header->buckets));
+    MODULE->CACHE = cache;
+    MODULE->CACHE_SIZE = size;
+    return 0;
+}
+
+///check a module's sidecar in full: its checksum and that every symbol index in it names a symtab entry
+///param: MODULE with its tables loaded, file of the module
+///return: 1 if the sidecar matches the module but is damaged, 0 if it is sound, stale or missing
+int check_cache(module_t* MODULE, char* file){
+    size_t size;
+    struct stat st;
+    uint8_t* cache = map_cache(file,&size);
+    if(!cache){
+        return 0;
+    }
+    cache_header_t* header = (cache_header_t*)cache;
+    char* damage = NULL;
+    if(stat(file,&st)||cache_stale(MODULE,header,size,&st)){
+        fprintf(ERR,"warning: %s" CACHE_SUFFIX " does not match the module and is not used\n",file);
+    }
+    else if(header->check!=hash_bytes(0xcbf29ce484222325ull,header+1,header->size-sizeof(cache_header_t))){
+        damage = "its checksum does not match";
+    }
+    else{
+        uint32_t* by_value = (uint32_t*)(cache+header->by_value);
+        uint32_t* buckets = (uint32_t*)(cache+header->buckets);
+        uint32_t empty = 0;
+        for(uint32_t entry=0;entry<header->nsyms&&!damage;entry++){
+            damage = by_value[entry]>=header->nsyms?"the symbols by value name a missing entry":NULL;
+        }
+        for(uint32_t bucket=0;bucket<header->nbuckets&&!damage;bucket++){
+            damage = buckets[bucket]>header->nsyms?"the symbol hash names a missing entry":NULL;
+            empty += !buckets[bucket];
+        }
+        damage = damage?damage:!empty?"the symbol hash has no empty bucket":NULL;
+    }
+    if(damage){
+        fprintf(ERR,"error: %s" CACHE_SUFFIX " is damaged: %s, delete it or run cache\n",file,damage);
+    }
+    munmap(cache,size);
+    return damage!=NULL;
+}
+
+///write an array into the sidecar at the next aligned offset
+///param: fp, at offset written so far, data, bytes
+///return: offset of the array
+static uint64_t put_array(FILE* fp, uint64_t* at, void* data, size_t bytes){
+    static const uint8_t pad[CACHE_ALIGN];
+    uint64_t offset = (*at+CACHE_ALIGN-1)&~(uint64_t)(CACHE_ALIGN-1);
+    fwrite(pad,1,offset-*at,fp);
+    if(bytes){
+        fwrite(data,1,bytes,fp);
+    }
+    *at = offset+bytes;
+    return offset;
+}
+
+///write the sidecar of a module that matches its file, building any index that is missing
+///the sidecar is written to a temporary file which then replaces the old one
+///param: MODULE, file of the module
+///return: 0 on success, 1 on error
+int save_cache(module_t* MODULE, char* file){
+    char path[PATH_MAX], tmpname[PATH_MAX+4];
+    struct stat st;
+    if(stat(file,&st)){
+        fprintf(ERR,"error: %s: %s\n",file,strerror(errno));
+        return 1;
+    }
+    if(load_sections(MODULE,TABLE_SECTIONS)){
+        return 1;
+    }
+    if(!MODULE->RELOCS){
+        MODULE->RELOCS = build_reloc_index(MODULE);
+    }
+    cache_header_t header = {0};
+    memcpy(header.magic,CACHE_MAGIC,4);
+    header.order = CACHE_ORDER;
+    header.length = st.st_size;
+    header.mtime_sec = st.st_mtim.tv_sec;
+    header.mtime_nsec = st.st_mtim.tv_nsec;
+    header.hash = hash_key(MODULE);
+    uint32_t *by_value, *buckets;
+    symbols_by_value(MODULE,&header.nsyms);
+    symindex_arrays(MODULE->SYMBOLS,&by_value,&header.nbuckets,&buckets);
+    cache_path(file,path);
+    snprintf(tmpname,sizeof(tmpname),"%s.tmp",path);
+    FILE* fp = fopen(tmpname,"w+");
+    if(!fp){
+        fprintf(ERR,"error: %s: %s\n",tmpname,strerror(errno));
+        return 1;
+    }
+    uint64_t at = sizeof(cache_header_t);
+    fwrite(&header,sizeof(header),1,fp);//placeholder until the offsets are known
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        void* spans;
+        header.span_bytes[sec] = reloc_spans(MODULE->RELOCS,sec,&spans);
+        header.spans[sec] = put_array(fp,&at,spans,header.span_bytes[sec]);
+    }
+    header.by_value = put_array(fp,&at,by_value,(size_t)header.nsyms*4);
+    header.buckets = put_array(fp,&at,buckets,(size_t)header.nbuckets*4);
+    header.size = at;
+    //hash the body back from the file so the check covers the padding too
+    uint64_t check = 0xcbf29ce484222325ull;
+    uint8_t buf[1<<16];
+    size_t n;
+    int failed = fflush(fp)!=0||fseek(fp,sizeof(cache_header_t),SEEK_SET)!=0;
+    while(!failed&&(n=fread(buf,1,sizeof(buf),fp))>0){
+        check = hash_bytes(check,buf,n);//every chunk but the last is a multiple of 8
+    }
+    header.check = check;
+    failed |= fseek(fp,0,SEEK_SET)!=0;
+    failed |= fwrite(&header,sizeof(header),1,fp)!=1;
+    failed |= fclose(fp)!=0;
+    if(failed||rename(tmpname,path)){
+        fprintf(ERR,"error: %s: %s\n",path,strerror(errno));
+        remove(tmpname);
+        return 1;
+    }
+    stats_io(0,at);
+    return 0;
+}
+
+///unmap a module's sidecar, the indexes adopted from it must be gone already
+///param: MODULE
+void release_cache(module_t* MODULE){
+    if(MODULE->CACHE){
+        munmap(MODULE->CACHE,MODULE->CACHE_SIZE);
+        MODULE->CACHE = NULL;
+    }
+}
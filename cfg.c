@@ -0,0 +1,545 @@
+///author: jmp1617
+///purpose: basic blocks and call graph over the text section
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///instructions decoded per sweep job
+#define CFG_CHUNK 65536
+
+///leader marks for each instruction
+#define CFG_LEADER 1
+#define CFG_FUNCTION 2
+
+///how an instruction transfers control
+enum cfg_kind{
+    KIND_NONE,
+    KIND_BRANCH,//conditional, falls through after the delay slot
+    KIND_JUMP,//unconditional with a known target
+    KIND_INDIRECT,//jr, the target is not known
+    KIND_CALL,//jal, bltzal, bgezal: returns after the delay slot
+    KIND_CALL_INDIRECT//jalr
+};
+
+///struct to hold one call site found by the sweep
+typedef struct cfg_call{
+    uint32_t site;//instruction index of the call
+    uint32_t target;//instruction index called, or UINT32_MAX
+    int32_t ref;//reftab entry naming an external target, or -1
+}cfg_call_t;
+
+///struct to hold one basic block
+typedef struct cfg_block{
+    uint32_t start;//instruction index of the first instruction
+    uint32_t end;//instruction index after the last instruction
+    uint32_t succ[2];//instruction index of successor blocks
+    uint32_t nsucc;
+    uint32_t func;//index of the function holding the block
+}cfg_block_t;
+
+///struct to hold one function
+typedef struct cfg_func{
+    uint32_t start;//instruction index of the entry
+    uint32_t first_block;
+    uint32_t nblocks;
+    char* name;//from the symtab, NULL if it has none
+}cfg_func_t;
+
+///struct to hold the analysis of a module's text
+struct cfg{
+    module_t* MODULE;
+    uint32_t base;//address of the first instruction
+    uint32_t ninsns;
+    uint8_t* leader;//CFG_LEADER and CFG_FUNCTION marks
+    uint8_t* jump_hint;//1 where the reltab has a REL_JUMP entry
+    int32_t* ref;//reftab entry at each instruction, -1 if none
+    cfg_block_t* blocks;
+    uint32_t nblocks;
+    cfg_func_t* funcs;
+    uint32_t nfuncs;
+    cfg_call_t* calls;
+    uint32_t ncalls;
+};
+
+///struct to hold one chunk of the linear sweep
+typedef struct cfg_job{
+    cfg_t* cfg;
+    uint32_t begin;
+    uint32_t end;
+    cfg_call_t* calls;
+    uint32_t ncalls;
+    uint32_t cap;
+    int failed;//1 if the calls outgrew memory
+}cfg_job_t;
+
+///get an instruction word from the text section
+///param: cfg, index of the instruction
+///return: the word
+static uint32_t cfg_word(cfg_t* cfg, uint32_t index){
+    uint32_t word;
+    memcpy(&word,&cfg->MODULE->TEXT[index*4],sizeof(uint32_t));
+    return SECTION_WORD(cfg->MODULE->LITTLE,word);
+}
+
+///classify an instruction and find its target
+///param: cfg, index of the instruction, target set to the target index or UINT32_MAX
+///return: the cfg_kind of the instruction
+static int cfg_classify(cfg_t* cfg, uint32_t index, uint32_t* target){
+    uint32_t word = cfg_word(cfg,index);
+    uint32_t op = word>>26;
+    uint32_t rs = (word>>21)&0x1f, rt = (word>>16)&0x1f;
+    uint32_t pc = cfg->base+index*4;
+    uint32_t addr = 0;
+    int kind = KIND_NONE;
+    *target = UINT32_MAX;
+    switch(op){
+        case 0://special
+            if((word&0x3f)==8){
+                return KIND_INDIRECT;
+            }
+            if((word&0x3f)==9){
+                return KIND_CALL_INDIRECT;
+            }
+            return KIND_NONE;
+        case 1://regimm
+            if(rt!=0&&rt!=1&&rt!=16&&rt!=17){
+                return KIND_NONE;
+            }
+            kind = rt>=16?KIND_CALL:KIND_BRANCH;
+            addr = pc+4+((uint32_t)(int32_t)(int16_t)(word&0xffff)<<2);
+            break;
+        case 2://j
+        case 3://jal
+            kind = op==2?KIND_JUMP:KIND_CALL;
+            if(cfg->MODULE->HEADER->entry!=0x0){
+                addr = ((pc+4)&0xf0000000)|((word&0x03ffffff)<<2);
+            }
+            else if(cfg->jump_hint[index]){//relocatable target, relative to text
+                addr = (word&0x03ffffff)<<2;
+            }
+            else{
+                return kind;//absolute target outside this module
+            }
+            break;
+        case 4: case 5: case 6: case 7://beq bne blez bgtz
+            kind = KIND_BRANCH;
+            if(op==4&&rs==0&&rt==0){//beq $0,$0 is an unconditional branch
+                kind = KIND_JUMP;
+            }
+            addr = pc+4+((uint32_t)(int32_t)(int16_t)(word&0xffff)<<2);
+            break;
+        default:
+            return KIND_NONE;
+    }
+    if(addr>=cfg->base&&(addr-cfg->base)/4<cfg->ninsns&&!(addr&3)){
+        *target = (addr-cfg->base)/4;
+    }
+    return kind;
+}
+
+///mark an instruction as a leader, safe from several threads
+///param: cfg, index of the instruction, mark CFG_LEADER or CFG_FUNCTION
+static void cfg_mark(cfg_t* cfg, uint32_t index, uint8_t mark){
+    if(index<cfg->ninsns){
+        __atomic_or_fetch(&cfg->leader[index],mark,__ATOMIC_RELAXED);
+    }
+}
+
+///sweep one chunk of text marking leaders and recording calls
+///param: arg the cfg_job_t to process
+static void* cfg_sweep(void* arg){
+    cfg_job_t* job = arg;
+    cfg_t* cfg = job->cfg;
+    for(uint32_t index=job->begin;index<job->end;index++){
+        uint32_t target;
+        int kind = cfg_classify(cfg,index,&target);
+        switch(kind){
+            case KIND_BRANCH:
+            case KIND_JUMP:
+                cfg_mark(cfg,target,CFG_LEADER);
+                /* fall through */
+            case KIND_INDIRECT:
+                cfg_mark(cfg,index+2,CFG_LEADER);//after the delay slot
+                break;
+            case KIND_CALL:
+            case KIND_CALL_INDIRECT:
+                cfg_mark(cfg,target,CFG_LEADER|CFG_FUNCTION);
+                if(job->ncalls==job->cap){
+                    uint32_t cap = job->cap?job->cap*2:64;
+                    cfg_call_t* calls = realloc(job->calls,cap*sizeof(cfg_call_t));
+                    if(!calls){
+                        job->failed = 1;
+                        return NULL;
+                    }
+                    job->calls = calls;
+                    job->cap = cap;
+                }
+                job->calls[job->ncalls].site = index;
+                job->calls[job->ncalls].target = target;
+                job->calls[job->ncalls].ref = cfg->ref?cfg->ref[index]:-1;
+                job->ncalls++;
+                break;
+        }
+    }
+    return NULL;
+}
+
+///find the function holding an instruction
+///param: cfg, index of the instruction
+///return: index of the function
+static uint32_t cfg_find_func(cfg_t* cfg, uint32_t index){
+    uint32_t lo = 0, hi = cfg->nfuncs;
+    while(hi-lo>1){
+        uint32_t mid = (lo+hi)/2;
+        if(cfg->funcs[mid].start<=index){
+            lo = mid;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+///map an address in the text section to an instruction index
+///param: cfg, addr from a table (absolute in load modules, relative in object modules)
+///return: the index, UINT32_MAX if it is not in text
+static uint32_t cfg_index(cfg_t* cfg, uint32_t addr){
+    if(addr<cfg->base||(addr-cfg->base)%4||(addr-cfg->base)/4>=cfg->ninsns){
+        return UINT32_MAX;
+    }
+    return (addr-cfg->base)/4;
+}
+
+///build the basic blocks, functions and call graph of the text section
+///function starts come from the entry point, the symtab and call targets
+///param: MODULE to analyze
+///return: the analysis, NULL if there is no text or no memory
+cfg_t* build_cfg(module_t* MODULE){
+    uint32_t ninsns = get_size("text",MODULE)/4;
+    if(!ninsns){
+        fprintf(ERR,"error: the module has no text to analyze\n");
+        return NULL;
+    }
+    if(load_sections(MODULE,SECTION_BIT(EH_IX_TEXT)|TABLE_SECTIONS)){
+        return NULL;
+    }
+    cfg_t* cfg = calloc(1,sizeof(cfg_t));
+    cfg->MODULE = MODULE;
+    cfg->ninsns = ninsns;
+    cfg->base = MODULE->HEADER->entry!=0x0?TEXT_BEGIN:0;
+    cfg->leader = calloc(ninsns+1,1);
+    cfg->jump_hint = calloc(ninsns,1);
+    //hints from the tables
+    for(uint32_t entry=0;entry<(uint32_t)get_size("reltab",MODULE);entry++){
+        relent_t* rel = &MODULE->RELTAB[entry];
+        uint32_t index = cfg_index(cfg,ntohl(rel->addr));
+        if(rel->section==EH_IX_TEXT+1&&rel->type==REL_JUMP&&index!=UINT32_MAX){
+            cfg->jump_hint[index] = 1;
+        }
+    }
+    if(get_size("reftab",MODULE)){
+        cfg->ref = malloc(ninsns*sizeof(int32_t));
+        memset(cfg->ref,0xff,ninsns*sizeof(int32_t));
+        for(uint32_t entry=0;entry<(uint32_t)get_size("reftab",MODULE);entry++){
+            refent_t* ref = &MODULE->REFTAB[entry];
+            uint32_t index = cfg_index(cfg,ntohl(ref->addr));
+            if(ref->section==EH_IX_TEXT+1&&index!=UINT32_MAX){
+                cfg->ref[index] = entry;
+            }
+        }
+    }
+    cfg_mark(cfg,0,CFG_LEADER|CFG_FUNCTION);
+    if(MODULE->HEADER->entry!=0x0){
+        cfg_mark(cfg,cfg_index(cfg,ntohl(MODULE->HEADER->entry)),CFG_LEADER|CFG_FUNCTION);
+    }
+    for(uint32_t entry=0;entry<(uint32_t)get_size("symtab",MODULE);entry++){
+        cfg_mark(cfg,cfg_index(cfg,ntohl(MODULE->SYMTAB[entry].value)),CFG_LEADER|CFG_FUNCTION);
+    }
+    //parallel linear sweep
+    uint32_t njobs = (ninsns+CFG_CHUNK-1)/CFG_CHUNK;
+    cfg_job_t* jobs = calloc(njobs,sizeof(cfg_job_t));
+    for(uint32_t job=0;job<njobs;job++){
+        jobs[job].cfg = cfg;
+        jobs[job].begin = job*CFG_CHUNK;
+        jobs[job].end = ninsns-job*CFG_CHUNK>CFG_CHUNK?(job+1)*CFG_CHUNK:ninsns;
+    }
+    uint32_t nthreads = get_nprocs();
+    if(nthreads>njobs){
+        nthreads = njobs;
+    }
+    for(uint32_t first=0;first<njobs;first+=nthreads){//one wave of threads at a time
+        pthread_t threads[nthreads];
+        int started[nthreads];
+        for(uint32_t t=0;t<nthreads&&first+t<njobs;t++){
+            started[t] = nthreads>1&&!pthread_create(&threads[t],NULL,cfg_sweep,&jobs[first+t]);
+            if(!started[t]){
+                cfg_sweep(&jobs[first+t]);
+            }
+        }
+        for(uint32_t t=0;t<nthreads&&first+t<njobs;t++){
+            if(started[t]){
+                pthread_join(threads[t],NULL);
+            }
+        }
+    }
+    int failed = 0;
+    for(uint32_t job=0;job<njobs;job++){
+        cfg_call_t* calls = failed||jobs[job].failed?NULL:
+                            realloc(cfg->calls,(cfg->ncalls+jobs[job].ncalls+1)*sizeof(cfg_call_t));
+        if(calls){
+            cfg->calls = calls;
+            if(jobs[job].ncalls){
+                memcpy(&cfg->calls[cfg->ncalls],jobs[job].calls,jobs[job].ncalls*sizeof(cfg_call_t));
+            }
+            cfg->ncalls += jobs[job].ncalls;
+        }
+        failed |= !calls;
+        free(jobs[job].calls);
+    }
+    free(jobs);
+    if(failed){
+        fprintf(ERR,"error: not enough memory to analyze the text\n");
+        destroy_cfg(cfg);
+        return NULL;
+    }
+    //functions and blocks in address order
+    for(uint32_t index=0;index<ninsns;index++){
+        if(cfg->leader[index]&CFG_FUNCTION){
+            cfg->nfuncs++;
+        }
+        if(cfg->leader[index]){
+            cfg->nblocks++;
+        }
+    }
+    cfg->funcs = calloc(cfg->nfuncs,sizeof(cfg_func_t));
+    cfg->blocks = calloc(cfg->nblocks,sizeof(cfg_block_t));
+    uint32_t func = 0, block = 0;
+    for(uint32_t index=0;index<ninsns;index++){
+        if(cfg->leader[index]&CFG_FUNCTION){
+            cfg->funcs[func].start = index;
+            cfg->funcs[func].first_block = block;
+            func++;
+        }
+        if(cfg->leader[index]){
+            cfg_block_t* b = &cfg->blocks[block++];
+            b->start = index;
+            b->func = func-1;
+            cfg->funcs[func-1].nblocks++;
+            b->end = index+1;
+            while(b->end<ninsns&&!cfg->leader[b->end]){
+                b->end++;
+            }
+        }
+    }
+    //successors from the transfer at the end of each block, before or in the delay slot
+    for(block=0;block<cfg->nblocks;block++){
+        cfg_block_t* b = &cfg->blocks[block];
+        uint32_t target = UINT32_MAX;
+        int kind = KIND_NONE;
+        if(b->end-b->start>=2){
+            kind = cfg_classify(cfg,b->end-2,&target);
+        }
+        if(kind!=KIND_BRANCH&&kind!=KIND_JUMP&&kind!=KIND_INDIRECT){
+            kind = cfg_classify(cfg,b->end-1,&target);
+        }
+        if((kind==KIND_BRANCH||kind==KIND_JUMP)&&target!=UINT32_MAX){
+            b->succ[b->nsucc++] = target;
+        }
+        if(kind!=KIND_JUMP&&kind!=KIND_INDIRECT&&b->end<ninsns){
+            b->succ[b->nsucc++] = b->end;
+        }
+    }
+    //names from the symtab
+    for(uint32_t entry=0;entry<(uint32_t)get_size("symtab",MODULE);entry++){
+        uint32_t index = cfg_index(cfg,ntohl(MODULE->SYMTAB[entry].value));
+        if(index!=UINT32_MAX){
+            cfg_func_t* f = &cfg->funcs[cfg_find_func(cfg,index)];
+            if(f->start==index&&!f->name){
+                f->name = get_string(MODULE,ntohl(MODULE->SYMTAB[entry].sym));
+            }
+        }
+    }
+    return cfg;
+}
+
+///compare two call graph edges
+///param: a and b pointers to pairs of function indices (or external refs)
+///return: qsort ordering
+static int compare_edges(const void* a, const void* b){
+    const int64_t* x = a;
+    const int64_t* y = b;
+    if(x[0]!=y[0]){
+        return x[0]<y[0]?-1:1;
+    }
+    if(x[1]!=y[1]){
+        return x[1]<y[1]?-1:1;
+    }
+    return 0;
+}
+
+///get the unique call graph edges, caller function to callee function
+///external callees are stored as -(reftab entry+1)
+///param: cfg, nedges set to the number of edges
+///return: array of edge pairs, to be freed by the caller
+static int64_t* cfg_edges(cfg_t* cfg, uint32_t* nedges){
+    int64_t* edges = malloc((cfg->ncalls+1)*2*sizeof(int64_t));
+    uint32_t n = 0;
+    for(uint32_t call=0;call<cfg->ncalls;call++){
+        cfg_call_t* c = &cfg->calls[call];
+        int64_t callee;
+        if(c->ref>=0){
+            callee = -(int64_t)c->ref-1;
+        }
+        else if(c->target!=UINT32_MAX){
+            callee = cfg_find_func(cfg,c->target);
+        }
+        else{
+            continue;//indirect or outside the module
+        }
+        edges[n*2] = cfg_find_func(cfg,c->site);
+        edges[n*2+1] = callee;
+        n++;
+    }
+    qsort(edges,n,2*sizeof(int64_t),compare_edges);
+    uint32_t unique = 0;
+    for(uint32_t edge=0;edge<n;edge++){
+        if(!unique||compare_edges(&edges[edge*2],&edges[(unique-1)*2])){
+            edges[unique*2] = edges[edge*2];
+            edges[unique*2+1] = edges[edge*2+1];
+            unique++;
+        }
+    }
+    *nedges = unique;
+    return edges;
+}
+
+///write a name inside a quoted JSON or DOT string
+///both escape quotes and backslashes with a backslash, JSON also needs control characters as \u escapes
+///param: name, json 1 for JSON 0 for DOT, out
+static void cfg_write_quoted(const char* name, int json, FILE* out){
+    for(const unsigned char* at=(const unsigned char*)name;*at;at++){
+        if(*at=='"'||*at=='\\'){
+            fputc('\\',out);
+            fputc(*at,out);
+        }
+        else if(json&&*at<0x20){
+            fprintf(out,"\\u%04x",*at);
+        }
+        else{
+            fputc(*at,out);
+        }
+    }
+}
+
+///write the name of a function, made up from its address if it has no symbol
+///param: cfg, func index, json 1 for JSON 0 for DOT, out
+static void cfg_write_name(cfg_t* cfg, uint32_t func, int json, FILE* out){
+    if(cfg->funcs[func].name){
+        cfg_write_quoted(cfg->funcs[func].name,json,out);
+    }
+    else{
+        fprintf(out,"fn_%08x",cfg->base+cfg->funcs[func].start*4);
+    }
+}
+
+///write a callee, either a function in the module or an external symbol
+///param: cfg, callee from cfg_edges, json 1 for JSON 0 for DOT, out
+static void cfg_write_callee(cfg_t* cfg, int64_t callee, int json, FILE* out){
+    if(callee<0){
+        cfg_write_quoted(get_string(cfg->MODULE,ntohl(cfg->MODULE->REFTAB[-callee-1].sym)),json,out);
+    }
+    else{
+        cfg_write_name(cfg,callee,json,out);
+    }
+}
+
+///write the analysis as a graphviz digraph or as JSON
+///in DOT blocks are clustered by function and calls are dashed edges
+///param: cfg, json 1 for JSON 0 for DOT, out
+void write_cfg(cfg_t* cfg, int json, FILE* out){
+    uint32_t nedges = 0;
+    int64_t* edges = cfg_edges(cfg,&nedges);
+    uint32_t edge = 0;
+    if(json){
+        fprintf(out,"{\"functions\":[");
+        for(uint32_t func=0;func<cfg->nfuncs;func++){
+            cfg_func_t* f = &cfg->funcs[func];
+            cfg_block_t* last = &cfg->blocks[f->first_block+f->nblocks-1];
+            fprintf(out,"%s\n {\"name\":\"",func?",":"");
+            cfg_write_name(cfg,func,json,out);
+            fprintf(out,"\",\"start\":%u,\"end\":%u,\"blocks\":[",cfg->base+f->start*4,cfg->base+last->end*4);
+            for(uint32_t block=f->first_block;block<f->first_block+f->nblocks;block++){
+                cfg_block_t* b = &cfg->blocks[block];
+                fprintf(out,"%s{\"start\":%u,\"end\":%u,\"succ\":[",block>f->first_block?",":"",
+                        cfg->base+b->start*4,cfg->base+b->end*4);
+                for(uint32_t succ=0;succ<b->nsucc;succ++){
+                    fprintf(out,"%s%u",succ?",":"",cfg->base+b->succ[succ]*4);
+                }
+                fprintf(out,"]}");
+            }
+            fprintf(out,"],\"calls\":[");
+            for(int first=1;edge<nedges&&edges[edge*2]==func;edge++,first=0){
+                fprintf(out,"%s\"",first?"":",");
+                cfg_write_callee(cfg,edges[edge*2+1],json,out);
+                fprintf(out,"\"");
+            }
+            fprintf(out,"]}");
+        }
+        fprintf(out,"\n]}\n");
+    }
+    else{
+        fprintf(out,"digraph cfg {\n  node [shape=box,fontname=monospace];\n");
+        for(uint32_t func=0;func<cfg->nfuncs;func++){
+            cfg_func_t* f = &cfg->funcs[func];
+            fprintf(out,"  subgraph cluster_%u {\n    label=\"",func);
+            cfg_write_name(cfg,func,json,out);
+            fprintf(out,"\";\n");
+            for(uint32_t block=f->first_block;block<f->first_block+f->nblocks;block++){
+                cfg_block_t* b = &cfg->blocks[block];
+                fprintf(out,"    b%u [label=\"%#010x-%#010x\"];\n",b->start,cfg->base+b->start*4,cfg->base+b->end*4-4);
+            }
+            fprintf(out,"  }\n");
+        }
+        for(uint32_t block=0;block<cfg->nblocks;block++){
+            for(uint32_t succ=0;succ<cfg->blocks[block].nsucc;succ++){
+                fprintf(out,"  b%u -> b%u;\n",cfg->blocks[block].start,cfg->blocks[block].succ[succ]);
+            }
+        }
+        for(edge=0;edge<nedges;edge++){
+            fprintf(out,"  b%u -> ",cfg->funcs[edges[edge*2]].start);
+            if(edges[edge*2+1]<0){
+                fprintf(out,"\"");
+                cfg_write_callee(cfg,edges[edge*2+1],json,out);
+                fprintf(out,"\" [style=dashed];\n");
+            }
+            else{
+                fprintf(out,"b%u [style=dashed];\n",cfg->funcs[edges[edge*2+1]].start);
+            }
+        }
+        fprintf(out,"}\n");
+    }
+    free(edges);
+}
+
+///print the size of the analysis
+///param: cfg
+void print_cfg_summary(cfg_t* cfg){
+    fprintf(OUT,"Found %u functions, %u basic blocks and %u call sites\n",cfg->nfuncs,cfg->nblocks,cfg->ncalls);
+}
+
+///free the analysis
+///param: cfg
+void destroy_cfg(cfg_t* cfg){
+    free(cfg->leader);
+    free(cfg->jump_hint);
+    free(cfg->ref);
+    free(cfg->blocks);
+    free(cfg->funcs);
+    free(cfg->calls);
+    free(cfg);
+}
@@ -0,0 +1,357 @@
+///author: jmp1617
+///purpose: opcode mix, byte entropy and zero runs of the sections, for the stats-content command
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///bytes scanned by one job, a whole number of blocks
+#define CONTENT_CHUNK (1u<<20)
+///bytes the entropy of each block is taken over
+#define CONTENT_BLOCK 4096
+///characters in the entropy map
+#define CONTENT_MAP 64
+///largest zero runs listed for each section
+#define CONTENT_RUNS 5
+
+///opcode histogram bins: the primary opcodes, then the special functs, the regimm branches and nop
+#define BIN_SPECIAL 64
+#define BIN_REGIMM 128
+#define BIN_NOP 160
+#define N_BINS 161
+
+///struct to hold one job of the scan, a chunk of a section
+typedef struct content_job{
+    const uint8_t* data;
+    uint32_t size;
+    int text;//1 to also count opcodes
+    int little;//1 if the words are little endian
+    float* entropy;//entropy of each block in the chunk, in bits per byte
+    uint64_t bytes[256];//byte histogram of the chunk
+    uint64_t bins[N_BINS];//opcode histogram of the chunk
+}content_job_t;
+
+///struct to hold a zero run
+typedef struct zero_run{
+    uint32_t start;
+    uint32_t length;
+}zero_run_t;
+
+///c*log2(c) for every count a block can hold, so block entropy needs no log calls
+static float clogc[CONTENT_BLOCK+1];
+static pthread_once_t clogc_once = PTHREAD_ONCE_INIT;
+
+///fill in the c*log2(c) table
+static void init_clogc(void){
+    for(int c=1;c<=CONTENT_BLOCK;c++){
+        clogc[c] = c*log2((double)c);
+    }
+}
+
+///get the entropy of a byte histogram
+///param: counts per byte value, total bytes counted
+///return: bits per byte
+static double entropy_of(const uint64_t counts[256], uint64_t total){
+    double sum = 0;
+    for(int b=0;b<256;b++){
+        if(counts[b]){
+            sum += counts[b]*log2((double)counts[b]);
+        }
+    }
+    return total?log2((double)total)-sum/total:0;
+}
+
+///count the bytes of one block, four tables are filled in turn so repeated bytes do not wait on each other
+///param: data of the block, size at most CONTENT_BLOCK, counts set to the histogram
+static void count_block(const uint8_t* data, uint32_t size, uint16_t counts[256]){
+    uint16_t sub[4][256];
+    memset(sub,0,sizeof(sub));
+    uint32_t at = 0;
+    for(;at+4<=size;at+=4){
+        sub[0][data[at]]++;
+        sub[1][data[at+1]]++;
+        sub[2][data[at+2]]++;
+        sub[3][data[at+3]]++;
+    }
+    for(;at<size;at++){
+        sub[0][data[at]]++;
+    }
+    for(int b=0;b<256;b++){
+        counts[b] = sub[0][b]+sub[1][b]+sub[2][b]+sub[3][b];
+    }
+}
+
+///get the opcode bin of an instruction word
+///param: word the instruction
+///return: the bin
+static uint32_t opcode_bin(uint32_t word){
+    uint32_t op = word>>26;
+    if(!word){
+        return BIN_NOP;
+    }
+    return op==0?BIN_SPECIAL+(word&0x3f):op==1?BIN_REGIMM+((word>>16)&0x1f):op;
+}
+
+///scan one chunk, counting bytes per block and opcodes
+///param: arg the content_job_t to process
+static void* content_scan(void* arg){
+    content_job_t* job = arg;
+    uint16_t counts[256];
+    for(uint32_t block=0;block*CONTENT_BLOCK<job->size;block++){
+        uint32_t size = job->size-block*CONTENT_BLOCK<CONTENT_BLOCK?job->size-block*CONTENT_BLOCK:CONTENT_BLOCK;
+        count_block(job->data+block*CONTENT_BLOCK,size,counts);
+        float sum = 0;
+        for(int b=0;b<256;b++){
+            job->bytes[b] += counts[b];
+            sum += clogc[counts[b]];
+        }
+        job->entropy[block] = clogc[size]/size-sum/size;//log2(n) - sum(c log2 c)/n
+    }
+    if(job->text){
+        uint32_t bins[4][N_BINS];
+        memset(bins,0,sizeof(bins));
+        uint32_t words = job->size/4, at = 0;
+        uint32_t insn[4];
+        for(;at+4<=words;at+=4){
+            memcpy(insn,job->data+at*4,sizeof(insn));
+            bins[0][opcode_bin(SECTION_WORD(job->little,insn[0]))]++;
+            bins[1][opcode_bin(SECTION_WORD(job->little,insn[1]))]++;
+            bins[2][opcode_bin(SECTION_WORD(job->little,insn[2]))]++;
+            bins[3][opcode_bin(SECTION_WORD(job->little,insn[3]))]++;
+        }
+        for(;at<words;at++){
+            memcpy(insn,job->data+at*4,sizeof(uint32_t));
+            bins[0][opcode_bin(SECTION_WORD(job->little,insn[0]))]++;
+        }
+        for(int bin=0;bin<N_BINS;bin++){
+            job->bins[bin] = (uint64_t)bins[0][bin]+bins[1][bin]+bins[2][bin]+bins[3][bin];
+        }
+    }
+    return NULL;
+}
+
+///run the jobs, one wave of threads at a time
+///param: jobs, njobs
+static void run_jobs(content_job_t* jobs, uint32_t njobs){
+    uint32_t nthreads = get_nprocs();
+    if(nthreads>njobs){
+        nthreads = njobs;
+    }
+    for(uint32_t first=0;first<njobs;first+=nthreads){
+        pthread_t threads[nthreads];
+        int started[nthreads];
+        for(uint32_t t=0;t<nthreads&&first+t<njobs;t++){
+            started[t] = nthreads>1&&!pthread_create(&threads[t],NULL,content_scan,&jobs[first+t]);
+            if(!started[t]){
+                content_scan(&jobs[first+t]);
+            }
+        }
+        for(uint32_t t=0;t<nthreads&&first+t<njobs;t++){
+            if(started[t]){
+                pthread_join(threads[t],NULL);
+            }
+        }
+    }
+}
+
+///load 8 bytes from any alignment
+///param: data
+///return: the bytes as one word, zero only if they all are
+static inline uint64_t load_word(const uint8_t* data){
+    uint64_t word;
+    memcpy(&word,data,sizeof(word));
+    return word;
+}
+
+///find the zero runs of at least min_run bytes, keeping the longest
+///any such run holds an aligned zero word, so the data is looked at a word at a time until one is found
+///param: data, size, min_run at least 16, runs set to the longest, nruns set to how many were kept
+///return: bytes in runs, count set to the number of runs
+static uint64_t find_zero_runs(const uint8_t* data, uint32_t size, uint32_t min_run, zero_run_t runs[CONTENT_RUNS],
+        int* nruns, uint32_t* count){
+    uint64_t covered = 0;
+    *nruns = 0;
+    *count = 0;
+    uint32_t nwords = size/8;
+    for(uint32_t w=0;w<nwords;w++){
+        if(load_word(data+w*8)){
+            continue;
+        }
+        uint32_t start = w*8, end = (w+1)*8;
+        while(start>0&&!data[start-1]){
+            start--;
+        }
+        while(end/8<nwords&&!load_word(data+end)){
+            end += 8;
+        }
+        while(end<size&&!data[end]){
+            end++;
+        }
+        w = (end+7)/8-1;//the loop steps past the last word the run touches
+        uint32_t length = end-start;
+        if(length<min_run){
+            continue;
+        }
+        (*count)++;
+        covered += length;
+        int slot;
+        if(*nruns<CONTENT_RUNS){
+            slot = (*nruns)++;
+        }
+        else if(runs[CONTENT_RUNS-1].length>=length){
+            continue;//no longer than every run kept
+        }
+        else{
+            slot = CONTENT_RUNS-1;
+        }
+        while(slot>0&&runs[slot-1].length<length){//keep the runs longest first
+            runs[slot] = runs[slot-1];
+            slot--;
+        }
+        runs[slot].start = start;
+        runs[slot].length = length;
+    }
+    return covered;
+}
+
+///histogram being sorted, qsort has no context argument
+static uint64_t* sorting;
+
+///compare two opcode bins by count, then bin
+static int compare_bins(const void* a, const void* b){
+    int x = *(const int*)a, y = *(const int*)b;
+    if(sorting[x]!=sorting[y]){
+        return sorting[x]>sorting[y]?-1:1;
+    }
+    return x-y;
+}
+
+///print the opcode mix of the text section
+///param: bins the opcode histogram, words in text
+static void print_opcodes(uint64_t bins[N_BINS], uint64_t words){
+    int order[N_BINS];
+    for(int bin=0;bin<N_BINS;bin++){
+        order[bin] = bin;
+    }
+    sorting = bins;
+    qsort(order,N_BINS,sizeof(int),compare_bins);
+    fprintf(OUT,"text: %llu instructions, %llu nop (%.1f%%)\n",(unsigned long long)words,
+            (unsigned long long)bins[BIN_NOP],100.0*bins[BIN_NOP]/words);
+    for(int rank=0;rank<N_BINS&&bins[order[rank]];rank++){
+        int bin = order[rank];
+        uint32_t word = bin==BIN_NOP?0:bin<BIN_SPECIAL?(uint32_t)bin<<26:bin<BIN_REGIMM?(uint32_t)(bin-BIN_SPECIAL)
+                :1u<<26|(uint32_t)(bin-BIN_REGIMM)<<16;
+        const char* name = bin==BIN_NOP?"nop":instruction_name(word);
+        char reserved[32];
+        if(!name){
+            snprintf(reserved,sizeof(reserved),bin<BIN_SPECIAL?"(opcode %d)":bin<BIN_REGIMM?"(funct %d)":"(regimm %d)",
+                    bin<BIN_SPECIAL?bin:bin<BIN_REGIMM?bin-BIN_SPECIAL:bin-BIN_REGIMM);
+            name = reserved;
+        }
+        fprintf(OUT,"   %-14s %10llu %5.1f%%\n",name,(unsigned long long)bins[bin],100.0*bins[bin]/words);
+    }
+}
+
+///print the entropy, zero bytes and zero runs of a section
+///param: name of the section, start address, data, size, entropy of each block, bytes histogram, min_run
+static void print_section(char* name, uint32_t start, const uint8_t* data, uint32_t size, float* entropy,
+        uint64_t bytes[256], uint32_t min_run){
+    static const char scale[] = " .:-=+*#%@";
+    fprintf(OUT,"%s: %u bytes, %.2f bits per byte, %llu zero bytes (%.1f%%)\n",name,size,entropy_of(bytes,size),
+            (unsigned long long)bytes[0],100.0*bytes[0]/size);
+    zero_run_t runs[CONTENT_RUNS];
+    int nruns;
+    uint32_t count;
+    uint64_t covered = find_zero_runs(data,size,min_run,runs,&nruns,&count);
+    fprintf(OUT,"   %u zero run%s of %u bytes or more, %llu bytes (%.1f%%)\n",count,count==1?"":"s",min_run,
+            (unsigned long long)covered,100.0*covered/size);
+    for(int run=0;run<nruns;run++){
+        fprintf(OUT,"      %#010x %u bytes\n",start+runs[run].start,runs[run].length);
+    }
+    uint32_t nblocks = (size+CONTENT_BLOCK-1)/CONTENT_BLOCK;
+    uint32_t per = (nblocks+CONTENT_MAP-1)/CONTENT_MAP;
+    char map[CONTENT_MAP+1];
+    int width = 0;
+    for(uint32_t first=0;first<nblocks;first+=per){
+        float sum = 0;
+        uint32_t n = nblocks-first<per?nblocks-first:per;
+        for(uint32_t block=first;block<first+n;block++){
+            sum += entropy[block];
+        }
+        int level = (int)(sum/n/8*(sizeof(scale)-2)+0.5);
+        map[width++] = scale[level<0?0:level>(int)sizeof(scale)-2?(int)sizeof(scale)-2:level];
+    }
+    map[width] = '\0';
+    fprintf(OUT,"   entropy, %u KB per character from ' ' (0 bits) to '@' (8 bits): |%s|\n",per*CONTENT_BLOCK/1024,map);
+}
+
+///print the opcode mix of text and the entropy and zero runs of text, rdata, data and sdata
+///sbss and bss are not scanned, they are zero by definition
+///param: MODULE, min_run shortest zero run to report, at least 16
+///return: 0 on success 1 if the sections could not be read
+int print_content(module_t* MODULE, uint32_t min_run){
+    static char* sections[] = {"text","rdata","data","sdata"};
+    if(load_sections(MODULE,SECTION_BIT(EH_IX_TEXT)|SECTION_BIT(EH_IX_RDATA)|SECTION_BIT(EH_IX_DATA)
+                |SECTION_BIT(EH_IX_SDATA))){
+        return 1;
+    }
+    pthread_once(&clogc_once,init_clogc);
+    uint32_t njobs = 0, nblocks = 0;
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_SDATA;sec++){
+        uint32_t size = get_size(sections[sec],MODULE);
+        njobs += (size+CONTENT_CHUNK-1)/CONTENT_CHUNK;
+        nblocks += (size+CONTENT_BLOCK-1)/CONTENT_BLOCK;
+    }
+    content_job_t* jobs = calloc(njobs?njobs:1,sizeof(content_job_t));
+    float* entropy = malloc((nblocks?nblocks:1)*sizeof(float));
+    uint32_t job = 0, block = 0;
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_SDATA;sec++){
+        uint32_t size = get_size(sections[sec],MODULE);
+        for(uint32_t at=0;at<size;at+=CONTENT_CHUNK){
+            jobs[job].data = (uint8_t*)*get_section(MODULE,sec)+at;
+            jobs[job].size = size-at<CONTENT_CHUNK?size-at:CONTENT_CHUNK;
+            jobs[job].text = sec==EH_IX_TEXT;
+            jobs[job].little = MODULE->LITTLE;
+            jobs[job].entropy = entropy+block;
+            block += (jobs[job].size+CONTENT_BLOCK-1)/CONTENT_BLOCK;
+            job++;
+        }
+    }
+    run_jobs(jobs,njobs);
+    job = 0;
+    block = 0;
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_SDATA;sec++){
+        uint32_t size = get_size(sections[sec],MODULE);
+        if(!size){
+            fprintf(OUT,"%s: empty\n",sections[sec]);
+            continue;
+        }
+        uint64_t bytes[256] = {0}, bins[N_BINS] = {0};
+        float* first = entropy+block;
+        for(uint32_t at=0;at<size;at+=CONTENT_CHUNK,job++){
+            for(int b=0;b<256;b++){
+                bytes[b] += jobs[job].bytes[b];
+            }
+            for(int bin=0;bin<N_BINS;bin++){
+                bins[bin] += jobs[job].bins[bin];
+            }
+            block += (jobs[job].size+CONTENT_BLOCK-1)/CONTENT_BLOCK;
+        }
+        if(sec==EH_IX_TEXT&&size>=4){
+            print_opcodes(bins,size/4);
+        }
+        print_section(sections[sec],MODULE->HEADER->entry?get_start(MODULE,sections[sec]):0,
+                *get_section(MODULE,sec),size,first,bytes,min_run);
+    }
+    for(int sec=EH_IX_SBSS;sec<=EH_IX_BSS;sec++){
+        fprintf(OUT,"%s: %u bytes, all zero\n",sec==EH_IX_SBSS?"sbss":"bss",
+                ntohl(MODULE->HEADER->data[sec]));
+    }
+    free(jobs);
+    free(entropy);
+    return 0;
+}
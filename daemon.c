@@ -0,0 +1,258 @@
+///author: jmp1617
+///purpose: keep modules resident and serve edit commands over a unix socket
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lmedit.h"
+
+///line sent after the output of each command
+#define END_OF_REPLY ".\n"
+
+///struct to hold a module kept in memory by the daemon
+typedef struct resident{
+    char path[PATH_MAX];
+    module_t* MODULE;//NULL until it has loaded, and after a load that failed
+    int loading;//1 while a client loads it outside residents_lock
+    pthread_rwlock_t lock;//readers examine, writers edit and write
+    int changed;
+}resident_t;
+
+///modules loaded so far, entries are never freed so clients can keep pointers to them
+static resident_t** residents;
+static int nresidents;
+static pthread_mutex_t residents_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t residents_loaded = PTHREAD_COND_INITIALIZER;//signalled when a load finishes
+
+///find a resident module or load it
+///the entry goes in first as a placeholder so the load runs without residents_lock held,
+///clients opening the same path wait for it and others carry on
+///param: file to open
+///return: the resident module, NULL if it could not be loaded
+static resident_t* open_resident(char* file){
+    char path[PATH_MAX];
+    resident_t* found = NULL;
+    if(!realpath(file,path)){
+        fprintf(ERR,"error: %s could not be found\n",file);
+        return NULL;
+    }
+    pthread_mutex_lock(&residents_lock);
+    for(int r=0;r<nresidents&&!found;r++){
+        if(!strcmp(residents[r]->path,path)){
+            found = residents[r];
+        }
+    }
+    if(!found){
+        resident_t** grown = realloc(residents,(nresidents+1)*sizeof(resident_t*));
+        found = grown?calloc(1,sizeof(resident_t)):NULL;
+        if(grown){
+            residents = grown;
+        }
+        if(!found){
+            pthread_mutex_unlock(&residents_lock);
+            fprintf(ERR,"error: not enough memory to load %s\n",path);
+            return NULL;
+        }
+        strcpy(found->path,path);
+        pthread_rwlock_init(&found->lock,NULL);
+        residents[nresidents++] = found;
+    }
+    while(found->loading){
+        pthread_cond_wait(&residents_loaded,&residents_lock);
+    }
+    if(!found->MODULE){//new, or an earlier load failed and this client tries again
+        found->loading = 1;
+        pthread_mutex_unlock(&residents_lock);
+        module_t* MODULE = load_module(path);
+        pthread_mutex_lock(&residents_lock);
+        found->MODULE = MODULE;
+        found->loading = 0;
+        pthread_cond_broadcast(&residents_loaded);
+    }
+    module_t* MODULE = found->MODULE;
+    pthread_mutex_unlock(&residents_lock);
+    return MODULE?found:NULL;
+}
+
+///run one command for a client
+///param: line of the command, current module, current section of the client
+static void serve_command(char* line, resident_t** current, char section[10]){
+    char arg[PATH_MAX];
+    resident_t* resident = *current;
+    if(sscanf(line,"open %4095s",arg)==1){
+        resident_t* opened = open_resident(arg);
+        if(opened){
+            *current = opened;
+            strcpy(section,"text");
+            fprintf(OUT,"Now editing %s\n",opened->path);
+        }
+        return;
+    }
+    if(!strcmp(line,"modules")){
+        pthread_mutex_lock(&residents_lock);
+        for(int r=0;r<nresidents;r++){
+            if(residents[r]->MODULE){
+                fprintf(OUT,"%s%s\n",residents[r]->path,residents[r]==resident?" (current)":"");
+            }
+        }
+        pthread_mutex_unlock(&residents_lock);
+        return;
+    }
+    if(!strcmp(line,"stats")){
+        print_stats();
+        return;
+    }
+    if(!resident){
+        fprintf(ERR,"error: no module is open, use open [file]\n");
+        return;
+    }
+    module_t* MODULE = resident->MODULE;
+    uint64_t began = stats_now();
+    int stat = STAT_NONE;
+    if(sscanf(line,"section %31s",arg)==1){
+        stat = STAT_SECTION;
+        pthread_rwlock_rdlock(&resident->lock);
+        if(!select_section(MODULE,arg)){
+            strcpy(section,arg);
+        }
+        pthread_rwlock_unlock(&resident->lock);
+    }
+    else if(!strcmp(line,"size")){
+        stat = STAT_SIZE;
+        pthread_rwlock_rdlock(&resident->lock);
+        print_size(MODULE,section);
+        pthread_rwlock_unlock(&resident->lock);
+    }
+    else if(!strcmp(line,"write")){
+        stat = STAT_WRITE;
+        pthread_rwlock_wrlock(&resident->lock);
+        if(!resident->changed){
+            fprintf(OUT,"There have been no changes: nothing to write\n");
+        }
+        else if(!write_module(MODULE,resident->path)){
+            resident->changed = 0;
+        }
+        pthread_rwlock_unlock(&resident->lock);
+    }
+    else{
+        unsigned int x_command[6] = {0};
+        if(strstr(line,":i=")){
+            stat = STAT_ASSEMBLE;
+            pthread_rwlock_wrlock(&resident->lock);//looking a symbol up may build the index
+            if(!assemble_command(MODULE,line,section,x_command)&&edit_module(MODULE,x_command,section)){
+                resident->changed = 1;
+                invalidate_indexes(MODULE,get_index(section),0);
+            }
+        }
+        else if(proccess_x_command(x_command,line)){
+            return;
+        }
+        else if(x_command[4]==1||x_command[4]==3){//edits take the module for themselves
+            stat = STAT_EDIT;
+            pthread_rwlock_wrlock(&resident->lock);
+            if(edit_module(MODULE,x_command,section)){
+                resident->changed = 1;
+                invalidate_indexes(MODULE,get_index(section),0);
+            }
+        }
+        else{
+            stat = STAT_EXAMINE;
+            pthread_rwlock_rdlock(&resident->lock);
+            edit_module(MODULE,x_command,section);
+        }
+        pthread_rwlock_unlock(&resident->lock);
+    }
+    if(stat!=STAT_NONE){
+        stats_record(stat,began);
+    }
+}
+
+///serve one client until it quits or hangs up
+///param: arg the connected socket
+static void* serve_client(void* arg){
+    int fd = (int)(intptr_t)arg;
+    FILE* in = fdopen(fd,"r");
+    int out_fd = dup(fd);
+    client_out = out_fd>=0?fdopen(out_fd,"w"):NULL;
+    if(!in||!client_out){
+        dprintf(fd,"error: the connection could not be set up: %s\n" END_OF_REPLY,strerror(errno));
+        if(in){
+            fclose(in);
+        }
+        else{
+            close(fd);
+        }
+        if(client_out){
+            fclose(client_out);
+        }
+        else if(out_fd>=0){
+            close(out_fd);
+        }
+        return NULL;
+    }
+    resident_t* current = NULL;
+    char section[10] = "text";
+    char line[PATH_MAX+16];
+    while(fgets(line,sizeof(line),in)){
+        line[strcspn(line,"\r\n")] = '\0';
+        if(!strcmp(line,"quit")){
+            break;
+        }
+        if(line[0]){
+            serve_command(line,&current,section);
+        }
+        fputs(END_OF_REPLY,client_out);
+        fflush(client_out);//one write per reply
+    }
+    fclose(in);
+    fclose(client_out);
+    client_out = NULL;
+    return NULL;
+}
+
+///keep modules in memory and serve clients on a unix socket until killed
+///each client gets a thread, edits and writes take the module's lock for writing
+///param: socket_path to listen on, files to load up front, nfiles
+///return: 1 if the socket could not be set up
+int serve_modules(char* socket_path, char** files, int nfiles){
+    struct sockaddr_un addr = {0};
+    if(strlen(socket_path)>=sizeof(addr.sun_path)){
+        fprintf(stderr,"error: the socket path %s is too long\n",socket_path);
+        return 1;
+    }
+    for(int f=0;f<nfiles;f++){
+        if(!open_resident(files[f])){
+            return 1;
+        }
+    }
+    int listener = socket(AF_UNIX,SOCK_STREAM,0);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,socket_path);
+    unlink(socket_path);
+    if(listener<0||bind(listener,(struct sockaddr*)&addr,sizeof(addr))||listen(listener,64)){
+        perror(socket_path);
+        return 1;
+    }
+    signal(SIGPIPE,SIG_IGN);//a client hanging up mid reply is not fatal
+    printf("Serving %d module%s on %s\n",nresidents,nresidents==1?"":"s",socket_path);
+    fflush(stdout);
+    while(1){
+        int client = accept(listener,NULL,NULL);
+        pthread_t thread;
+        if(client<0){
+            continue;
+        }
+        if(pthread_create(&thread,NULL,serve_client,(void*)(intptr_t)client)){
+            close(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
@@ -0,0 +1,647 @@
+///author: jmp1617
+///purpose: convert between R2K modules and big-endian ELF32 MIPS files
+#define _GNU_SOURCE //copy_file_range
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///the ELF index of an R2K section is its EH_IX_ index + 1
+#define ELF_SEC(sec) ((sec)+1)
+///the section symbols follow the null symbol, the module's symbols follow them
+#define FIRST_SYMBOL (EH_IX_BSS+2)
+///section holding the header and tables as they are in the module, so converting back is exact
+#define R2K_TABLES ".r2k.tables"
+#define COPY_CHUNK (1<<20)
+#define ALIGN8(n) (((n)+7)&~(uint64_t)7)
+
+static char* elf_names[] = {".text",".rdata",".data",".sdata",".sbss",".bss"};
+
+///write all of a buffer at an offset
+///param: fd, offset, data, bytes
+///return: 0 on success, 1 on error
+static int put_at(int fd, uint64_t offset, const void* data, size_t bytes){
+    const uint8_t* at = data;
+    while(bytes){
+        ssize_t put = pwrite(fd,at,bytes,offset);
+        if(put<0&&errno==EINTR){
+            continue;
+        }
+        if(put<=0){
+            return 1;
+        }
+        at += put;
+        offset += put;
+        bytes -= put;
+    }
+    return 0;
+}
+
+///copy bytes between files, in the kernel where it can be and through a buffer where not
+///param: in, from offset in it, out, to offset in it, bytes
+///return: 0 on success, 1 on error
+static int copy_bytes(int in, uint64_t from, int out, uint64_t to, uint64_t bytes){
+    while(bytes){
+        loff_t off_in = from, off_out = to;
+        ssize_t got = copy_file_range(in,&off_in,out,&off_out,bytes,0);
+        if(got<0&&errno==EINTR){
+            continue;
+        }
+        if(got<=0){
+            break;//not supported between these files, or the input ended
+        }
+        from += got;
+        to += got;
+        bytes -= got;
+    }
+    if(!bytes){
+        return 0;
+    }
+    uint8_t* buffer = malloc(COPY_CHUNK);
+    while(buffer&&bytes){
+        ssize_t got = pread(in,buffer,bytes<COPY_CHUNK?bytes:COPY_CHUNK,from);
+        if(got<0&&errno==EINTR){
+            continue;
+        }
+        if(got<=0||put_at(out,to,buffer,got)){
+            break;
+        }
+        from += got;
+        to += got;
+        bytes -= got;
+    }
+    free(buffer);
+    return bytes!=0;
+}
+
+///get the ELF relocations that do what an R2K relocation type does
+///param: type from the entry, elf set to the ELF types
+///return: how many ELF relocations it takes, 0 if there is no equivalent
+static int elf_types(uint8_t type, uint32_t elf[2]){
+    switch(type&0x0f){
+        case REL_IMM: elf[0] = R_MIPS_LO16; return 1;
+        case REL_IMM_2: elf[0] = R_MIPS_HI16; elf[1] = R_MIPS_LO16; return 2;//lui then the instruction after
+        case REL_WORD: elf[0] = R_MIPS_32; return 1;
+        case REL_JUMP: elf[0] = R_MIPS_26; return 1;
+    }
+    return 0;
+}
+
+///add a name to a string table being built
+///param: table, length of it so far, name
+///return: index of the name
+static uint32_t add_name(char* table, uint32_t* length, char* name){
+    uint32_t index = *length;
+    strcpy(table+index,name);
+    *length += strlen(name)+1;
+    return index;
+}
+
+///write a module as an ELF file: relocatable for an object module, executable for a load module
+///the sections are copied from the module file to the ELF file without passing through memory
+///param: file of the module, elf file to write
+///return: 0 on success, 1 on error
+int module_to_elf(char* file, char* elf){
+    module_t* MODULE = load_module(file);
+    if(!MODULE){
+        return 1;
+    }
+    if(MODULE->LITTLE){//the sections are copied to the ELF file as they are, which is big endian
+        fprintf(ERR,"error: %s is little endian, only big endian modules convert to ELF\n",file);
+        destroy_module(MODULE);
+        return 1;
+    }
+    if(load_sections(MODULE,TABLE_SECTIONS)){
+        destroy_module(MODULE);
+        return 1;
+    }
+    exec_t* header = MODULE->HEADER;
+    int load = header->entry!=0x0;
+    uint32_t nrel = ntohl(header->data[EH_IX_REL]), nref = ntohl(header->data[EH_IX_REF]);
+    uint32_t nsyms = ntohl(header->data[EH_IX_SYM]), nstrings = ntohl(header->data[EH_IX_STR]);
+    uint32_t start[EH_IX_BSS+1], size[EH_IX_BSS+1];
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        start[sec] = load?get_start(MODULE,elf_names[sec]+1):0;
+        size[sec] = ntohl(header->data[sec]);
+    }
+    //names a reftab entry uses that no symtab entry defines become undefined symbols
+    uint32_t nslots = 16;
+    while(nslots<2ull*nref){
+        nslots <<= 1;
+    }
+    uint32_t* slot_name = calloc(nslots,sizeof(uint32_t));//string index + 1, 0 when empty
+    uint32_t* slot_symbol = malloc(nslots*sizeof(uint32_t));
+    uint32_t* ref_symbol = malloc((nref?nref:1)*sizeof(uint32_t));
+    uint32_t nundefined = 0;
+    for(uint32_t entry=0;entry<nref;entry++){
+        uint32_t name = ntohl(MODULE->REFTAB[entry].sym);
+        int64_t defined = find_symbol(MODULE,get_string(MODULE,name));
+        if(defined>=0){
+            ref_symbol[entry] = FIRST_SYMBOL+defined;
+            continue;
+        }
+        uint32_t slot = (name*0x9e3779b1u)&(nslots-1);
+        while(slot_name[slot]&&slot_name[slot]!=name+1){
+            slot = (slot+1)&(nslots-1);
+        }
+        if(!slot_name[slot]){
+            slot_name[slot] = name+1;
+            slot_symbol[slot] = FIRST_SYMBOL+nsyms+nundefined++;
+        }
+        ref_symbol[entry] = slot_symbol[slot];
+    }
+    //relocations, grouped by the section they fix up
+    Elf32_Rel* rels[EH_IX_SDATA+1] = {0};
+    uint32_t nrels[EH_IX_SDATA+1] = {0};
+    uint32_t dropped = 0;
+    for(int pass=0;pass<2;pass++){
+        uint32_t placed[EH_IX_SDATA+1] = {0};
+        for(uint32_t entry=0;entry<nrel+nref;entry++){
+            int rel = entry<nrel;
+            uint8_t section = rel?MODULE->RELTAB[entry].section:MODULE->REFTAB[entry-nrel].section;
+            uint8_t type = rel?MODULE->RELTAB[entry].type:MODULE->REFTAB[entry-nrel].type;
+            uint32_t addr = ntohl(rel?MODULE->RELTAB[entry].addr:MODULE->REFTAB[entry-nrel].addr);
+            uint32_t types[2];
+            int count = elf_types(type,types);
+            if(section<1||section>EH_IX_SDATA+1||!count){
+                dropped += pass==0;
+                continue;
+            }
+            int sec = section-1;
+            if(pass==0){
+                nrels[sec] += count;
+                continue;
+            }
+            uint32_t symbol = rel?STN_UNDEF:ref_symbol[entry-nrel];//the reltab is relative to where the module loads
+            for(int part=0;part<count;part++){
+                Elf32_Rel* out = &rels[sec][placed[sec]++];
+                out->r_offset = htonl(addr+4*part);
+                out->r_info = htonl(ELF32_R_INFO(symbol,types[part]));
+            }
+        }
+        for(int sec=0;pass==0&&sec<=EH_IX_SDATA;sec++){
+            rels[sec] = malloc((nrels[sec]?nrels[sec]:1)*sizeof(Elf32_Rel));
+        }
+    }
+    //symbols: null, one per section, the symtab, then the undefined names
+    uint32_t nelfsyms = FIRST_SYMBOL+nsyms+nundefined;
+    Elf32_Sym* syms = calloc(nelfsyms,sizeof(Elf32_Sym));
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        syms[1+sec].st_value = htonl(start[sec]);
+        syms[1+sec].st_info = ELF32_ST_INFO(STB_LOCAL,STT_SECTION);
+        syms[1+sec].st_shndx = htons(ELF_SEC(sec));
+    }
+    for(uint32_t entry=0;entry<nsyms;entry++){
+        Elf32_Sym* sym = &syms[FIRST_SYMBOL+entry];
+        uint32_t value = ntohl(MODULE->SYMTAB[entry].value);
+        sym->st_name = MODULE->SYMTAB[entry].sym;
+        sym->st_value = MODULE->SYMTAB[entry].value;
+        sym->st_info = ELF32_ST_INFO(STB_GLOBAL,STT_NOTYPE);
+        sym->st_shndx = htons(SHN_ABS);//an object module's values do not say which section they are in
+        for(int sec=0;load&&sec<=EH_IX_BSS;sec++){
+            if(size[sec]&&value>=start[sec]&&value-start[sec]<size[sec]){
+                sym->st_info = ELF32_ST_INFO(STB_GLOBAL,sec==EH_IX_TEXT?STT_FUNC:STT_OBJECT);
+                sym->st_shndx = htons(ELF_SEC(sec));
+                break;
+            }
+        }
+    }
+    for(uint32_t slot=0;slot<nslots;slot++){
+        if(slot_name[slot]){
+            Elf32_Sym* sym = &syms[slot_symbol[slot]];
+            sym->st_name = htonl(slot_name[slot]-1);
+            sym->st_info = ELF32_ST_INFO(STB_GLOBAL,STT_NOTYPE);
+            sym->st_shndx = htons(SHN_UNDEF);
+        }
+    }
+    free(slot_name);
+    free(slot_symbol);
+    free(ref_symbol);
+    //lay the file out: sections at the same distance apart as their addresses, then the tables
+    char shstrtab[256];
+    uint32_t shstrlen = 1;
+    shstrtab[0] = '\0';
+    Elf32_Shdr shdrs[EH_IX_BSS+2+EH_IX_SDATA+1+4];
+    memset(shdrs,0,sizeof(shdrs));
+    int nphdrs = load?2:0;
+    uint64_t at = ALIGN8(sizeof(Elf32_Ehdr)+nphdrs*sizeof(Elf32_Phdr));
+    uint64_t offset[EH_IX_BSS+1];
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        static const uint32_t flags[] = {SHF_ALLOC|SHF_EXECINSTR,SHF_ALLOC,SHF_ALLOC|SHF_WRITE,
+                                         SHF_ALLOC|SHF_WRITE|SHF_MIPS_GPREL,SHF_ALLOC|SHF_WRITE|SHF_MIPS_GPREL,
+                                         SHF_ALLOC|SHF_WRITE};
+        if(sec==EH_IX_RDATA){
+            at = ALIGN8(at);
+        }
+        else if(sec>EH_IX_RDATA&&sec<EH_IX_SBSS){
+            at = offset[EH_IX_RDATA]+(load?start[sec]-start[EH_IX_RDATA]:ALIGN8(at-offset[EH_IX_RDATA]));
+        }
+        offset[sec] = at;
+        Elf32_Shdr* shdr = &shdrs[ELF_SEC(sec)];
+        shdr->sh_name = htonl(add_name(shstrtab,&shstrlen,elf_names[sec]));
+        shdr->sh_type = htonl(sec>=EH_IX_SBSS?SHT_NOBITS:SHT_PROGBITS);
+        shdr->sh_flags = htonl(flags[sec]);
+        shdr->sh_addr = htonl(start[sec]);
+        shdr->sh_offset = htonl(at);
+        shdr->sh_size = htonl(size[sec]);
+        shdr->sh_addralign = htonl(sec==EH_IX_TEXT?4:8);
+        if(sec<EH_IX_SBSS){
+            at += size[sec];
+        }
+    }
+    int nshdrs = ELF_SEC(EH_IX_BSS)+1;
+    int symtab = nshdrs+(nrels[0]>0)+(nrels[1]>0)+(nrels[2]>0)+(nrels[3]>0);
+    for(int sec=0;sec<=EH_IX_SDATA;sec++){
+        if(!nrels[sec]){
+            continue;
+        }
+        char name[16];
+        snprintf(name,sizeof(name),".rel%s",elf_names[sec]);
+        at = ALIGN8(at);
+        Elf32_Shdr* shdr = &shdrs[nshdrs++];
+        shdr->sh_name = htonl(add_name(shstrtab,&shstrlen,name));
+        shdr->sh_type = htonl(SHT_REL);
+        shdr->sh_flags = htonl(SHF_INFO_LINK);
+        shdr->sh_offset = htonl(at);
+        shdr->sh_size = htonl(nrels[sec]*sizeof(Elf32_Rel));
+        shdr->sh_link = htonl(symtab);
+        shdr->sh_info = htonl(ELF_SEC(sec));
+        shdr->sh_addralign = htonl(4);
+        shdr->sh_entsize = htonl(sizeof(Elf32_Rel));
+        at += nrels[sec]*sizeof(Elf32_Rel);
+    }
+    uint64_t tables = (uint64_t)nrel*RELENT_SIZE+(uint64_t)nref*REFENT_SIZE+(uint64_t)nsyms*SYMENT_SIZE;
+    struct{char* name; uint32_t type; uint64_t bytes; uint32_t link, info, entsize;} rest[] = {
+        {".symtab",SHT_SYMTAB,(uint64_t)nelfsyms*sizeof(Elf32_Sym),symtab+1,FIRST_SYMBOL,sizeof(Elf32_Sym)},
+        {".strtab",SHT_STRTAB,nstrings?nstrings:1,0,0,0},//the string table as it is, so names keep their index
+        {R2K_TABLES,SHT_PROGBITS,HEADER_SIZE+tables,0,0,0},
+        {".shstrtab",SHT_STRTAB,0,0,0,0},
+    };
+    uint64_t rest_at[4];
+    for(int r=0;r<4;r++){
+        rest_at[r] = at = ALIGN8(at);
+        Elf32_Shdr* shdr = &shdrs[nshdrs++];
+        shdr->sh_name = htonl(add_name(shstrtab,&shstrlen,rest[r].name));
+        if(r==3){
+            rest[r].bytes = shstrlen;
+        }
+        shdr->sh_type = htonl(rest[r].type);
+        shdr->sh_offset = htonl(at);
+        shdr->sh_size = htonl(rest[r].bytes);
+        shdr->sh_link = htonl(rest[r].link);
+        shdr->sh_info = htonl(rest[r].info);
+        shdr->sh_addralign = htonl(r==0?4:1);
+        shdr->sh_entsize = htonl(rest[r].entsize);
+        at += rest[r].bytes;
+    }
+    uint64_t shoff = ALIGN8(at);
+    if(shoff+nshdrs*sizeof(Elf32_Shdr)>UINT32_MAX){
+        fprintf(ERR,"error: %s is too big for an ELF32 file\n",file);
+        for(int sec=0;sec<=EH_IX_SDATA;sec++){
+            free(rels[sec]);
+        }
+        free(syms);
+        destroy_module(MODULE);
+        return 1;
+    }
+    Elf32_Ehdr ehdr = {0};
+    memcpy(ehdr.e_ident,ELFMAG,SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2MSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = htons(load?ET_EXEC:ET_REL);
+    ehdr.e_machine = htons(EM_MIPS);
+    ehdr.e_version = htonl(EV_CURRENT);
+    ehdr.e_entry = header->entry;
+    ehdr.e_phoff = htonl(nphdrs?sizeof(Elf32_Ehdr):0);
+    ehdr.e_shoff = htonl(shoff);
+    ehdr.e_flags = htonl(EF_MIPS_ARCH_1);
+    ehdr.e_ehsize = htons(sizeof(Elf32_Ehdr));
+    ehdr.e_phentsize = htons(nphdrs?sizeof(Elf32_Phdr):0);
+    ehdr.e_phnum = htons(nphdrs);
+    ehdr.e_shentsize = htons(sizeof(Elf32_Shdr));
+    ehdr.e_shnum = htons(nshdrs);
+    ehdr.e_shstrndx = htons(nshdrs-1);
+    Elf32_Phdr phdrs[2];
+    memset(phdrs,0,sizeof(phdrs));
+    if(load){
+        phdrs[0].p_type = htonl(PT_LOAD);
+        phdrs[0].p_offset = htonl(offset[EH_IX_TEXT]);
+        phdrs[0].p_vaddr = phdrs[0].p_paddr = htonl(start[EH_IX_TEXT]);
+        phdrs[0].p_filesz = phdrs[0].p_memsz = htonl(size[EH_IX_TEXT]);
+        phdrs[0].p_flags = htonl(PF_R|PF_X);
+        phdrs[0].p_align = htonl(8);
+        phdrs[1].p_type = htonl(PT_LOAD);
+        phdrs[1].p_offset = htonl(offset[EH_IX_RDATA]);
+        phdrs[1].p_vaddr = phdrs[1].p_paddr = htonl(start[EH_IX_RDATA]);
+        phdrs[1].p_filesz = htonl(start[EH_IX_SDATA]+size[EH_IX_SDATA]-start[EH_IX_RDATA]);
+        phdrs[1].p_memsz = htonl(start[EH_IX_BSS]+size[EH_IX_BSS]-start[EH_IX_RDATA]);
+        phdrs[1].p_flags = htonl(PF_R|PF_W);
+        phdrs[1].p_align = htonl(8);
+    }
+    //write it in one pass, the gaps between sections are left as holes that read back as zeros
+    char target[PATH_MAX], tmpname[PATH_MAX+4];
+    int fd = open_replacement(elf,target,tmpname);
+    int failed = fd<0;
+    failed = failed||put_at(fd,0,&ehdr,sizeof(ehdr))||put_at(fd,sizeof(ehdr),phdrs,nphdrs*sizeof(Elf32_Phdr));
+    for(int sec=0;sec<=EH_IX_SDATA&&!failed;sec++){
+        failed = copy_bytes(MODULE->FD,MODULE->OFFSET[sec],fd,offset[sec],size[sec]);
+    }
+    for(int sec=0,r=ELF_SEC(EH_IX_BSS)+1;sec<=EH_IX_SDATA&&!failed;sec++){
+        if(nrels[sec]){
+            failed = put_at(fd,ntohl(shdrs[r++].sh_offset),rels[sec],nrels[sec]*sizeof(Elf32_Rel));
+        }
+    }
+    failed = failed||put_at(fd,rest_at[0],syms,rest[0].bytes);
+    failed = failed||put_at(fd,rest_at[1],nstrings?(void*)MODULE->STRINGS:"",rest[1].bytes);
+    //the tables go in one after another as the module has them, version 2 modules keep them on separate pages
+    exec_t kept = *header;
+    kept.magic = htons(HDR_MAGIC);//kept in host order in memory
+    failed = failed||put_at(fd,rest_at[2],&kept,HEADER_SIZE);
+    uint64_t kept_at = rest_at[2]+HEADER_SIZE;
+    for(int sec=EH_IX_REL;sec<=EH_IX_SYM&&!failed;sec++){
+        uint64_t bytes = (uint64_t)ntohl(header->data[sec])*get_unit(sec);
+        failed = bytes&&copy_bytes(MODULE->FD,MODULE->OFFSET[sec],fd,kept_at,bytes);
+        kept_at += bytes;
+    }
+    failed = failed||put_at(fd,rest_at[3],shstrtab,shstrlen);
+    failed = failed||put_at(fd,shoff,shdrs,nshdrs*sizeof(Elf32_Shdr));
+    if(fd>=0){
+        failed = close_replacement(fd,target,tmpname,failed);
+    }
+    if(!failed){
+        stats_io(0,shoff+nshdrs*sizeof(Elf32_Shdr));
+        if(dropped){
+            fprintf(ERR,"warning: %u relocation%s with no ELF equivalent were left out of the ELF relocations\n",
+                    dropped,dropped==1?"":"s");
+        }
+    }
+    for(int sec=0;sec<=EH_IX_SDATA;sec++){
+        free(rels[sec]);
+    }
+    free(syms);
+    destroy_module(MODULE);
+    return failed;
+}
+
+///struct to hold an ELF file being read
+typedef struct elf_in{
+    int fd;
+    uint64_t length;
+    Elf32_Shdr* shdrs;
+    uint32_t nshdrs;
+}elf_in_t;
+
+///read a whole section of an ELF file
+///param: in, index of the section, bytes set to its size
+///return: the contents, NULL if it is out of the file or empty
+static uint8_t* read_section(elf_in_t* in, uint32_t index, uint32_t* bytes){
+    *bytes = 0;
+    if(index>=in->nshdrs||ntohl(in->shdrs[index].sh_type)==SHT_NOBITS){
+        return NULL;
+    }
+    uint32_t offset = ntohl(in->shdrs[index].sh_offset), size = ntohl(in->shdrs[index].sh_size);
+    if(!size||(uint64_t)offset+size>in->length){
+        return NULL;
+    }
+    uint8_t* data = malloc((size_t)size+1);
+    if(pread(in->fd,data,size,offset)!=(ssize_t)size){
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';//so a string table always ends
+    *bytes = size;
+    return data;
+}
+
+///get the R2K relocation type of an ELF relocation
+///param: type of the ELF relocation
+///return: the R2K type, 0 if there is none
+static uint8_t r2k_type(uint32_t type){
+    switch(type){
+        case R_MIPS_LO16: return REL_IMM;
+        case R_MIPS_32: return REL_WORD;
+        case R_MIPS_26: return REL_JUMP;
+    }
+    return 0;
+}
+
+///write an ELF file as a module, a load module if it is an executable and an object module otherwise
+///a file written by --to-elf comes back exactly as it was, others keep what the R2K tables can hold
+///param: elf file to read, file of the module to write
+///return: 0 on success, 1 on error
+int elf_to_module(char* elf, char* file){
+    elf_in_t in = {0};
+    Elf32_Ehdr ehdr;
+    struct stat st;
+    in.fd = open(elf,O_RDONLY);
+    if(in.fd<0){
+        fprintf(ERR,"error: %s: %s\n",elf,strerror(errno));
+        return 1;
+    }
+    if(fstat(in.fd,&st)||pread(in.fd,&ehdr,sizeof(ehdr),0)!=sizeof(ehdr)||memcmp(ehdr.e_ident,ELFMAG,SELFMAG)
+       ||ehdr.e_ident[EI_CLASS]!=ELFCLASS32||ehdr.e_ident[EI_DATA]!=ELFDATA2MSB||ntohs(ehdr.e_machine)!=EM_MIPS
+       ||ntohs(ehdr.e_shentsize)!=sizeof(Elf32_Shdr)){
+        fprintf(ERR,"error: %s is not a big-endian ELF32 MIPS file\n",elf);
+        close(in.fd);
+        return 1;
+    }
+    in.length = st.st_size;
+    in.nshdrs = ntohs(ehdr.e_shnum);
+    in.shdrs = malloc((in.nshdrs?in.nshdrs:1)*sizeof(Elf32_Shdr));
+    if((uint64_t)ntohl(ehdr.e_shoff)+in.nshdrs*sizeof(Elf32_Shdr)>in.length
+       ||pread(in.fd,in.shdrs,in.nshdrs*sizeof(Elf32_Shdr),ntohl(ehdr.e_shoff))!=(ssize_t)(in.nshdrs*sizeof(Elf32_Shdr))){
+        fprintf(ERR,"error: the section headers of %s are past its end\n",elf);
+        free(in.shdrs);
+        close(in.fd);
+        return 1;
+    }
+    uint32_t shstrlen, nstrings = 0, tables_len = 0, symlen = 0;
+    char* shstrtab = (char*)read_section(&in,ntohs(ehdr.e_shstrndx),&shstrlen);
+    //find the sections by name and the symbol table by type
+    int found[EH_IX_BSS+1], tables = -1, symtab = -1;
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        found[sec] = -1;
+    }
+    for(uint32_t s=1;s<in.nshdrs;s++){
+        uint32_t name = ntohl(in.shdrs[s].sh_name);
+        char* sname = shstrtab&&name<shstrlen?shstrtab+name:"";
+        for(int sec=0;sec<=EH_IX_BSS;sec++){
+            if(found[sec]<0&&(!strcmp(sname,elf_names[sec])||(sec==EH_IX_RDATA&&!strcmp(sname,".rodata")))){
+                found[sec] = s;
+            }
+        }
+        if(!strcmp(sname,R2K_TABLES)){
+            tables = s;
+        }
+        if(symtab<0&&ntohl(in.shdrs[s].sh_type)==SHT_SYMTAB){
+            symtab = s;
+        }
+    }
+    free(shstrtab);
+    exec_t header = {0};
+    header.magic = htons(HDR_MAGIC);
+    header.version = htons(HDR_VERSION);
+    header.entry = ntohs(ehdr.e_type)==ET_EXEC?ehdr.e_entry:0;
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        header.data[sec] = found[sec]<0?0:in.shdrs[found[sec]].sh_size;
+        if(found[sec]>=0&&sec<EH_IX_SBSS&&ntohl(in.shdrs[found[sec]].sh_type)!=SHT_NOBITS
+           &&(uint64_t)ntohl(in.shdrs[found[sec]].sh_offset)+ntohl(header.data[sec])>in.length){
+            fprintf(ERR,"error: section %s of %s is past its end\n",elf_names[sec],elf);
+            free(in.shdrs);
+            close(in.fd);
+            return 1;
+        }
+    }
+    uint8_t* strings = symtab<0?NULL:read_section(&in,ntohl(in.shdrs[symtab].sh_link),&nstrings);
+    uint8_t* raw = tables<0?NULL:read_section(&in,tables,&tables_len);
+    uint8_t* table_bytes = NULL;//reltab, reftab and symtab as they go in the module
+    uint64_t table_len = 0;
+    if(raw&&tables_len>=HEADER_SIZE){
+        //the header and tables --to-elf kept, if the sections still have the sizes they had then
+        exec_t kept;
+        memcpy(&kept,raw,HEADER_SIZE);
+        uint64_t kept_len = (uint64_t)ntohl(kept.data[EH_IX_REL])*RELENT_SIZE+(uint64_t)ntohl(kept.data[EH_IX_REF])*REFENT_SIZE
+                          +(uint64_t)ntohl(kept.data[EH_IX_SYM])*SYMENT_SIZE;
+        int same = kept_len==tables_len-HEADER_SIZE&&(ntohl(kept.data[EH_IX_STR])==nstrings
+                   ||(!kept.data[EH_IX_STR]&&nstrings<=1));
+        for(int sec=0;sec<=EH_IX_BSS&&same;sec++){
+            same = kept.data[sec]==header.data[sec];
+        }
+        if(same){
+            memcpy(&header,&kept,HEADER_SIZE);
+            header.magic = htons(HDR_MAGIC);
+            table_bytes = raw+HEADER_SIZE;
+            table_len = kept_len;
+        }
+        else{
+            fprintf(ERR,"warning: the sections of %s have changed since it was converted, its tables are rebuilt\n",elf);
+        }
+    }
+    if(!table_bytes){
+        //build the tables from the ELF symbols and relocations
+        Elf32_Sym* syms = symtab<0?NULL:(Elf32_Sym*)read_section(&in,symtab,&symlen);
+        uint32_t nelfsyms = symlen/sizeof(Elf32_Sym), nsyms = 0, nrel = 0, nref = 0, dropped = 0, skipped = 0;
+        //each ELF relocation becomes at most one entry, so the tables are sized from the relocation sections
+        uint64_t most = 0;
+        for(uint32_t s=1;s<in.nshdrs;s++){
+            most += ntohl(in.shdrs[s].sh_type)==SHT_REL?ntohl(in.shdrs[s].sh_size)/sizeof(Elf32_Rel):0;
+        }
+        relent_t* reltab = calloc(most?most:1,sizeof(relent_t));
+        refent_t* reftab = calloc(most?most:1,sizeof(refent_t));
+        syment_t* symtab_out = calloc(nelfsyms?nelfsyms:1,sizeof(syment_t));
+        for(uint32_t s=1;s<nelfsyms;s++){
+            int type = ELF32_ST_TYPE(syms[s].st_info);
+            if(syms[s].st_shndx!=htons(SHN_UNDEF)&&type!=STT_SECTION&&type!=STT_FILE&&ntohl(syms[s].st_name)
+               &&ntohl(syms[s].st_name)<nstrings){
+                symtab_out[nsyms].value = syms[s].st_value;
+                symtab_out[nsyms++].sym = syms[s].st_name;
+            }
+        }
+        for(uint32_t s=1;s<in.nshdrs;s++){
+            uint32_t type = ntohl(in.shdrs[s].sh_type), target = ntohl(in.shdrs[s].sh_info);
+            if(type==SHT_RELA){
+                skipped += ntohl(in.shdrs[s].sh_size)/sizeof(Elf32_Rela);//the addends have nowhere to go
+                continue;
+            }
+            int sec = -1;
+            for(int f=0;f<=EH_IX_SDATA;f++){
+                sec = found[f]==(int)target?f:sec;
+            }
+            uint32_t bytes;
+            Elf32_Rel* rels = type==SHT_REL?(Elf32_Rel*)read_section(&in,s,&bytes):NULL;
+            uint32_t nrels = rels?bytes/sizeof(Elf32_Rel):0;
+            for(uint32_t r=0;r<nrels;r++){
+                uint32_t info = ntohl(rels[r].r_info), symbol = ELF32_R_SYM(info);
+                uint8_t r2k = r2k_type(ELF32_R_TYPE(info));
+                if(ELF32_R_TYPE(info)==R_MIPS_HI16&&r+1<nrels&&ntohl(rels[r+1].r_info)==ELF32_R_INFO(symbol,R_MIPS_LO16)
+                   &&ntohl(rels[r+1].r_offset)==ntohl(rels[r].r_offset)+4){
+                    r2k = REL_IMM_2;//the pair is one R2K entry
+                    r++;
+                }
+                if(sec<0||!r2k||symbol>=nelfsyms){
+                    dropped++;
+                    continue;
+                }
+                int relative = symbol==STN_UNDEF||ELF32_ST_TYPE(syms[symbol].st_info)==STT_SECTION;
+                if(relative){
+                    reltab[nrel].addr = rels[r-(r2k==REL_IMM_2)].r_offset;
+                    reltab[nrel].section = sec+1;
+                    reltab[nrel++].type = r2k;
+                }
+                else{
+                    reftab[nref].addr = rels[r-(r2k==REL_IMM_2)].r_offset;
+                    reftab[nref].sym = syms[symbol].st_name;
+                    reftab[nref].section = sec+1;
+                    reftab[nref++].type = r2k;
+                }
+            }
+            free(rels);
+        }
+        if(dropped||skipped){
+            fprintf(ERR,"warning: %u relocation%s with no R2K equivalent were left out\n",
+                    dropped+skipped,dropped+skipped==1?"":"s");
+        }
+        header.data[EH_IX_REL] = htonl(nrel);
+        header.data[EH_IX_REF] = htonl(nref);
+        header.data[EH_IX_SYM] = htonl(nsyms);
+        header.data[EH_IX_STR] = htonl(nstrings);
+        table_len = (uint64_t)nrel*RELENT_SIZE+(uint64_t)nref*REFENT_SIZE+(uint64_t)nsyms*SYMENT_SIZE;
+        table_bytes = malloc(table_len?table_len:1);
+        memcpy(table_bytes,reltab,(size_t)nrel*RELENT_SIZE);
+        memcpy(table_bytes+(size_t)nrel*RELENT_SIZE,reftab,(size_t)nref*REFENT_SIZE);
+        memcpy(table_bytes+(size_t)nrel*RELENT_SIZE+(size_t)nref*REFENT_SIZE,symtab_out,(size_t)nsyms*SYMENT_SIZE);
+        free(reltab);
+        free(reftab);
+        free(symtab_out);
+        free(syms);
+        free(raw);
+        raw = table_bytes;
+    }
+    //write it in one pass where the header's version puts each section, sbss and bss are left as a hole
+    //that reads back as zeros
+    uint64_t offset[N_EH];
+    uint64_t length = module_layout(&header,offset);
+    char target[PATH_MAX], tmpname[PATH_MAX+4];
+    int fd = open_replacement(file,target,tmpname);
+    int failed = fd<0||put_at(fd,0,&header,HEADER_SIZE);
+    if(ntohs(header.version)==HDR_VERSION_2){
+        uint32_t table[N_EH];
+        for(int sec=0;sec<N_EH;sec++){
+            table[sec] = htonl(offset[sec]);
+        }
+        failed = failed||put_at(fd,HEADER_SIZE,table,LAYOUT_SIZE);
+    }
+    for(int sec=0;sec<EH_IX_SBSS&&!failed;sec++){
+        uint32_t bytes = ntohl(header.data[sec]);
+        if(bytes&&ntohl(in.shdrs[found[sec]].sh_type)!=SHT_NOBITS){
+            failed = copy_bytes(in.fd,ntohl(in.shdrs[found[sec]].sh_offset),fd,offset[sec],bytes);
+        }
+    }
+    uint8_t* entries = table_bytes;
+    for(int sec=EH_IX_REL;sec<=EH_IX_SYM;sec++){
+        uint64_t bytes = (uint64_t)ntohl(header.data[sec])*get_unit(sec);
+        failed = failed||put_at(fd,offset[sec],entries,bytes);
+        entries += bytes;
+    }
+    failed = failed||put_at(fd,offset[EH_IX_STR],strings,ntohl(header.data[EH_IX_STR]));
+    failed = failed||ftruncate(fd,length)!=0;
+    if(fd>=0){
+        failed = close_replacement(fd,target,tmpname,failed);
+    }
+    if(!failed){
+        stats_io(0,length);
+    }
+    free(raw);
+    free(strings);
+    free(in.shdrs);
+    close(in.fd);
+    return failed;
+}
@@ -35,6 +35,10 @@
     /* module version numbers */
     /* version 1:    0000111 1001 00010    2007/09/02 */
 #define    HDR_VERSION_1    0x0f22
+    /* version 2:    0011010 1010 10010    2026/10/18 */
+    /*    a table of section offsets follows the header and each section */
+    /*    starts on a page; sbss and bss are not stored */
+#define    HDR_VERSION_2    0x3552
 
     /* current version number */
 #define    HDR_VERSION    HDR_VERSION_1
@@ -118,8 +122,7 @@ typedef
 
     /* aliases for fields within the data array */
 #define sz_text     data[EH_IX_TEXT]
-#defin:q
-        sz_rdata    data[EH_IX_RDATA]
+#define sz_rdata    data[EH_IX_RDATA]
 #define sz_data     data[EH_IX_DATA]
 #define sz_sdata    data[EH_IX_SDATA]
 #define sz_sbss     data[EH_IX_SBSS]
@@ -3,30 +3,68 @@
 ///Git was used for VCS
 #include <stdio.h>
 #include <stdlib.h>
-#include "exec.h"
+#include "lmedit.h"
+#include "probes.h"
 #include <arpa/inet.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+///table entries checked per validation job, and bad entries kept per job
+#define VALIDATE_CHUNK 65536
+#define VALIDATE_MAX_REPORT 16
+
+///arena alignment of each section, and size from which huge pages are requested
+#define ARENA_ALIGN 64
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#define ALIGN_UP(n,a) (((n)+(a)-1)&~((size_t)(a)-1))
+
+__thread FILE* client_out = NULL;
 
 ///struct to represent a single command for history
 typedef struct history_cmd{
-    char* command;
+    char command[COMMAND_SIZE];
     int seqnum;
 }history_cmd_t;
 
-///struct to represent entire module in memory
-typedef struct module{
-    exec_t* HEADER;
-    uint8_t* TEXT;
-    uint8_t* RDATA;
-    uint8_t* DATA;
-    uint8_t* SDATA;
-    uint8_t* SBSS;
-    uint8_t* BSS;
-    relent_t* RELTAB;
-    refent_t* REFTAB;
-    syment_t* SYMTAB;
-    uint8_t* STRINGS;
-}module_t;
+///struct to hold a module open in the editor and where the user is in it
+typedef struct session{
+    module_t* MODULE;
+    char* file;
+    int changed;
+    char section[10];
+}session_t;
+
+///struct to hold every module open in the editor, numbered from 1 in the order they were opened
+typedef struct workspace{
+    session_t* modules;
+    int count;
+    int current;//index of the module commands apply to
+}workspace_t;
+
+//the loader reads tables straight into these structs
+_Static_assert(sizeof(relent_t)==RELENT_SIZE,"relent_t does not match the file layout");
+_Static_assert(sizeof(refent_t)==REFENT_SIZE,"refent_t does not match the file layout");
+_Static_assert(sizeof(syment_t)==SYMENT_SIZE,"syment_t does not match the file layout");
+
+///struct to hold one chunk of table entries to validate
+typedef struct validate_job{
+    module_t* MODULE;
+    int table;//EH_IX_REL, EH_IX_REF or EH_IX_SYM
+    uint32_t begin;
+    uint32_t end;
+    uint32_t* start;//start address of each section (0 for object modules)
+    int64_t last_nul;//index of the last NUL in the string table, -1 if none
+    uint32_t nbad;//number of bad entries found in the chunk
+    uint32_t bad[VALIDATE_MAX_REPORT];//index of the first bad entries
+    uint8_t why[VALIDATE_MAX_REPORT];//reason each entry was bad
+}validate_job_t;
 
 ///create a bit mask to extract a certain field of bits
 ///param a start and b end point of mask
@@ -79,32 +117,35 @@ void convertversion(uint16_t version){
     int month = btod(ver.month,4);
     int day = btod(ver.day,5);
     if(month<10 && day<10){
-        printf("%d/0%d/0%d",year,month,day);
+        fprintf(OUT,"%d/0%d/0%d",year,month,day);
     }
     else if(month<10){
-        printf("%d/0%d/%d",year,month,day);
+        fprintf(OUT,"%d/0%d/%d",year,month,day);
     }
     else if(day<10){
-        printf("%d/%d/0%d",year,month,day);
+        fprintf(OUT,"%d/%d/0%d",year,month,day);
     }
     else{
-        printf("%d/%d/%d",year,month,day);
+        fprintf(OUT,"%d/%d/%d",year,month,day);
     }
 }
 
 ///function to try and open the file and check if it is a module with the magic number
-///param: file to open
-FILE* open_module(char* file){
+///a byte swapped magic number is a little endian module
+///param: file to open, little set to 1 for a little endian module
+FILE* open_module(char* file, int* little){
     FILE* fp = fopen(file, "r");//read now write later
     if(!fp){
-        perror("error: file could not be opened");
+        fprintf(ERR,"error: file could not be opened: %s\n",strerror(errno));
         return NULL;
     }
     else{
         uint16_t magic;
         fread(&magic,sizeof(uint16_t),1,fp);
-        if(ntohs(magic)!=HDR_MAGIC){
-            fprintf(stderr,"error: %s is not an R2K object module (magic number 0x%x)\n",file,ntohs(magic));
+        *little = le16toh(magic)==HDR_MAGIC;
+        if(ntohs(magic)!=HDR_MAGIC&&!*little){
+            fprintf(ERR,"error: %s is not an R2K object module (magic number 0x%x)\n",file,ntohs(magic));
+            fclose(fp);
             return NULL;
         }
         else{
@@ -113,67 +154,289 @@ FILE* open_module(char* file){
     }
 }
 
-///free the module
-void destroy_module(module_t* MODULE){
-    if(MODULE->HEADER){
-        free(MODULE->HEADER);
+///map a read only region that reads back as zeros
+///every page is the kernel's shared zero page so nothing is allocated
+///param: size of the region
+///return: the region, NULL on failure
+uint8_t* map_zero(size_t size){
+    void* zero = mmap(NULL,size,PROT_READ,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+    if(zero==MAP_FAILED){
+        return NULL;
+    }
+    stats_alloc(size);
+    return zero;
+}
+
+///get where a section or table is stored in the module
+///param: MODULE, sec the EH_IX_ index of the section
+///return: address of the section's pointer
+void** get_section(module_t* MODULE, int sec){
+    switch(sec){
+        case EH_IX_TEXT: return (void**)&MODULE->TEXT;
+        case EH_IX_RDATA: return (void**)&MODULE->RDATA;
+        case EH_IX_DATA: return (void**)&MODULE->DATA;
+        case EH_IX_SDATA: return (void**)&MODULE->SDATA;
+        case EH_IX_SBSS: return (void**)&MODULE->SBSS;
+        case EH_IX_BSS: return (void**)&MODULE->BSS;
+        case EH_IX_REL: return (void**)&MODULE->RELTAB;
+        case EH_IX_REF: return (void**)&MODULE->REFTAB;
+        case EH_IX_SYM: return (void**)&MODULE->SYMTAB;
+        default: return (void**)&MODULE->STRINGS;
     }
-    if(MODULE->TEXT){
-        free(MODULE->TEXT);
+}
+
+///get the size in memory of one unit of a section
+///param: sec the EH_IX_ index of the section
+///return: 1 for byte sections, the entry size for tables
+size_t get_unit(int sec){
+    switch(sec){
+        case EH_IX_REL: return sizeof(relent_t);
+        case EH_IX_REF: return sizeof(refent_t);
+        case EH_IX_SYM: return sizeof(syment_t);
+        default: return 1;
+    }
+}
+
+///check if a section lives in the module's arena
+///param: MODULE, data pointer to check
+///return: 1 if it does, 0 if it was allocated on its own
+int in_arena(module_t* MODULE, void* data){
+    return (uint8_t*)data>=MODULE->ARENA&&(uint8_t*)data<MODULE->ARENA+MODULE->ARENA_SIZE;
+}
+
+///drop the indexes that depend on a changed section so they are rebuilt when next needed
+///param: MODULE, sec the EH_IX_ index of the section, resized 1 if its size changed
+void invalidate_indexes(module_t* MODULE, int sec, int resized){
+    if(resized||sec==EH_IX_TEXT||sec==EH_IX_REL||sec==EH_IX_SYM){
+        destroy_xref(MODULE->XREF);
+        MODULE->XREF = NULL;
     }
-    if(MODULE->RDATA){
-        free(MODULE->RDATA);
+    if(resized||sec==EH_IX_REL||sec==EH_IX_REF){
+        destroy_reloc_index(MODULE->RELOCS);
+        MODULE->RELOCS = NULL;
     }
-    if(MODULE->DATA){
-        free(MODULE->DATA);
+    if(resized||sec==EH_IX_SYM||sec==EH_IX_STR){
+        destroy_symindex(MODULE->SYMBOLS);
+        MODULE->SYMBOLS = NULL;
     }
-    if(MODULE->SDATA){
-        free(MODULE->SDATA);
+    for(int table=EH_IX_REL;table<=EH_IX_SYM;table++){
+        if(resized||sec==table||sec==EH_IX_STR){//compact renumbers the names
+            destroy_columns(MODULE->COLUMNS[table-EH_IX_REL]);
+            MODULE->COLUMNS[table-EH_IX_REL] = NULL;
+        }
     }
-    if(MODULE->SBSS){
-        free(MODULE->SBSS);
+}
+
+///free a section that was given its own allocation by resize or compact
+///param: MODULE, sec the EH_IX_ index of the section
+void release_section(module_t* MODULE, int sec){
+    void** slot = get_section(MODULE,sec);
+    if(*slot&&!in_arena(MODULE,*slot)){
+        if(sec==EH_IX_SBSS||sec==EH_IX_BSS){//zero mappings, their size is in the header
+            munmap(*slot,ntohl(MODULE->HEADER->data[sec]));
+        }
+        else if(MODULE->MAPPED&SECTION_BIT(sec)){//mapped from the file, also sized from the header
+            munmap(*slot,(size_t)ntohl(MODULE->HEADER->data[sec])*get_unit(sec));
+            MODULE->MAPPED &= ~SECTION_BIT(sec);
+        }
+        else{
+            free(*slot);
+        }
     }
-    if(MODULE->BSS){
-        free(MODULE->BSS);
+    *slot = NULL;
+}
+
+///create a module with every section carved out of one arena sized from the header
+///sbss and bss sit in read only pages at the end of the arena so they stay zero pages
+///param: header in file byte order
+///return: the module, NULL if the arena could not be allocated
+module_t* create_module(exec_t* header){
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = ALIGN_UP(sizeof(module_t),ARENA_ALIGN)+ALIGN_UP(sizeof(exec_t),ARENA_ALIGN);
+    for(int sec=0;sec<N_EH;sec++){
+        if(sec!=EH_IX_SBSS&&sec!=EH_IX_BSS){
+            size += ALIGN_UP((size_t)ntohl(header->data[sec])*get_unit(sec),ARENA_ALIGN);
+        }
     }
-    if(MODULE->RELTAB){
-        free(MODULE->RELTAB);
+    size = ALIGN_UP(size,page);
+    size_t zero = ALIGN_UP(ntohl(header->data[EH_IX_SBSS]),page)+ALIGN_UP(ntohl(header->data[EH_IX_BSS]),page);
+    uint8_t* arena = mmap(NULL,size+zero,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+    if(arena==MAP_FAILED){
+        return NULL;
     }
-    if(MODULE->REFTAB){
-        free(MODULE->REFTAB);
+    stats_alloc(size+zero);
+    if(size>=HUGE_PAGE_SIZE){
+        madvise(arena,size,MADV_HUGEPAGE);
     }
-    if(MODULE->SYMTAB){
-        free(MODULE->SYMTAB);
+    if(zero){
+        mprotect(arena+size,zero,PROT_READ);
     }
-    if(MODULE->STRINGS){
-        free(MODULE->STRINGS);
+    //carve the pieces out in file order
+    module_t* MODULE = (module_t*)arena;
+    MODULE->ARENA = arena;
+    MODULE->ARENA_SIZE = size+zero;
+    MODULE->FD = -1;
+    MODULE->LOADED = ALL_SECTIONS;//the loader clears the sections it has yet to read
+    pthread_mutex_init(&MODULE->LOAD_LOCK,NULL);
+    uint8_t* at = arena+ALIGN_UP(sizeof(module_t),ARENA_ALIGN);
+    MODULE->HEADER = (exec_t*)at;
+    memcpy(MODULE->HEADER,header,sizeof(exec_t));
+    at += ALIGN_UP(sizeof(exec_t),ARENA_ALIGN);
+    uint8_t* zero_at = arena+size;
+    for(int sec=0;sec<N_EH;sec++){
+        size_t bytes = (size_t)ntohl(header->data[sec])*get_unit(sec);
+        if(!bytes){
+            continue;//the section pointer stays NULL
+        }
+        if(sec==EH_IX_SBSS||sec==EH_IX_BSS){
+            *get_section(MODULE,sec) = zero_at;
+            zero_at += ALIGN_UP(bytes,page);
+        }
+        else{
+            *get_section(MODULE,sec) = at;
+            at += ALIGN_UP(bytes,ARENA_ALIGN);
+        }
+    }
+    return MODULE;
+}
+
+///read sections from the module file the first time they are needed
+///param: MODULE, mask with the SECTION_BIT of each section wanted
+///return: 0 on success, 1 if one could not be read
+int load_sections(module_t* MODULE, uint32_t mask){
+    if((__atomic_load_n(&MODULE->LOADED,__ATOMIC_ACQUIRE)&mask)==mask){
+        return 0;
+    }
+    int failed = 0;
+    pthread_mutex_lock(&MODULE->LOAD_LOCK);//daemon clients reading the module can get here together
+    for(int sec=0;sec<N_EH&&!failed;sec++){
+        if(!(mask&SECTION_BIT(sec))||(MODULE->LOADED&SECTION_BIT(sec))){
+            continue;
+        }
+        size_t bytes = (size_t)ntohl(MODULE->HEADER->data[sec])*get_unit(sec);
+        uint8_t* data = *get_section(MODULE,sec);
+        uint64_t began = stats_now();
+        PROBE2(section__load__entry,sec,bytes);
+        //sections of version 2 modules start on a page, so big ones are mapped copy on write instead of read
+        size_t page = sysconf(_SC_PAGESIZE);
+        if(bytes>=page&&MODULE->OFFSET[sec]%page==0){
+            void* mapped = mmap(NULL,bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE,MODULE->FD,MODULE->OFFSET[sec]);
+            if(mapped!=MAP_FAILED){
+                data = *get_section(MODULE,sec) = mapped;
+                MODULE->MAPPED |= SECTION_BIT(sec);
+            }
+        }
+        for(size_t done=MODULE->MAPPED&SECTION_BIT(sec)?bytes:0;done<bytes&&!failed;){
+            ssize_t got = pread(MODULE->FD,data+done,bytes-done,MODULE->OFFSET[sec]+done);
+            if(got<0&&errno==EINTR){
+                continue;
+            }
+            if(got<=0){
+                fprintf(ERR,"error: %s could not be read: %s\n",MODULE->PATH,got?strerror(errno):"the file is truncated");
+                failed = 1;
+            }
+            done += got;
+        }
+        PROBE2(section__load__return,sec,failed);
+        if(!failed&&MODULE->LITTLE&&sec>=EH_IX_REL&&sec<=EH_IX_SYM){//the tables are kept big endian
+            swap_entries(data,sec,ntohl(MODULE->HEADER->data[sec]));
+        }
+        if(!failed){
+            stats_record(STAT_LOAD_SECTIONS,began);
+            stats_io(MODULE->MAPPED&SECTION_BIT(sec)?0:bytes,0);
+            __atomic_or_fetch(&MODULE->LOADED,SECTION_BIT(sec),__ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&MODULE->LOAD_LOCK);
+    return failed;
+}
+
+///read the tables and adopt the indexes in the module's sidecar, the first time an index is needed
+///param: MODULE
+void load_indexes(module_t* MODULE){
+    if(MODULE->INDEXED){
+        return;
+    }
+    MODULE->INDEXED = 1;
+    uint64_t began = stats_now();
+    struct stat st;
+    if(!load_sections(MODULE,TABLE_SECTIONS)&&MODULE->FD>=0&&!fstat(MODULE->FD,&st)){
+        load_cache(MODULE,MODULE->PATH,&st);
+    }
+    stats_record(STAT_LOAD_INDEX,began);
+}
+
+///free the module
+///everything it loaded is in the arena, only sections resized or compacted since are separate
+void destroy_module(module_t* MODULE){
+    destroy_xref(MODULE->XREF);
+    destroy_reloc_index(MODULE->RELOCS);
+    destroy_symindex(MODULE->SYMBOLS);
+    for(int table=0;table<3;table++){
+        destroy_columns(MODULE->COLUMNS[table]);
     }
-    free(MODULE);
+    release_cache(MODULE);
+    destroy_snapshots(MODULE);
+    if(MODULE->FD>=0){
+        close(MODULE->FD);
+    }
+    free(MODULE->PATH);
+    pthread_mutex_destroy(&MODULE->LOAD_LOCK);
+    for(int sec=0;sec<N_EH;sec++){
+        release_section(MODULE,sec);
+    }
+    munmap(MODULE->ARENA,MODULE->ARENA_SIZE);//the module itself is in the arena
 }
 
-void print_summary(exec_t* header, char* name){
+void print_summary(exec_t* header, char* name, int little){
     if(header->entry == 0x0){
-        printf("File %s is an R2K object module\n",name);
+        fprintf(OUT,"File %s is an R2K object module%s\n",name,little?" (little endian)":"");
     }
     else{
-        printf("File %s is an R2K load module (entry point %#010x)\n",name,ntohl(header->entry));
+        fprintf(OUT,"File %s is an R2K load module (entry point %#010x)%s\n",name,ntohl(header->entry),
+                little?" (little endian)":"");
     }
-    printf("Module version: ");
+    fprintf(OUT,"Module version: ");
     convertversion(ntohs(header->version));
-    printf("\n");
+    fprintf(OUT,"\n");
     char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
     for(int i=0;i<N_EH;i++){
         if(ntohl(header->data[i])!=0){
             if(i<6||i==9){
-                printf("Section %s is %d bytes long\n",sections[i],ntohl(header->data[i]));
+                fprintf(OUT,"Section %s is %d bytes long\n",sections[i],ntohl(header->data[i]));
             }
             else{
-                printf("Section %s is %d entries long\n",sections[i],ntohl(header->data[i]));
+                fprintf(OUT,"Section %s is %d entries long\n",sections[i],ntohl(header->data[i]));
             }
         }
     }
 }
 
+///fuction to get the index of a section from its name
+///param: section name of the section
+///return: the EH_IX_ index, or -1 if it is not a section
+int get_index(char* section){
+    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    for(int sec=0;sec<N_EH;sec++){
+        if(!strcmp(section,sections[sec])){
+            return sec;
+        }
+    }
+    return -1;
+}
+
+///fuction to get the editable fields of a table section
+///param: sec the EH_IX_ index of the section
+///return: string of field characters, empty if not a table
+char* get_fields(int sec){
+    switch(sec){
+        case EH_IX_REL: return "ast";//addr section type
+        case EH_IX_REF: return "ayst";//addr symbol section type
+        case EH_IX_SYM: return "fvy";//flags value symbol
+        default: return "";
+    }
+}
+
 ///fuction to get the size of a section
 ///param: section section to get size, module current module
 ///return: size of section
@@ -189,97 +452,264 @@ int get_size(char* section, module_t* MODULE){
     return 0;
 }
 
+///lay the sections of a module out as its version writes them
+///version 1 packs them after the header; version 2 follows the header with the table of offsets and
+///starts each section on a MODULE_PAGE so it can be mapped, leaving out sbss and bss
+///param: header in big endian order, offset set to where each section starts, 0 if version 2 does not store it
+///return: length of the file in bytes
+uint64_t module_layout(exec_t* header, uint64_t offset[N_EH]){
+    int paged = ntohs(header->version)==HDR_VERSION_2;
+    uint64_t at = HEADER_SIZE+(paged?LAYOUT_SIZE:0);
+    for(int sec=0;sec<N_EH;sec++){
+        uint64_t bytes = (uint64_t)ntohl(header->data[sec])*get_unit(sec);
+        if(paged&&(!bytes||sec==EH_IX_SBSS||sec==EH_IX_BSS)){
+            offset[sec] = 0;
+            continue;
+        }
+        if(paged){
+            at = ALIGN_UP(at,MODULE_PAGE);
+        }
+        offset[sec] = at;
+        at += bytes;
+    }
+    return at;
+}
+
+///compute the length a module file must have based on its header
+///param: header in file byte order
+///return: length in bytes
+uint64_t module_length(exec_t* header){
+    uint64_t offset[N_EH];
+    return module_layout(header,offset);
+}
+
+///find where each section of a module file starts and check that the file holds them
+///version 2 files give the offsets in the table after the header, a table of zeros means module_layout's
+///param: fd of the file, file name, header in big endian order, little 1 if the file is little endian,
+///       length of the file, offset set to where each section starts
+///return: 0 on success, 1 if the file cannot hold the sections
+int read_layout(int fd, char* file, exec_t* header, int little, uint64_t length, uint64_t offset[N_EH]){
+    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    uint64_t needed = module_layout(header,offset);
+    uint32_t table[N_EH];
+    int given = 0;
+    if(ntohs(header->version)==HDR_VERSION_2&&length>=HEADER_SIZE+LAYOUT_SIZE
+       &&pread(fd,table,LAYOUT_SIZE,HEADER_SIZE)==LAYOUT_SIZE){
+        for(int sec=0;sec<N_EH;sec++){
+            given |= table[sec]!=0;
+        }
+    }
+    if(given){
+        needed = HEADER_SIZE+LAYOUT_SIZE;
+        for(int sec=0;sec<N_EH;sec++){
+            uint64_t bytes = (uint64_t)ntohl(header->data[sec])*get_unit(sec);
+            offset[sec] = 0;
+            if(!bytes||sec==EH_IX_SBSS||sec==EH_IX_BSS){
+                continue;
+            }
+            offset[sec] = SECTION_WORD(little,table[sec]);
+            if(offset[sec]<HEADER_SIZE+LAYOUT_SIZE){
+                fprintf(ERR,"error: %s: section %s starts at %llu, inside the header\n",file,sections[sec],
+                        (unsigned long long)offset[sec]);
+                return 1;
+            }
+            if(offset[sec]+bytes>needed){
+                needed = offset[sec]+bytes;
+            }
+        }
+    }
+    if(needed>length){
+        fprintf(ERR,"error: %s is truncated (section sizes need %llu bytes, file is %llu bytes)\n",
+                file,(unsigned long long)needed,(unsigned long long)length);
+        return 1;
+    }
+    return 0;
+}
+
 ///fuction to update the history array
+///the entries are fixed size so nothing is allocated per command
 ///param: cmd the command to add, history the history array
 ///,n the sequence num, size the number of commands in the history
-void add_to_history(char* cmd, int n, history_cmd_t* history[], int* size){
-    if(*size<10){//add the command to the array;
-        history[*size] = malloc(sizeof(history_cmd_t));
-        history[*size]->command = malloc(strlen(cmd)+1);
-        strncpy(history[*size]->command,cmd,strlen(cmd)+1);
-        history[*size]->seqnum = n;
-        (*size)++;
-    }
-    else{//must push out the old
-        free(history[0]->command);//free the oldest history
-        free(history[0]);
-        history[0]->command = NULL;
-        history[0] = NULL;
-        for(int i=1;i<10;i++){//shift every pointer over one index
-            history[i-1] = history[i];
-        }
-        history[9] = malloc(sizeof(history_cmd_t));//create the newest entry
-        history[9]->command = malloc(strlen(cmd)+1);
-        strncpy(history[9]->command,cmd,strlen(cmd)+1);
-        history[9]->seqnum = n;
+void add_to_history(char* cmd, int n, history_cmd_t history[], int* size){
+    if(*size==10){//must push out the old
+        memmove(&history[0],&history[1],9*sizeof(history_cmd_t));
+        (*size)--;
     }
+    snprintf(history[*size].command,COMMAND_SIZE,"%s",cmd);
+    history[*size].seqnum = n;
+    (*size)++;
 }
 
-///routine to destroy the history
-///param: history history array, size size of history
-void destroy_history(history_cmd_t* history[], int* size){
-    for(int entry=0;entry<*size;entry++){
-        free(history[entry]->command);
-        free(history[entry]);
-    }
-    (*size) = 0;
+///copy bytes into the output buffer and advance it
+///param: at output cursor, src bytes to copy, n number of bytes
+void put_bytes(uint8_t** at, void* src, size_t n){
+    memcpy(*at,src,n);
+    (*at) += n;
 }
 
-///routine to write the module to the file 
-///param: MODULE module to write
-void write(module_t* MODULE, char* filename){
-    FILE* mfp = fopen(filename,"r+w");
-    //position the fp at the beginning of the file
-    fseek(mfp,52,SEEK_SET);//offset 52 bytes to skip the heade
-    //write out the sections
-    if(MODULE->HEADER->data[EH_IX_TEXT]){
-        for(int byte=0;byte<get_size("text",MODULE);byte++){
-            fwrite(&(MODULE->TEXT[byte]),1,1,mfp);
-        }
+///build the complete module file image from memory
+///tables are written with their file padding and the header with the current sizes
+///param: MODULE module to serialize, length set to the size of the image
+///return: the image, to be freed by the caller, NULL with the reason printed if it could not be built
+uint8_t* serialize_module(module_t* MODULE, uint64_t* length){
+    exec_t* header = MODULE->HEADER;
+    if(load_sections(MODULE,ALL_SECTIONS)){
+        return NULL;
     }
-    if(MODULE->HEADER->data[EH_IX_RDATA]){
-        for(int byte=0;byte<get_size("rdata",MODULE);byte++){
-            fwrite(&(MODULE->RDATA[byte]),1,1,mfp);
-        }
+    uint64_t offset[N_EH];
+    *length = module_layout(header,offset);
+    uint8_t* image = calloc(1,*length);//the gaps version 2 leaves before each page stay zero
+    if(!image){
+        fprintf(ERR,"error: not enough memory to write %s\n",MODULE->PATH?MODULE->PATH:"the module");
+        return NULL;
+    }
+    stats_alloc(*length);
+    uint8_t* at = image;
+    uint8_t pad[4] = {0};
+    //header, a little endian module is written back little endian
+    exec_t out = *header;
+    uint16_t magic = MODULE->LITTLE?htole16(HDR_MAGIC):htons(HDR_MAGIC);
+    if(MODULE->LITTLE){
+        swap_header(&out);
     }
-    if(MODULE->HEADER->data[EH_IX_DATA]){
-        for(int byte=0;byte<get_size("data",MODULE);byte++){
-            fwrite(&(MODULE->DATA[byte]),1,1,mfp);
+    put_bytes(&at,&magic,sizeof(uint16_t));
+    put_bytes(&at,&out.version,sizeof(uint16_t));
+    put_bytes(&at,&out.flags,sizeof(uint32_t));
+    put_bytes(&at,&out.entry,sizeof(uint32_t));
+    put_bytes(&at,out.data,sizeof(uint32_t)*N_EH);
+    if(ntohs(header->version)==HDR_VERSION_2){//where each section starts
+        for(int sec=0;sec<N_EH;sec++){
+            uint32_t word = MODULE->LITTLE?htole32(offset[sec]):htonl(offset[sec]);
+            put_bytes(&at,&word,sizeof(uint32_t));
         }
     }
-    if(MODULE->HEADER->data[EH_IX_SDATA]){
-        for(int byte=0;byte<get_size("sdata",MODULE);byte++){
-            fwrite(&(MODULE->SDATA[byte]),1,1,mfp);
+    //sections, version 2 does not store sbss and bss
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_BSS;sec++){
+        if(header->data[sec]&&offset[sec]){
+            at = image+offset[sec];
+            put_bytes(&at,*get_section(MODULE,sec),ntohl(header->data[sec]));
         }
     }
-    if(MODULE->HEADER->data[EH_IX_SBSS]){
-        fseek(mfp,get_size("sbss",MODULE),SEEK_CUR);//sbss cant be changed
+    //tables
+    at = image+offset[EH_IX_REL];
+    for(uint32_t entry=0;entry<ntohl(header->data[EH_IX_REL]);entry++){
+        relent_t* rel = &MODULE->RELTAB[entry];
+        put_bytes(&at,&rel->addr,sizeof(uint32_t));
+        put_bytes(&at,&rel->section,sizeof(uint8_t));
+        put_bytes(&at,&rel->type,sizeof(uint8_t));
+        put_bytes(&at,pad,RELENT_SIZE-6);
     }
-    if(MODULE->HEADER->data[EH_IX_BSS]){
-        fseek(mfp,get_size("bss",MODULE),SEEK_CUR);//bss cant be changed
+    at = image+offset[EH_IX_REF];
+    for(uint32_t entry=0;entry<ntohl(header->data[EH_IX_REF]);entry++){
+        refent_t* ref = &MODULE->REFTAB[entry];
+        put_bytes(&at,&ref->addr,sizeof(uint32_t));
+        put_bytes(&at,&ref->sym,sizeof(uint32_t));
+        put_bytes(&at,&ref->section,sizeof(uint8_t));
+        put_bytes(&at,&ref->type,sizeof(uint8_t));
+        put_bytes(&at,pad,REFENT_SIZE-10);
     }
-    if(MODULE->HEADER->data[EH_IX_REL]){
-        for(int entry=0;entry<(get_size("reltab",MODULE));entry++){//for the num entries
-            fseek(mfp,8,SEEK_CUR);//skip the size of a rel entry
-        }
-    } 
-    if(MODULE->HEADER->data[EH_IX_REF]){
-        for(int entry=0;entry<(get_size("reftab",MODULE));entry++){//for the num entries
-            fseek(mfp,12,SEEK_CUR);//skip the size of a ref entry
-        }   
+    at = image+offset[EH_IX_SYM];
+    for(uint32_t entry=0;entry<ntohl(header->data[EH_IX_SYM]);entry++){
+        syment_t* sym = &MODULE->SYMTAB[entry];
+        put_bytes(&at,&sym->flags,sizeof(uint32_t));
+        put_bytes(&at,&sym->value,sizeof(uint32_t));
+        put_bytes(&at,&sym->sym,sizeof(uint32_t));
+    }
+    for(int sec=EH_IX_REL;sec<=EH_IX_SYM&&MODULE->LITTLE;sec++){
+        swap_entries(image+offset[sec],sec,ntohl(header->data[sec]));
+    }
+    //strings
+    if(header->data[EH_IX_STR]){
+        at = image+offset[EH_IX_STR];
+        put_bytes(&at,MODULE->STRINGS,ntohl(header->data[EH_IX_STR]));
+    }
+    return image;
+}
+
+///open a temporary file to be written in place of a file, see close_replacement
+///a symlink is followed so the file it points at is replaced, not the link, and the new file is given the
+///mode and owner of the one it replaces
+///param: file to replace, target set to the file that will be replaced, tmpname set to the temporary file
+///return: descriptor of the temporary file, -1 with the reason printed on error
+int open_replacement(char* file, char target[PATH_MAX], char tmpname[PATH_MAX+4]){
+    if(!realpath(file,target)){//a new file
+        snprintf(target,PATH_MAX,"%s",file);
     }
-    if(MODULE->HEADER->data[EH_IX_SYM]){
-        for(int entry=0;entry<(get_size("symtab",MODULE));entry++){//for the num entries
-            fseek(mfp,12,SEEK_CUR);//skip the size of a sym entry
-        }   
+    snprintf(tmpname,PATH_MAX+4,"%s.tmp",target);
+    int fd = open(tmpname,O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+    if(fd<0){
+        fprintf(ERR,"error: %s: %s\n",tmpname,strerror(errno));
+        return -1;
     }
-    if(MODULE->HEADER->data[EH_IX_STR]){
-        for(int byte=0;byte<get_size("strings",MODULE);byte++){
-            fwrite(&(MODULE->STRINGS[byte]),1,1,mfp);
+    struct stat st;
+    if(!stat(target,&st)){
+        //the owner goes first as changing it clears the set id bits, only root may give a file away
+        if((fchown(fd,st.st_uid,st.st_gid)&&errno!=EPERM)||fchmod(fd,st.st_mode&07777)){
+            fprintf(ERR,"error: %s: %s\n",tmpname,strerror(errno));
+            close(fd);
+            remove(tmpname);
+            return -1;
         }
     }
-    fflush(mfp);
-    fclose(mfp);
+    return fd;
+}
+
+///finish a file written through open_replacement, replacing the file it stands for
+///param: fd, target and tmpname from open_replacement, failed 1 if writing it went wrong
+///return: 0 on success, 1 on error
+int close_replacement(int fd, char* target, char* tmpname, int failed){
+    failed |= fsync(fd)!=0;
+    failed |= close(fd)!=0;
+    if(failed||rename(tmpname,target)){
+        fprintf(ERR,"error: %s could not be written: %s\n",target,strerror(errno));
+        remove(tmpname);
+        return 1;
+    }
+    return 0;
+}
+
+///routine to write the module to the file 
+///the module is serialized and written to a temporary file which then replaces the original
+///param: MODULE module to write, filename of the module
+///return: 0 on success, 1 on error
+int write_module(module_t* MODULE, char* filename){
+    uint64_t length = 0;
+    uint64_t began = stats_now();
+    uint8_t* image = serialize_module(MODULE,&length);
+    stats_record(STAT_SERIALIZE,began);
+    if(!image){//serialize_module said why
+        return 1;
+    }
+    char target[PATH_MAX], tmpname[PATH_MAX+4];
+    int fd = open_replacement(filename,target,tmpname);
+    if(fd<0){
+        free(image);
+        return 1;
+    }
+    began = stats_now();
+    PROBE2(write__entry,filename,length);
+    PROBE3(write__extent,filename,0,length);//the image goes out in one extent
+    int failed = 0;
+    for(uint64_t done=0;done<length&&!failed;){
+        ssize_t put = write(fd,image+done,length-done);
+        if(put<0&&errno==EINTR){
+            continue;
+        }
+        failed = put<=0;
+        done += failed?0:put;
+    }
+    free(image);
+    if(close_replacement(fd,target,tmpname,failed)){
+        return 1;
+    }
+    stats_record(STAT_WRITE_FILE,began);
+    stats_io(0,length);
+    PROBE2(write__return,filename,length);
+    MODULE->LENGTH = length;
+    if(has_cache(filename)){//keep the sidecar matching the file
+        save_cache(MODULE,filename);
+    }
+    return 0;
 }
 
 ///fuction to see if a command contains a certain char
@@ -316,7 +746,7 @@ int count_char(char* word, char c){
 ///   3 = both have been entered
 ///param: command array to hold values, buf string to analyze
 ///return: 1 if not x command
-int proccess_x_command(unsigned int command[4],char* buf){
+static int parse_x_command(unsigned int command[6],char* buf){
     command[0]=0;
     command[1]=1;
     command[2]='w';
@@ -511,115 +941,116 @@ int proccess_x_command(unsigned int command[4],char* buf){
     return 1;
 }
 
+///function to process an x command, with the value of an edit read again at the full 64 bits
+///command[3] gets the low half of the value and command[5] the high half, which only doubleword edits use
+///param: command array to hold values, buf string to analyze
+///return 1 if not x command
+int proccess_x_command(unsigned int command[6],char* buf){
+    command[5]=0;
+    if(parse_x_command(command,buf)){
+        return 1;
+    }
+    if(command[4]==1||command[4]==3){
+        char* value = strrchr(buf,'=')+1;
+        char* end;
+        errno = 0;
+        unsigned long long change = strtoull(value,&end,strncmp(value,"0x",2)?10:16);
+        if(end==value||errno==ERANGE){
+            fprintf(ERR,"error: '%s' is not a 64 bit value\n",value);
+            return 1;
+        }
+        command[3] = change;
+        command[5] = change>>32;
+    }
+    return 0;
+}
+
 ///get start address for load modules
+///data sections follow each other from DATA_BEGIN, each on a 2^3 boundary
 ///param: MODULE, section to check
 ///return: unsigned int starting addr
 unsigned int get_start(module_t* MODULE, char* section){
-    unsigned int t_starting = 0x00400000;
-    unsigned int r_starting = 0x10000000;
-    unsigned int d_starting = 0x10000000;
-    unsigned int s_starting = 0x10000000;
-    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
-    if(MODULE->RDATA){//if rdata is selected and exists
-        if(MODULE->DATA){
-            int rdata_s = get_size("rdata",MODULE);
-            while(rdata_s%8!=0){
-                rdata_s++; //get mult of 8 addr
-            }
-            d_starting+=rdata_s;
-        }
-        if(MODULE->SDATA){
-            s_starting = d_starting;
-            int data_s = get_size("data",MODULE);
-            while(data_s%8!=0){
-                data_s++; //find next mult of 8 addr
-            }
-            s_starting+=data_s;
-        }
+    int sec = get_index(section);
+    if(sec==EH_IX_TEXT){
+        return TEXT_BEGIN;
     }
-    else if(MODULE->DATA){//there is no RDATA but is data
-        if(MODULE->SDATA){
-            int data_s = get_size("data",MODULE);
-            while(data_s%8!=0){
-                data_s++;
-            }
-            s_starting+=data_s;
-        }
-    }
-    //return currect val
-    if(!strcmp(section,sections[0])){
-        return t_starting;
-    }
-    else if(!strcmp(section,sections[1])){
-        return r_starting;
-    }
-    else if(!strcmp(section,sections[2])){
-        return d_starting;
-    }
-    else if(!strcmp(section,sections[3])){
-        return s_starting;
-    }
-    else{
+    if(sec<EH_IX_RDATA||sec>EH_IX_BSS){
         return 0x0;
     }
+    unsigned int starting = DATA_BEGIN;
+    for(int prev=EH_IX_RDATA;prev<sec;prev++){
+        starting += (ntohl(MODULE->HEADER->data[prev])+7)&~7u;//next mult of 8 addr
+    }
+    return starting;
 }
 
 ///check command for errors
 ///param: commands to check, section and module
 ///return 0 for good 1 for error
-int check_for_errors(unsigned int commands[5],char* section, module_t* MODULE){
+int check_for_errors(unsigned int commands[6],char* section, module_t* MODULE){
     //check the type
     unsigned int address = commands[0];
     unsigned int count = commands[1];
     char type = commands[2];
     unsigned int change = commands[3];
     unsigned int flag = commands[4];
+    uint64_t value = (uint64_t)commands[5]<<32|change;
 
-    int countsize = 0;
+    uint64_t countsize = 0;
 
     if(!strcmp("symtab",section)||!strcmp("reltab",section)||!strcmp("reftab",section)){//if a table section
-        if(flag==2||flag==3){
-            fprintf(stderr,"error: ':%c' not valid in table sections\n",type);
+        //the type selects the field of the entries
+        if(flag==1){
+            fprintf(ERR,"error: a field (:%s) is needed to edit %s entries\n",get_fields(get_index(section)),section);
             return 1;
         }
-        if(flag==1||flag==3){
-            fprintf(stderr,"error: '=%u' is not valid in table sections\n",change);
-            return 1;
+        if(flag==2||flag==3){
+            if(!type||!strchr(get_fields(get_index(section)),type)){
+                fprintf(ERR,"error: '%c' is not a valid field in %s\n",type,section);
+                return 1;
+            }
+        }
+        if(flag==3){
+            if(commands[5]){
+                fprintf(ERR,"error: %#llx does not fit in a %s field\n",(unsigned long long)value,section);
+                return 1;
+            }
+            if(type=='s'&&(change<1||change>EH_IX_BSS+1)){
+                fprintf(ERR,"error: '%u' is not a valid section number\n",change);
+                return 1;
+            }
+            if(type=='t'&&change>0xff){
+                fprintf(ERR,"error: '%u' is not a valid type\n",change);
+                return 1;
+            }
+            if(type=='y'&&change>=(unsigned int)get_size("strings",MODULE)){
+                fprintf(ERR,"error: '%u' is not a valid string index\n",change);
+                return 1;
+            }
         }
         countsize = count;
     }
     else{
-    //check type
-         switch(type){
-            case 'b':
-                countsize = count;//byte
-                break;
-            case 'h':
-                countsize = count*2;//half
-                break;
-            case 'w':
-                countsize = count*4;//word
-                break;
-            default:
-                fprintf(stderr,"error: '%c' is not a valid type\n",type);
-                return 1;
+        if((flag==1||flag==3)&&(!strcmp(section,"sbss")||!strcmp(section,"bss"))){
+            fprintf(ERR,"error: cannot edit %s section\n",section);
+            return 1;
+        }
+        //check type, then that the value fits in one unit of it
+        const access_t* access = get_access(type,MODULE->LITTLE);
+        if(!access){
+            fprintf(ERR,"error: '%c' is not a valid type\n",type);
+            return 1;
+        }
+        if((flag==1||flag==3)&&value>access->max){
+            fprintf(ERR,"error: %#llx does not fit in a %u byte unit\n",(unsigned long long)value,access->width);
+            return 1;
         }
+        countsize = (uint64_t)count*access->width;
     }
 
     int offset = 0;
     if(MODULE->HEADER->entry!=0x0){//if its a load module acount for offset
-        if(!strcmp(section,"text")){
-            offset = get_start(MODULE,"text");
-        }
-        else if(!strcmp(section,"rdata")){
-            offset = get_start(MODULE,"rdata");
-        }
-        else if(!strcmp(section,"data")){
-            offset = get_start(MODULE,"data");
-        }
-        else if(!strcmp(section,"sdata")){
-            offset = get_start(MODULE,"sdata");
-        }
+        offset = get_start(MODULE,section);
     }
 
     //get size of section;
@@ -627,15 +1058,15 @@ int check_for_errors(unsigned int commands[5],char* section, module_t* MODULE){
     unsigned int startaddr = 0;
     if(startaddr>(address-offset)||(address-offset)>sect_size){
         if(address==0x0){
-            fprintf(stderr,"error: '0' is not a valid address\n");
+            fprintf(ERR,"error: '0' is not a valid address\n");
         }
         else{
-            fprintf(stderr,"error: '%u' is not a valid address\n",address);
+            fprintf(ERR,"error: '%u' is not a valid address\n",address);
         }
         return 1;
     }
-    if(((address-offset)+countsize)>sect_size){//if the added count and adress will surpass size of section 
-        fprintf(stderr,"error: '%d' is not a valid count\n",count);
+    if((address-offset)+countsize>sect_size){//if the added count and adress will surpass size of section 
+        fprintf(ERR,"error: '%d' is not a valid count\n",count);
         return 1;
     }
 
@@ -643,6 +1074,16 @@ int check_for_errors(unsigned int commands[5],char* section, module_t* MODULE){
 }
 
 ///get the string based on an index
+///param: MODULE for the string table, index into the table
+///return: the string, or a placeholder if the index is out of range
+char* get_string(module_t* MODULE, uint32_t index){
+    uint32_t strings_size = ntohl(MODULE->HEADER->sz_strings);
+    load_sections(MODULE,SECTION_BIT(EH_IX_STR));
+    if(!MODULE->STRINGS||index>=strings_size||!memchr(&MODULE->STRINGS[index],'\0',strings_size-index)){
+        return "(bad string index)";
+    }
+    return (char*)&MODULE->STRINGS[index];
+}
 
 ///print out the ref tab
 ///param: address, count, reference table array, MODULE for string
@@ -650,10 +1091,10 @@ int check_for_errors(unsigned int commands[5],char* section, module_t* MODULE){
 void print_ref_tab(unsigned int address,int count,refent_t* reftab,module_t* MODULE){
     for(int entry=0;entry<count;entry++){
         if(reftab[address].addr == 0x0){
-            printf("   0x00000000 type %#06x symbol %s\n",reftab[address].section,&MODULE->STRINGS[ntohl(reftab[address].sym)]);
+            fprintf(OUT,"   0x00000000 type %#06x symbol %s\n",reftab[address].type,get_string(MODULE,ntohl(reftab[address].sym)));
         }
         else{
-            printf("   %#010x type %#06x symbol %s\n",ntohl(reftab[address].addr),reftab[address].section,&MODULE->STRINGS[ntohl(reftab[address].sym)]);
+            fprintf(OUT,"   %#010x type %#06x symbol %s\n",ntohl(reftab[address].addr),reftab[address].type,get_string(MODULE,ntohl(reftab[address].sym)));
         }
         address++;
     }
@@ -665,11 +1106,15 @@ void print_ref_tab(unsigned int address,int count,refent_t* reftab,module_t* MOD
 void print_rel_tab(unsigned int address,int count,relent_t* reltab){
     char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
     for(int entry=0;entry<count;entry++){
+        char* name = "bad section";
+        if(reltab[address].section>=1&&reltab[address].section<=EH_IX_BSS+1){
+            name = sections[reltab[address].section-1];
+        }
         if(reltab[address].addr == 0x0){
-            printf("   0x00000000 (%s) type %#06x\n",sections[reltab[address].section-1],reltab[address].type);
+            fprintf(OUT,"   0x00000000 (%s) type %#06x\n",name,reltab[address].type);
         }
         else{
-            printf("   %#010x (%s) type %#06x\n",ntohl(reltab[address].addr),sections[reltab[address].section-1],reltab[address].type);
+            fprintf(OUT,"   %#010x (%s) type %#06x\n",ntohl(reltab[address].addr),name,reltab[address].type);
         }
         address++;
     }
@@ -680,10 +1125,10 @@ void print_rel_tab(unsigned int address,int count,relent_t* reltab){
 void print_sym_tab(unsigned int address,int count,syment_t* symtab,module_t* MODULE){
     for(int entry=0;entry<count;entry++){
         if(symtab[address].value == 0x0){
-            printf("   value 0x00000000 flags %#010x symbol %s\n",ntohl(symtab[address].flags),&MODULE->STRINGS[ntohl(symtab[address].sym)]);
+            fprintf(OUT,"   value 0x00000000 flags %#010x symbol %s\n",ntohl(symtab[address].flags),get_string(MODULE,ntohl(symtab[address].sym)));
         }
         else{
-            printf("   value %#010x flags %#010x symbol %s\n",ntohl(symtab[address].value),ntohl(symtab[address].flags),&MODULE->STRINGS[ntohl(symtab[address].sym)]);
+            fprintf(OUT,"   value %#010x flags %#010x symbol %s\n",ntohl(symtab[address].value),ntohl(symtab[address].flags),get_string(MODULE,ntohl(symtab[address].sym)));
         }
         address++;
     }
@@ -714,7 +1159,13 @@ void print_module_data(unsigned int address, int count, char type, module_t* MOD
                 case 3://sdata
                     to_print = MODULE->SDATA;
                     break;
-                case 6://skip bss sbbs to reltab
+                case 4://sbss, reads as zeros
+                    to_print = MODULE->SBSS;
+                    break;
+                case 5://bss
+                    to_print = MODULE->BSS;
+                    break;
+                case 6://reltab
                     to_print_rel = MODULE->RELTAB;
                     break;
                 case 7://reftab
@@ -730,18 +1181,7 @@ void print_module_data(unsigned int address, int count, char type, module_t* MOD
 
             int offset = 0;
             if(MODULE->HEADER->entry!=0x0){
-                if(!strcmp(section,"text")){
-                    offset = get_start(MODULE,"text");
-                }
-                else if(!strcmp(section,"rdata")){
-                    offset = get_start(MODULE,"rdata");
-                }
-                else if(!strcmp(section,"data")){
-                    offset = get_start(MODULE,"data");
-                }
-                else if(!strcmp(section,"sdata")){
-                    offset = get_start(MODULE,"sdata");
-                }
+                offset = get_start(MODULE,section);
             }
 
             if(to_print_ref){
@@ -753,65 +1193,18 @@ void print_module_data(unsigned int address, int count, char type, module_t* MOD
             else if(to_print_sym){
                 print_sym_tab(address,count,to_print_sym,MODULE);
             }
-            else{//if not an entry table
-                for(int data=0;data<count;data++){
-                    if(type=='b'){
-                        if(offset==0x0&&(address-offset)==0x0){
-                            if(to_print[address-offset]==0x0){
-                                printf("   0x00000000 = 0x00\n");
-                            }
-                            else{
-                                printf("   0x00000000 = %#04x\n",to_print[address-offset]);
-                            }
-                        }
-                        else{
-                            if(to_print[address-offset]==0x0){
-                                printf("   %#010x = 0x00\n",address);
-                            }
-                            else{
-                                printf("   %#010x = %#04x\n",address,to_print[address-offset]);
-                            }
-                        }
-                        address++;
-                    }
-                    else if(type=='h'){
-                        if(offset==0x0&&(address-offset)==0x0){
-                            if(to_print[address-offset]==0x0){
-                                printf("   0x00000000 = 0x00%02x\n",to_print[(address-offset)+1]);
-                            }
-                            else{
-                                printf("   0x00000000 = %#04x%02x\n",to_print[address-offset],to_print[(address-offset)+1]);
-                            }
-                        }
-                        else{
-                            if(to_print[address-offset]==0x0){
-                                printf("   %#010x = 0x00%02x\n",address,to_print[(address-offset)+1]);
-                            }
-                            else{
-                                printf("   %#010x = %#04x%02x\n",address,to_print[address-offset],to_print[(address-offset)+1]);
-                            }
-                        }
-                        address+=2;
-                    }
-                    else{
-                        if(offset==0x0&&(address-offset)==0x0){
-                            if(to_print[address-offset]==0x0){
-                                printf("   0x00000000 = 0x00%02x%02x%02x\n",to_print[(address-offset)+1],to_print[(address-offset)+2],to_print[(address-offset)+3]);
-                            }
-                            else{
-                                 printf("   0x00000000 = %#04x%02x%02x%02x\n",to_print[address-offset],to_print[(address-offset)+1],to_print[(address-offset)+2],to_print[(address-offset)+3]);
-                            }
-                        }
-                        else{
-                            if(to_print[address-offset]==0x0){
-                                printf("   %#010x = 0x00%02x%02x%02x\n",address,to_print[(address-offset)+1],to_print[(address-offset)+2],to_print[(address-offset)+3]);
-                            }
-                            else{
-                                printf("   %#010x = %#04x%02x%02x%02x\n",address,to_print[address-offset],to_print[(address-offset)+1],to_print[(address-offset)+2],to_print[(address-offset)+3]);
-                            }
-                        } 
-                        address+=4;
+            else{//if not an entry table, the units are gathered a batch at a time by the kernel of the type
+                const access_t* access = get_access(type,MODULE->LITTLE);
+                uint8_t* at = to_print+(address-offset);
+                uint64_t values[256];
+                for(int done=0;done<count;){
+                    uint32_t batch = count-done<256?count-done:256;
+                    access->gather(at+(size_t)done*access->width,values,batch);
+                    for(uint32_t unit=0;unit<batch;unit++){
+                        fprintf(OUT,"   0x%08x = 0x%0*llx\n",address,(int)access->width*2,(unsigned long long)values[unit]);
+                        address += access->width;
                     }
+                    done += batch;
                 }
             }
         }
@@ -821,318 +1214,1036 @@ void print_module_data(unsigned int address, int count, char type, module_t* MOD
 
 ///funciton to edit the modules memory in place
 ///param: address,count,type,change value,MODULE,seciton
-void edit_module_data(unsigned int address,int count,char type,unsigned int change,module_t* MODULE,char* section){
-    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
-    for(int sec=0;sec<10;sec++){
-        if(!strcmp(section,sections[sec])){
-            uint8_t byte_toadd = 0;
-            uint8_t half_toadd[2] = {0};
-            uint8_t word_toadd[4] = {0};
-            
-            uint8_t* to_write = NULL;
-
-            switch(sec){
-                case 0:
-                    to_write = MODULE->TEXT;
-                    break;
-                case 1:
-                    to_write = MODULE->RDATA;
-                    break;
-                case 2:
-                    to_write = MODULE->DATA;
-                    break;
-                case 3:
-                    to_write = MODULE->SDATA;
-                    break;
-                case 9:
-                    to_write = MODULE->STRINGS;
-                    break;
-            }
-
-            int offset = 0;
-            if(MODULE->HEADER->entry!=0x0){
-                if(!strcmp(section,"text")){
-                    offset = get_start(MODULE,"text");
-                }
-                else if(!strcmp(section,"rdata")){
-                    offset = get_start(MODULE,"rdata");
-                }
-                else if(!strcmp(section,"data")){
-                    offset = get_start(MODULE,"data");
-                }
-                else if(!strcmp(section,"sdata")){
-                    offset = get_start(MODULE,"sdata");
-                }
-            }
+void edit_module_data(unsigned int address,int count,char type,uint64_t change,module_t* MODULE,char* section){
+    int sec = get_index(section);
+    const access_t* access = get_access(type,MODULE->LITTLE);
+    int offset = 0;
+    if(MODULE->HEADER->entry!=0x0){
+        offset = get_start(MODULE,section);
+    }
+    uint8_t* to_write = *get_section(MODULE,sec);
+    snapshot_touch(MODULE,sec,address-offset,(uint64_t)count*access->width);
+    access->fill(to_write+(address-offset),change,count);
+    for(int unit=0;unit<count;unit++){
+        fprintf(OUT,"   0x%08x is now 0x%0*llx\n",address,(int)access->width*2,(unsigned long long)change);
+        address += access->width;
+    }
+}
 
-            switch(type){
-                case 'b':
-                    if(change>=0xff){//if bigger than a byte
-                        byte_toadd = 0xff;
-                    }
-                    else{
-                        byte_toadd = change;
-                    }
-                    break;
-                case 'h':
-                    if(change>=0xffff){//greater than half word
-                        half_toadd[0] = 0xff;
-                        half_toadd[1] = 0xff;
-                    }
-                    else{
-                        unsigned mask = createMask(0,7);//create an 8 bit mask
-                        half_toadd[1] = mask & change;//flip because bigendian
-                        change = change>>8;//shift 8 bits
-                        half_toadd[0] = mask & change;
-                    }
-                    break;
-                case 'w':
-                    if(change>=0xffffffff){//greater than a word
-                        word_toadd[0] = 0xff;
-                        word_toadd[1] = 0xff;
-                        word_toadd[2] = 0xff;
-                        word_toadd[3] = 0xff;
-                    }
-                    else{
-                        unsigned mask = createMask(0,7);
-                        word_toadd[3] = mask & change;
-                        change = change>>8;
-                        word_toadd[2] = mask & change;
-                        change = change>>8;
-                        word_toadd[1] = mask & change;
-                        change = change>>8;
-                        word_toadd[0] = mask & change;
-                    }
-                    break;
+///funciton to edit the entries of a table section in place
+///param: address first entry, count, field to change, change value, MODULE, section
+void edit_table_data(unsigned int address,int count,char field,unsigned int change,module_t* MODULE,char* section){
+    int sec = get_index(section);
+    snapshot_touch(MODULE,sec,(uint64_t)address*get_unit(sec),(uint64_t)count*get_unit(sec));
+    for(int entry=0;entry<count;entry++){
+        if(!strcmp(section,"reltab")){
+            relent_t* rel = &MODULE->RELTAB[address];
+            switch(field){
+                case 'a': rel->addr = htonl(change); break;
+                case 's': rel->section = change; break;
+                case 't': rel->type = change; break;
             }
-            if(type=='b'){//write the byte
-                for(int byte=0;byte<count;byte++){
-                    to_write[address-offset] = byte_toadd;
-                    if(address==0x0){
-                        if(to_write[address-offset]==0x0){
-                            printf("   0x00000000 is now 0x00\n");
-                        }
-                        else{
-                            printf("   0x00000000 is now %#04x\n",to_write[address-offset]);
-                        }
-                    }
-                    else{
-                        if(to_write[address-offset]==0x0){
-                            printf("   %#010x is now 0x00\n",address);
-                        }
-                        else{
-                            printf("   %#010x is now %#04x\n",address,to_write[address-offset]);
-                        }
-                    }
-                    address++;
-                }
+            print_rel_tab(address,1,MODULE->RELTAB);
+        }
+        else if(!strcmp(section,"reftab")){
+            refent_t* ref = &MODULE->REFTAB[address];
+            switch(field){
+                case 'a': ref->addr = htonl(change); break;
+                case 'y': ref->sym = htonl(change); break;
+                case 's': ref->section = change; break;
+                case 't': ref->type = change; break;
             }
-            else if(type=='h'){//write a half word
-                for(int half=0;half<count;half++){
-                    for(int byte=0;byte<2;byte++){//2 bytes in a half
-                        to_write[(address-offset)+byte] = half_toadd[byte];
-                    }
-                    if(address==0x0){
-                        if(half_toadd[0]==0x0){
-                            printf("   0x00000000 is now 0x00%02x\n",half_toadd[1]);
-                        }
-                        else{
-                            printf("   0x00000000 is now %#04x%02x\n",half_toadd[0],half_toadd[1]);
-                        }
-                    }
-                    else{
-                        if(half_toadd[0]==0x0){
-                            printf("   %#010x is now 0x00%02x\n",address,half_toadd[1]);
-                        }
-                        else{
-                            printf("   %#010x is now %#04x%02x\n",address,half_toadd[0],half_toadd[1]);
-                        }
-                    }
-                    address+=2;
-                }
-            }
-            else if(type=='w'){//write a word
-                for(int word=0;word<count;word++){
-                    for(int byte=0;byte<4;byte++){
-                        to_write[(address-offset)+byte] = word_toadd[byte];
-                    }
-                    if(address==0x0){
-                        if(word_toadd[0]==0x0){
-                            printf("   0x00000000 is now 0x00%02x%02x%02x\n",word_toadd[1],word_toadd[2],word_toadd[3]);
-                        }
-                        else{
-                            printf("   0x00000000 is now %#04x%02x%02x%02x\n",word_toadd[0],word_toadd[1],word_toadd[2],word_toadd[3]);
-                        }
-                    }
-                    else{
-                        if(word_toadd[0]==0x0){
-                            printf("   %#010x is now 0x00%02x%02x%02x\n",address,word_toadd[1],word_toadd[2],word_toadd[3]);
-                        }
-                        else{
-                            printf("   %#010x is now %#04x%02x%02x%02x\n",address,word_toadd[0],word_toadd[1],word_toadd[2],word_toadd[3]);
-                        }
-                    }
-                    address+=4;
-                }
+            print_ref_tab(address,1,MODULE->REFTAB,MODULE);
+        }
+        else{
+            syment_t* sym = &MODULE->SYMTAB[address];
+            switch(field){
+                case 'f': sym->flags = htonl(change); break;
+                case 'v': sym->value = htonl(change); break;
+                case 'y': sym->sym = htonl(change); break;
             }
+            print_sym_tab(address,1,MODULE->SYMTAB,MODULE);
+        }
+        address++;
+    }
+}
+
+///change the size of a section or table, new space is zero filled
+///param: MODULE, sec the EH_IX_ index, size new size in bytes or entries
+///return: 1 if the module was changed, 0 otherwise
+int resize_section(module_t* MODULE, int sec, uint32_t size){
+    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    uint32_t old_size = ntohl(MODULE->HEADER->data[sec]);
+    if(sec==EH_IX_TEXT&&size%4!=0){
+        fprintf(ERR,"error: text must be a whole number of words\n");
+        return 0;
+    }
+    if(size==old_size||load_sections(MODULE,SECTION_BIT(sec))){
+        return 0;
+    }
+    snapshot_whole(MODULE,sec);
+    void** slot = get_section(MODULE,sec);
+    size_t unit = get_unit(sec);
+    if(sec==EH_IX_SBSS||sec==EH_IX_BSS){//zero mappings are replaced, not reallocated
+        uint8_t* zero = NULL;
+        if(size&&!(zero = map_zero(size))){
+            fprintf(ERR,"error: not enough memory to resize %s\n",sections[sec]);
+            return 0;
+        }
+        release_section(MODULE,sec);
+        *slot = zero;
+    }
+    else if(size==0){
+        release_section(MODULE,sec);
+    }
+    else{
+        //sections in the arena or mapped from the file move to their own allocation
+        int moved = in_arena(MODULE,*slot)||(MODULE->MAPPED&SECTION_BIT(sec));
+        uint8_t* data = moved?malloc((size_t)size*unit):realloc(*slot,(size_t)size*unit);
+        if(!data){
+            fprintf(ERR,"error: not enough memory to resize %s\n",sections[sec]);
+            return 0;
+        }
+        stats_alloc((size_t)size*unit);
+        if(moved){
+            memcpy(data,*slot,(size<old_size?size:old_size)*unit);
+            release_section(MODULE,sec);//unmaps a mapped section, leaves the arena as it is
         }
+        if(size>old_size){
+            memset(data+old_size*unit,0,(size-old_size)*unit);
+        }
+        *slot = data;
+    }
+    MODULE->HEADER->data[sec] = htonl(size);
+    if(sec==EH_IX_STR&&size<old_size){
+        fprintf(ERR,"warning: names past %u were removed, run validate\n",size);
     }
+    fprintf(OUT,"Section %s is now %u %s long\n",sections[sec],size,unit==1?"bytes":"entries");
+    return 1;
+}
+
+///check whether an edit overwrites a field the reltab or reftab fixes up
+///param: MODULE, commands of the edit, section being edited
+///return: 1 if the edit is refused, 0 if it may go ahead
+int guard_edit(module_t* MODULE, unsigned int commands[6], char* section){
+    if(MODULE->GUARD==GUARD_OFF){
+        return 0;
+    }
+    load_indexes(MODULE);
+    if(!MODULE->RELOCS){
+        MODULE->RELOCS = build_reloc_index(MODULE);
+    }
+    uint32_t offset = commands[0];
+    if(MODULE->HEADER->entry!=0x0){
+        offset -= get_start(MODULE,section);
+    }
+    uint32_t length = commands[1]*type_width(commands[2]);
+    char describe[64];
+    uint32_t hits = find_relocs(MODULE->RELOCS,get_index(section),offset,length,describe);
+    if(!hits){
+        return 0;
+    }
+    if(MODULE->GUARD==GUARD_WARN){
+        fprintf(ERR,"warning: the edit overwrites %u relocated field%s (%s)\n",hits,hits==1?"":"s",describe);
+        return 0;
+    }
+    fprintf(ERR,"error: the edit would overwrite %u relocated field%s (%s), use 'guard warn' to allow it\n",
+            hits,hits==1?"":"s",describe);
+    return 1;
 }
 
 ///fuction to edit the module based on the command
 ///param: MODULE module to edit, command command to process, current section
 ///return 1 if written 0 if examined
-int edit_module(module_t* MODULE, unsigned int commands[5],char* section){
-    //printf("[%#x][%d][%c][%#x] change flag: [%d]\n",commands[0],commands[1],commands[2],commands[3],commands[4]); 
-    if(!check_for_errors(commands,section,MODULE)){
+int edit_module(module_t* MODULE, unsigned int commands[6],char* section){
+    //fprintf(OUT,"[%#x][%d][%c][%#x] change flag: [%d]\n",commands[0],commands[1],commands[2],commands[3],commands[4]); 
+    int sec = get_index(section);
+    int table = get_unit(sec)>1;
+    uint64_t bytes = (uint64_t)commands[1]*(table?get_unit(sec):type_width(commands[2]));
+    uint64_t began = stats_now();
+    int bad = check_for_errors(commands,section,MODULE);
+    stats_record(STAT_CHECK,began);
+    if(!bad&&load_sections(MODULE,SECTION_BIT(sec)|(sec==EH_IX_REF||sec==EH_IX_SYM?SECTION_BIT(EH_IX_STR):0))){
+        return 0;
+    }
+    if(!bad){
         //the error test passed
-        if(commands[4]==1||commands[4]==3){//if values will be changed
-            edit_module_data(commands[0],commands[1],commands[2],commands[3],MODULE,section); 
+        if(commands[4]==3&&strchr(get_fields(sec),commands[2])){//if table entries will be changed
+            PROBE4(edit__entry,section,commands[0],commands[1],bytes);
+            edit_table_data(commands[0],commands[1],commands[2],commands[3],MODULE,section);
+            PROBE4(edit__return,section,commands[0],commands[1],bytes);
+            return 1;
+        }
+        else if(commands[4]==1||commands[4]==3){//if values will be changed
+            if(guard_edit(MODULE,commands,section)){
+                return 0;
+            }
+            PROBE4(edit__entry,section,commands[0],commands[1],bytes);
+            edit_module_data(commands[0],commands[1],commands[2],(uint64_t)commands[5]<<32|commands[3],MODULE,section);
+            PROBE4(edit__return,section,commands[0],commands[1],bytes);
             return 1;
         }
         else{//if its just a print command
+            PROBE4(examine__entry,section,commands[0],commands[1],bytes);
             print_module_data(commands[0],commands[1],commands[2],MODULE,section);
+            PROBE4(examine__return,section,commands[0],commands[1],bytes);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+///copy bytes from a section of one module into the same section of another, or of the same module
+///param: to module being edited, from module copied from, section, source address, count of bytes, dest address
+///return: 1 if copied, 0 if not
+int copy_range(module_t* to, module_t* from, char* section, unsigned int source, unsigned int count, unsigned int dest){
+    int sec = get_index(section);
+    if(get_unit(sec)>1){
+        fprintf(ERR,"error: %s entries cannot be copied, their indexes belong to their own module\n",section);
+        return 0;
+    }
+    unsigned int examine[6] = {source,count,'b',0,0,0};
+    unsigned int edit[6] = {dest,count,'b',0,1,0};
+    if(check_for_errors(examine,section,from)||check_for_errors(edit,section,to)){
+        return 0;
+    }
+    if(load_sections(from,SECTION_BIT(sec))||load_sections(to,SECTION_BIT(sec))||guard_edit(to,edit,section)){
+        return 0;
+    }
+    uint8_t* src = (uint8_t*)*get_section(from,sec)+source-(from->HEADER->entry?get_start(from,section):0);
+    uint8_t* dst = (uint8_t*)*get_section(to,sec)+dest-(to->HEADER->entry?get_start(to,section):0);
+    snapshot_touch(to,sec,dest-(to->HEADER->entry?get_start(to,section):0),count);
+    memmove(dst,src,count);//the ranges overlap when copying within one module
+    return 1;
+}
+
+///check that an entry's section number and address are inside the module
+///param: job the entry belongs to, section number (1 based), address
+///return: 0 if good, otherwise the reason it is bad
+int validate_address(validate_job_t* job, uint8_t section, uint32_t addr){
+    if(section<1||section>EH_IX_BSS+1){
+        return 2;
+    }
+    uint32_t start = job->start[section-1];
+    uint64_t size = ntohl(job->MODULE->HEADER->data[section-1]);
+    if(addr<start||(uint64_t)(addr-start)+4>size){
+        return 3;
+    }
+    return 0;
+}
+
+///check a string table index
+///param: job the entry belongs to, index to check
+///return: 0 if good, otherwise the reason it is bad
+int validate_string(validate_job_t* job, uint32_t index){
+    if((int64_t)index>job->last_nul){//past the end or runs off the end of the table
+        return 1;
+    }
+    return 0;
+}
+
+///check one chunk of a table, safe to run on its own thread
+///param: arg the validate_job_t to process
+void* validate_entries(void* arg){
+    validate_job_t* job = arg;
+    module_t* MODULE = job->MODULE;
+    for(uint32_t entry=job->begin;entry<job->end;entry++){
+        int why = 0;
+        switch(job->table){
+            case EH_IX_REL:
+                why = validate_address(job,MODULE->RELTAB[entry].section,ntohl(MODULE->RELTAB[entry].addr));
+                break;
+            case EH_IX_REF:
+                why = validate_string(job,ntohl(MODULE->REFTAB[entry].sym));
+                if(!why){
+                    why = validate_address(job,MODULE->REFTAB[entry].section,ntohl(MODULE->REFTAB[entry].addr));
+                }
+                break;
+            case EH_IX_SYM:
+                why = validate_string(job,ntohl(MODULE->SYMTAB[entry].sym));
+                break;
+        }
+        if(why){
+            if(job->nbad<VALIDATE_MAX_REPORT){
+                job->bad[job->nbad] = entry;
+                job->why[job->nbad] = why;
+            }
+            job->nbad++;
+        }
+    }
+    return NULL;
+}
+
+///struct to hand a set of validation jobs to one thread
+typedef struct validate_worker{
+    validate_job_t* jobs;
+    int njobs;
+    int first;
+    int stride;
+}validate_worker_t;
+
+///run every stride'th job starting at first
+///param: arg the validate_worker_t to process
+void* validate_worker(void* arg){
+    validate_worker_t* worker = arg;
+    for(int job=worker->first;job<worker->njobs;job+=worker->stride){
+        validate_entries(&worker->jobs[job]);
+    }
+    return NULL;
+}
+
+///check the header, section sizes, tables and string indices of a module, and its sidecar if it has one
+///the tables are split into chunks which are checked in parallel
+///param: MODULE module to check, name of the module file
+///return: number of errors found
+unsigned int validate_module(module_t* MODULE, char* name){
+    char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    exec_t* header = MODULE->HEADER;
+    unsigned int errors = 0;
+    if(load_sections(MODULE,TABLE_SECTIONS)){
+        return 1;
+    }
+    //header and section sizes
+    if(ntohs(header->version)!=HDR_VERSION_1&&ntohs(header->version)!=HDR_VERSION_2){
+        fprintf(ERR,"warning: module version %#06x is not %#06x or %#06x\n",ntohs(header->version),HDR_VERSION_1,HDR_VERSION_2);
+    }
+    uint64_t length = module_length(header);
+    if(length>MODULE->LENGTH){
+        fprintf(ERR,"error: section sizes need %llu bytes but the file is %llu bytes long\n",
+                (unsigned long long)length,(unsigned long long)MODULE->LENGTH);
+        errors++;
+    }
+    else if(length<MODULE->LENGTH){
+        fprintf(ERR,"warning: %llu bytes follow the string table\n",(unsigned long long)(MODULE->LENGTH-length));
+    }
+    if(ntohl(header->data[EH_IX_TEXT])%4!=0){
+        fprintf(ERR,"error: text is %u bytes long, not a whole number of words\n",ntohl(header->data[EH_IX_TEXT]));
+        errors++;
+    }
+    uint32_t start[EH_IX_BSS+1] = {0};
+    if(header->entry!=0x0){//load module addresses are absolute
+        for(int sec=EH_IX_TEXT;sec<=EH_IX_BSS;sec++){
+            start[sec] = get_start(MODULE,sections[sec]);
+        }
+        uint32_t entry = ntohl(header->entry);
+        if(entry<TEXT_BEGIN||entry-TEXT_BEGIN>=ntohl(header->data[EH_IX_TEXT])||entry%4!=0){
+            fprintf(ERR,"error: entry point %#010x is not a word in the text section\n",entry);
+            errors++;
+        }
+        uint64_t data_end = DATA_BEGIN;
+        for(int sec=EH_IX_RDATA;sec<=EH_IX_BSS;sec++){
+            data_end += (ntohl(header->data[sec])+7)&~7u;
+        }
+        if(data_end>STACK_BEGIN){
+            fprintf(ERR,"error: data sections end at %#llx, past the start of the stack\n",(unsigned long long)data_end);
+            errors++;
+        }
+    }
+    //string table
+    uint32_t strings_size = ntohl(header->sz_strings);
+    int64_t last_nul = -1;
+    if(MODULE->STRINGS){
+        for(int64_t byte=strings_size-1;byte>=0;byte--){
+            if(MODULE->STRINGS[byte]=='\0'){
+                last_nul = byte;
+                break;
+            }
+        }
+        if(last_nul!=(int64_t)strings_size-1){
+            fprintf(ERR,"error: the string table is not NUL-terminated\n");
+            errors++;
+        }
+    }
+    //split the tables into jobs
+    int njobs = 0;
+    for(int table=EH_IX_REL;table<=EH_IX_SYM;table++){
+        njobs += (ntohl(header->data[table])+VALIDATE_CHUNK-1)/VALIDATE_CHUNK;
+    }
+    validate_job_t* jobs = calloc(njobs?njobs:1,sizeof(validate_job_t));
+    int job = 0;
+    for(int table=EH_IX_REL;table<=EH_IX_SYM;table++){
+        uint32_t entries = ntohl(header->data[table]);
+        for(uint32_t begin=0;begin<entries;begin+=VALIDATE_CHUNK){
+            jobs[job].MODULE = MODULE;
+            jobs[job].table = table;
+            jobs[job].begin = begin;
+            jobs[job].end = entries-begin>VALIDATE_CHUNK?begin+VALIDATE_CHUNK:entries;
+            jobs[job].start = start;
+            jobs[job].last_nul = last_nul;
+            job++;
+        }
+    }
+    //check the jobs, on this thread if there is only one
+    int nthreads = get_nprocs();
+    if(nthreads>njobs){
+        nthreads = njobs;
+    }
+    if(nthreads<=1){
+        for(job=0;job<njobs;job++){
+            validate_entries(&jobs[job]);
+        }
+    }
+    else{
+        pthread_t threads[nthreads];
+        validate_worker_t workers[nthreads];
+        int started = 0;
+        for(int t=0;t<nthreads;t++){
+            workers[t].jobs = jobs;
+            workers[t].njobs = njobs;
+            workers[t].first = t;
+            workers[t].stride = nthreads;
+        }
+        while(started<nthreads&&!pthread_create(&threads[started],NULL,validate_worker,&workers[started])){
+            started++;
+        }
+        for(int t=started;t<nthreads;t++){//could not get every thread, finish the rest here
+            validate_worker(&workers[t]);
+        }
+        for(int t=0;t<started;t++){
+            pthread_join(threads[t],NULL);
+        }
+    }
+    //report in table order
+    char* reasons[] = {"","bad string index","bad section number","address outside of its section"};
+    for(job=0;job<njobs;job++){
+        for(uint32_t bad=0;bad<jobs[job].nbad&&bad<VALIDATE_MAX_REPORT;bad++){
+            fprintf(ERR,"error: %s[%u]: %s\n",sections[jobs[job].table],jobs[job].bad[bad],reasons[jobs[job].why[bad]]);
+        }
+        if(jobs[job].nbad>VALIDATE_MAX_REPORT){
+            fprintf(ERR,"error: %s[%u-%u]: %u more bad entries\n",sections[jobs[job].table],
+                    jobs[job].begin,jobs[job].end-1,jobs[job].nbad-VALIDATE_MAX_REPORT);
+        }
+        errors += jobs[job].nbad;
+    }
+    free(jobs);
+    errors += check_cache(MODULE,name);
+    if(errors){
+        fprintf(OUT,"Module %s has %u errors\n",name,errors);
+    }
+    else{
+        fprintf(OUT,"Module %s is valid\n",name);
+    }
+    return errors;
+}
+
+///struct to hold one unique string while compacting the string table
+typedef struct intern{
+    char* str;
+    uint32_t len;
+    uint32_t hash;
+    uint32_t offset;//index in the compacted table
+}intern_t;
+
+///hash a string with FNV-1a
+///param: str to hash, len its length
+///return: 32 bit hash
+uint32_t hash_string(char* str, uint32_t len){
+    uint32_t hash = 2166136261u;
+    for(uint32_t c=0;c<len;c++){
+        hash ^= (uint8_t)str[c];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+///compare two interned strings from their last character back
+///so that a string sorts directly after every string it is a suffix of
+///param: a and b pointers to intern_t pointers
+///return: qsort ordering, descending
+int compare_reversed(const void* a, const void* b){
+    intern_t* x = *(intern_t**)a;
+    intern_t* y = *(intern_t**)b;
+    uint32_t i = x->len, j = y->len;
+    while(i>0&&j>0){
+        uint8_t cx = x->str[--i], cy = y->str[--j];
+        if(cx!=cy){
+            return cx<cy?1:-1;
+        }
+    }
+    if(x->len==y->len){
+        return 0;
+    }
+    return x->len<y->len?1:-1;
+}
+
+///rebuild the string table with only the names referenced by the symtab and reftab
+///duplicates are interned through a hash set and names that are the tail of
+///another name share its bytes
+///param: MODULE module to compact
+///return: 1 if the module was changed, 0 otherwise
+int compact_strings(module_t* MODULE){
+    uint32_t nsyms = ntohl(MODULE->HEADER->data[EH_IX_SYM]);
+    uint32_t nrefs = ntohl(MODULE->HEADER->data[EH_IX_REF]);
+    uint32_t old_size = ntohl(MODULE->HEADER->data[EH_IX_STR]);
+    uint32_t nnames = nsyms+nrefs;
+    if(!MODULE->STRINGS){
+        fprintf(OUT,"There is no string table to compact\n");
+        return 0;
+    }
+    if(load_sections(MODULE,TABLE_SECTIONS)){
+        return 0;
+    }
+    //every name must be a valid string before anything is touched
+    uint32_t* refs = malloc((nnames?nnames:1)*sizeof(uint32_t));//index of the name
+    for(uint32_t name=0;name<nnames;name++){
+        refs[name] = ntohl(name<nsyms?MODULE->SYMTAB[name].sym:MODULE->REFTAB[name-nsyms].sym);
+        if(refs[name]>=old_size||!memchr(&MODULE->STRINGS[refs[name]],'\0',old_size-refs[name])){
+            fprintf(ERR,"error: %s[%u] has a bad string index, run validate\n",
+                    name<nsyms?"symtab":"reftab",name<nsyms?name:name-nsyms);
+            free(refs);
             return 0;
         }
     }
+    //intern the names through an open addressed hash set
+    uint32_t buckets = 16;
+    while(buckets<nnames*2){
+        buckets <<= 1;
+    }
+    uint32_t* set = malloc(buckets*sizeof(uint32_t));//unique index + 1, 0 when empty
+    memset(set,0,buckets*sizeof(uint32_t));
+    intern_t* unique = malloc((nnames?nnames:1)*sizeof(intern_t));
+    uint32_t nunique = 0;
+    for(uint32_t name=0;name<nnames;name++){
+        char* str = (char*)&MODULE->STRINGS[refs[name]];
+        uint32_t len = strlen(str);
+        uint32_t hash = hash_string(str,len);
+        uint32_t bucket = hash&(buckets-1);
+        while(set[bucket]){
+            intern_t* in = &unique[set[bucket]-1];
+            if(in->hash==hash&&in->len==len&&!memcmp(in->str,str,len)){
+                break;
+            }
+            bucket = (bucket+1)&(buckets-1);
+        }
+        if(!set[bucket]){
+            unique[nunique].str = str;
+            unique[nunique].len = len;
+            unique[nunique].hash = hash;
+            set[bucket] = ++nunique;
+        }
+        refs[name] = set[bucket]-1;//now the unique index
+    }
+    free(set);
+    //tail merge: after sorting, a name is a suffix of the one before it or of nothing
+    intern_t** order = malloc((nunique?nunique:1)*sizeof(intern_t*));
+    for(uint32_t u=0;u<nunique;u++){
+        order[u] = &unique[u];
+    }
+    qsort(order,nunique,sizeof(intern_t*),compare_reversed);
+    uint32_t new_size = 1;//index 0 stays the empty string
+    uint32_t shared = 0;
+    intern_t* owner = NULL;
+    for(uint32_t u=0;u<nunique;u++){
+        intern_t* in = order[u];
+        if(in->len==0){
+            in->offset = owner?owner->offset+owner->len:0;
+            shared++;
+        }
+        else if(owner&&owner->len>=in->len&&!memcmp(owner->str+owner->len-in->len,in->str,in->len)){
+            in->offset = owner->offset+owner->len-in->len;
+            shared++;
+        }
+        else{
+            in->offset = new_size;
+            new_size += in->len+1;
+            owner = in;
+        }
+    }
+    free(order);
+    if(new_size>=old_size){
+        fprintf(OUT,"The string table is already compact (%u bytes)\n",old_size);
+        free(unique);
+        free(refs);
+        return 0;
+    }
+    //emit the new table and point the entries at it
+    snapshot_whole(MODULE,EH_IX_STR);
+    snapshot_touch(MODULE,EH_IX_SYM,0,(uint64_t)nsyms*sizeof(syment_t));
+    snapshot_touch(MODULE,EH_IX_REF,0,(uint64_t)nrefs*sizeof(refent_t));
+    uint8_t* strings = calloc(1,new_size);
+    stats_alloc(new_size);
+    for(uint32_t u=0;u<nunique;u++){//shared names copy the same bytes again
+        memcpy(&strings[unique[u].offset],unique[u].str,unique[u].len);
+    }
+    for(uint32_t name=0;name<nnames;name++){
+        uint32_t offset = htonl(unique[refs[name]].offset);
+        if(name<nsyms){
+            MODULE->SYMTAB[name].sym = offset;
+        }
+        else{
+            MODULE->REFTAB[name-nsyms].sym = offset;
+        }
+    }
+    release_section(MODULE,EH_IX_STR);
+    MODULE->STRINGS = strings;
+    MODULE->HEADER->data[EH_IX_STR] = htonl(new_size);
+    fprintf(OUT,"Section strings compacted from %u to %u bytes (%u unique names, %u shared)\n",
+            old_size,new_size,nunique,shared);
+    free(unique);
+    free(refs);
+    return 1;
+}
+
+///print the size of a section
+///param: MODULE, section name
+void print_size(module_t* MODULE, char* section){
+    char* unit = "bytes";
+    if(!strcmp(section,"reltab")||!strcmp(section,"reftab")||!strcmp(section,"symtab")){
+        unit = "entries";
+    }
+    int size = get_size(section,MODULE);
+    fprintf(OUT,"Section %s is %d %s long\n",section,size,unit);
+}
+
+///check that a section can be switched to
+///param: MODULE, sect name of the section
+///return: 0 if it can, 1 if it is not a section or not present
+int select_section(module_t* MODULE, char* sect){
+    int i = get_index(sect);
+    if(i<0){
+        fprintf(ERR,"error: '%s' is not a valid section name\n",sect);
+        return 1;
+    }
+    if(!MODULE->HEADER->data[i]){//the section doesnt exist
+        fprintf(ERR,"error: the section '%s' is not present in this module\n",sect);
+        return 1;
+    }
+    fprintf(OUT,"Now editing section %s\n",sect);
+    return 0;
+}
+
+///build the control flow graph of the text and write it out
+///param: MODULE, json 1 for JSON 0 for DOT, path of the output file, NULL for stdout
+///return: 0 on success 1 on error
+int export_cfg(module_t* MODULE, int json, char* path){
+    FILE* out = stdout;
+    cfg_t* cfg = build_cfg(MODULE);
+    if(!cfg){
+        return 1;
+    }
+    if(path&&!(out=fopen(path,"w"))){
+        fprintf(ERR,"error: could not open '%s' for writing\n",path);
+        destroy_cfg(cfg);
+        return 1;
+    }
+    write_cfg(cfg,json,out);
+    if(path){
+        fclose(out);
+        print_cfg_summary(cfg);
+    }
+    destroy_cfg(cfg);
+    return 0;
+}
+
+///add a module to the workspace and make it the current one
+///param: ws workspace, MODULE, file it is written to
+///return: the session of the module
+session_t* add_session(workspace_t* ws, module_t* MODULE, char* file){
+    ws->modules = realloc(ws->modules,(ws->count+1)*sizeof(session_t));
+    session_t* added = &ws->modules[ws->count];
+    memset(added,0,sizeof(session_t));
+    added->MODULE = MODULE;
+    added->file = strdup(file);
+    strcpy(added->section,"text");
+    ws->current = ws->count++;
+    return added;
+}
+
+///load a module into the workspace and make it the current one
+///a file that is already open is not loaded twice, the module it is open as becomes current
+///param: ws workspace, file to open
+///return: 0 on success, 1 if the module could not be loaded
+int open_session(workspace_t* ws, char* file){
+    char path[PATH_MAX], other[PATH_MAX];
+    if(realpath(file,path)){
+        for(int m=0;m<ws->count;m++){
+            if(realpath(ws->modules[m].file,other)&&!strcmp(path,other)){
+                fprintf(OUT,"%s is already open as module %d\n",file,m+1);
+                ws->current = m;
+                return 0;
+            }
+        }
+    }
+    module_t* MODULE = load_module(file);
+    if(!MODULE){
+        return 1;
+    }
+    add_session(ws,MODULE,file);
+    print_summary(MODULE->HEADER,file,MODULE->LITTLE);
     return 0;
 }
 
-///handle input 
-int run(module_t* MODULE,char* file){
-    char current_sec[10] = "text";
+///free every module in the workspace
+///param: ws workspace
+void close_workspace(workspace_t* ws){
+    for(int m=0;m<ws->count;m++){
+        destroy_module(ws->modules[m].MODULE);
+        free(ws->modules[m].file);
+    }
+    free(ws->modules);
+    ws->modules = NULL;
+    ws->count = 0;
+}
+
+///print the prompt, numbered by module once more than one is open
+///param: ws workspace, seq number of the command
+void print_prompt(workspace_t* ws, int seq){
+    session_t* s = &ws->modules[ws->current];
+    if(ws->count>1){
+        fprintf(OUT,"%d:",ws->current+1);
+    }
+    fprintf(OUT,"%s[%d] > ",s->section,seq);
+}
+
+///handle input
+int run(workspace_t* ws){
     int seq = 1;
-    char buf[128]={0};
+    char buf[COMMAND_SIZE]={0};
     char sect[32]={0};
+    char name[COMMAND_SIZE]={0};
     //history data
-    history_cmd_t* history[10] = {0};
+    history_cmd_t history[10];
     int hist_s = 0;
     //flags
     int da_flag = 0;
     int readin = 1;
-    int changed = 0;
     //
     int sequence = 0;
-    unsigned int x_command[5]={0};//array to hold the examine command
+    unsigned int new_size = 0;
+    unsigned int x_command[6]={0};//array to hold the examine command
     while(1){//get input
         da_flag = 0;
+        session_t* s = &ws->modules[ws->current];
+        module_t* MODULE = s->MODULE;
+        char* file = s->file;
+        char* current_sec = s->section;
         if(readin){
-            printf("%s[%d] > ",current_sec,seq);
-            fgets(buf,128,stdin);
+            print_prompt(ws,seq);
+            fgets(buf,COMMAND_SIZE,stdin);
         }
         readin=1;
+        uint64_t began = stats_now();
+        int stat = STAT_NONE;
         if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"quit"))){
             //quit
             char ans[256] = {0};
-            if(changed){
-                printf("Discard modifications (yes or no)?");
+            stat = STAT_QUIT;
+            int unsaved = 0;
+            for(int m=0;m<ws->count;m++){
+                if(ws->modules[m].changed&&ws->count>1){
+                    fprintf(OUT,"Module %d (%s) has unsaved changes\n",m+1,ws->modules[m].file);
+                }
+                unsaved |= ws->modules[m].changed;
+            }
+            PROBE1(quit,unsaved);
+            if(unsaved){
+                fprintf(OUT,"Discard modifications (yes or no)?");
                 fgets(ans,256,stdin);
                 char* answer = strtok(ans,"\n");
                 if(!strcmp(answer,"yes")){
-                    destroy_history(history,&hist_s);
-                    destroy_module(MODULE);
+                    close_workspace(ws);
                     exit(0);
                 }
             }
             else{
-                destroy_history(history,&hist_s);
                 return 0;
             }
         }
         else if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"size"))){
             //size
-            char* unit = "bytes";
-            if(!strcmp(current_sec,"reltab")||!strcmp(current_sec,"reftab")||!strcmp(current_sec,"symtab")){
-                unit = "entries";
-            }
-            int size = get_size(current_sec,MODULE);
-            printf("Section %s is %d %s long\n",current_sec,size,unit);
+            stat = STAT_SIZE;
+            print_size(MODULE,current_sec);
         }
         else if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"write"))){
             //write
-            if(changed){ 
-                write(MODULE,file);
-                changed = 0;
+            stat = STAT_WRITE;
+            if(s->changed){ 
+                if(!write_module(MODULE,file)){
+                    s->changed = 0;
+                }
             }
             else{
-                printf("There have been no changes: nothing to write\n");
+                fprintf(OUT,"There have been no changes: nothing to write\n");
+            }
+        }
+        else if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"compact"))){
+            //compact
+            stat = STAT_COMPACT;
+            if(compact_strings(MODULE)){
+                s->changed = 1;
+                invalidate_indexes(MODULE,EH_IX_STR,0);
             }
         }
+        else if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"validate"))){
+            //validate
+            stat = STAT_VALIDATE;
+            validate_module(MODULE,file);
+        }
         else if(strcmp(buf,"\n") && (!strcmp(strtok(buf,"\n"),"history"))){
             //history
+            stat = STAT_HISTORY;
             add_to_history(buf,seq,history,&hist_s);
             da_flag = 1;
             for(int entry=0;entry<hist_s;entry++){
-                printf("%d  %s\n",history[entry]->seqnum,history[entry]->command);
+                fprintf(OUT,"%d  %s\n",history[entry].seqnum,history[entry].command);
             }
         }
         else{//check if its the section command or the examination/modify
-            if(sscanf(buf,"section %s",sect)==1){
+            if(sscanf(buf,"section %31s",sect)==1){
                 //section
-                if(!strcmp(sect,"sbss")||!strcmp(sect,"bss")){
-                    fprintf(stderr,"error: cannot edit %s section\n",sect);
+                stat = STAT_SECTION;
+                if(!select_section(MODULE,sect)){
+                    strcpy(current_sec,sect);//select_section took it, so it is a section name
                 }
-                else{
-                    int in = 0;
-                    char* valid[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
-                    for(int i=0;i<10;i++){
-                        if(!strcmp(sect,valid[i])){
-                            if(i!=4&&i!=5){//its not bss or sbss  
-                                int size = MODULE->HEADER->data[i];
-                                if(size){
-                                    in = 1;
-                                }
-                                else{//the section doesnt exist
-                                    fprintf(stderr,"error: the section '%s' is not present in this module\n",sect);
-                                    in = 2;
-                                }
-                            }
-                        }
+            }
+            else if(sscanf(buf,"resize %31s %u",sect,&new_size)==2||sscanf(buf,"resize %u",&new_size)==1){
+                //resize
+                stat = STAT_RESIZE;
+                if(sscanf(buf,"resize %u",&new_size)==1){
+                    snprintf(sect,sizeof(sect),"%s",current_sec);
+                }
+                int sec = get_index(sect);
+                if(sec<0){
+                    fprintf(ERR,"error: '%s' is not a valid section name\n",sect);
+                }
+                else if(resize_section(MODULE,sec,new_size)){
+                    s->changed = 1;
+                    invalidate_indexes(MODULE,sec,1);
+                }
+            }
+            else if(!strncmp(buf,"run",3)&&(buf[3]=='\0'||buf[3]==' ')){
+                //run, optionally limited to a number of instructions
+                stat = STAT_RUN;
+                unsigned long long limit = 0;
+                sscanf(buf,"run %llu",&limit);
+                simulate_module(MODULE,limit);
+            }
+            else if(!strncmp(buf,"guard",5)&&(buf[5]=='\0'||buf[5]==' ')){
+                //relocation edit guard
+                stat = STAT_GUARD;
+                static char* modes[] = {"refuse","warn","off"};
+                char mode[8] = "";
+                sscanf(buf,"guard %7s",mode);
+                for(int m=0;m<3&&mode[0];m++){
+                    if(!strcmp(mode,modes[m])){
+                        MODULE->GUARD = m;
+                        mode[0] = '\0';
                     }
-                    if(in==1){
-                        printf("Now editing section %s\n",sect);
-                        strncpy(current_sec,sect,strlen(sect)+1);
+                }
+                if(mode[0]){
+                    fprintf(ERR,"error: '%s' is not a guard mode, use refuse, warn or off\n",mode);
+                }
+                else{
+                    fprintf(OUT,"Edits to relocated fields: %s\n",modes[MODULE->GUARD]);
+                }
+            }
+            else if(!strncmp(buf,"format",6)&&(buf[6]=='\0'||buf[6]==' ')){
+                //file format the module is written in
+                stat = STAT_FORMAT;
+                int version = 0;
+                if(buf[6]&&(sscanf(buf,"format %d",&version)!=1||version<1||version>2)){
+                    fprintf(ERR,"error: '%s' is not a format, use 1 or 2\n",buf+7);
+                }
+                else{
+                    uint16_t wanted = version==2?HDR_VERSION_2:HDR_VERSION_1;
+                    if(version&&ntohs(MODULE->HEADER->version)!=wanted){
+                        MODULE->HEADER->version = htons(wanted);
+                        s->changed = 1;
                     }
-                    else{
-                        if(in==0){
-                            fprintf(stderr,"error: '%s' is not a valid section name\n",sect);
-                        }
+                    int paged = ntohs(MODULE->HEADER->version)==HDR_VERSION_2;
+                    fprintf(OUT,"Module format: %d (%s)\n",paged?2:1,paged?"page aligned sections":"packed sections");
+                }
+            }
+            else if(sscanf(buf,"xref %127s",name)==1){
+                //data cross reference
+                stat = STAT_XREF;
+                print_xref(MODULE,name);
+            }
+            else if(!strncmp(buf,"cfg",3)&&(buf[3]=='\0'||buf[3]==' ')){
+                //control flow graph, as dot unless json is asked for
+                stat = STAT_CFG;
+                char format[8] = "dot";
+                char path[COMMAND_SIZE] = "";
+                sscanf(buf,"cfg %7s %127s",format,path);
+                if(strcmp(format,"dot")&&strcmp(format,"json")){
+                    fprintf(ERR,"error: '%s' is not a graph format, use dot or json\n",format);
+                }
+                else{
+                    export_cfg(MODULE,!strcmp(format,"json"),path[0]?path:NULL);
+                }
+            }
+            else if(!strcmp(buf,"cache")){
+                //save the indexes next to the module for the next time it is opened
+                stat = STAT_CACHE;
+                if(s->changed){
+                    fprintf(ERR,"error: the module has unsaved changes, write it before caching its indexes\n");
+                }
+                else if(!save_cache(MODULE,file)){
+                    fprintf(OUT,"Indexes saved to %s.lmx\n",file);
+                }
+            }
+            else if(sscanf(buf,"open %127s",name)==1){
+                //open another module in the workspace
+                stat = STAT_MODULE;
+                open_session(ws,name);
+            }
+            else if(!strcmp(buf,"modules")){
+                //list the open modules
+                stat = STAT_MODULE;
+                for(int m=0;m<ws->count;m++){
+                    fprintf(OUT,"%d  %s%s%s\n",m+1,ws->modules[m].file,ws->modules[m].changed?" (changed)":"",
+                            m==ws->current?" (current)":"");
+                }
+            }
+            else if(sscanf(buf,"module %d",&sequence)==1){
+                //switch to another open module
+                stat = STAT_MODULE;
+                if(sequence<1||sequence>ws->count){
+                    fprintf(ERR,"error: '%d' is not an open module\n",sequence);
+                }
+                else{
+                    ws->current = sequence-1;
+                    fprintf(OUT,"Now editing %s\n",ws->modules[ws->current].file);
+                }
+            }
+            else if(!strncmp(buf,"copy",4)&&(buf[4]=='\0'||buf[4]==' ')){
+                //copy bytes of the current section from an open module into this one
+                stat = STAT_COPY;
+                long long source = -1, count = -1, dest = -1;
+                int got = sscanf(buf,"copy %d %lli,%lli %lli",&sequence,&source,&count,&dest);
+                if(got==3){
+                    dest = source;
+                }
+                if(got<3||source<0||source>UINT32_MAX||count<0||count>UINT32_MAX||dest<0||dest>UINT32_MAX){
+                    fprintf(ERR,"error: use copy [module] [address],[count] to copy to the same address"
+                                " or copy [module] [address],[count] [address]\n");
+                }
+                else if(sequence<1||sequence>ws->count){
+                    fprintf(ERR,"error: '%d' is not an open module\n",sequence);
+                }
+                else if(copy_range(MODULE,ws->modules[sequence-1].MODULE,current_sec,source,count,dest)){
+                    s->changed = 1;
+                    invalidate_indexes(MODULE,get_index(current_sec),0);
+                    fprintf(OUT,"Copied %lld byte%s from module %d\n",count,count==1?"":"s",sequence);
+                }
+            }
+            else if(!strncmp(buf,"snapshot",8)&&(buf[8]=='\0'||buf[8]==' ')){
+                //remember the module as it is, pages are copied only as edits change them
+                stat = STAT_SNAPSHOT;
+                take_snapshot(MODULE,sscanf(buf,"snapshot %127s",name)==1?name:NULL);
+            }
+            else if(!strcmp(buf,"snapshots")){
+                stat = STAT_SNAPSHOT;
+                print_snapshots(MODULE);
+            }
+            else if(sscanf(buf,"restore %127s",name)==1){
+                //go back to a snapshot
+                stat = STAT_RESTORE;
+                if(!restore_snapshot(MODULE,name)){
+                    s->changed = 1;
+                }
+            }
+            else if(sscanf(buf,"branch %127s %31s",name,sect)>=1){
+                //try edits on a copy of the module, or of a snapshot of it, that writes to another file
+                stat = STAT_BRANCH;
+                char path[PATH_MAX], other[PATH_MAX];
+                int taken = -1;
+                for(int m=0;m<ws->count&&taken<0;m++){
+                    if(!strcmp(ws->modules[m].file,name)||(realpath(name,path)&&realpath(ws->modules[m].file,other)
+                                                            &&!strcmp(path,other))){
+                        taken = m;
                     }
                 }
+                module_t* BRANCH = NULL;
+                if(taken>=0){
+                    fprintf(ERR,"error: %s is open as module %d, branch to another file\n",name,taken+1);
+                }
+                else if((BRANCH = branch_module(MODULE,sscanf(buf,"branch %127s %31s",name,sect)==2?sect:NULL))){
+                    int from = ws->current+1;
+                    strcpy(sect,current_sec);//the session holding it moves as the workspace grows
+                    session_t* added = add_session(ws,BRANCH,name);
+                    added->changed = 1;
+                    strcpy(added->section,sect);
+                    fprintf(OUT,"Module %d is a branch of module %d, write saves it to %s\n",ws->count,from,name);
+                }
+            }
+            else if(!strcmp(buf,"stats")||!strcmp(buf,"stats json")){
+                //counters and timers, as a table or as JSON
+                stat = STAT_STATS;
+                if(!strcmp(buf,"stats")){
+                    print_stats();
+                }
+                else{
+                    write_stats_json(stdout);
+                }
             }
             else if(sscanf(buf,"!%d",&sequence)==1){
                 //sequennce retrieve
-                if(history[0]){
-                    int lowest = history[0]->seqnum;
-                    int highest = history[hist_s-1]->seqnum;
+                stat = STAT_RECALL;
+                if(hist_s){
+                    int lowest = history[0].seqnum;
+                    int highest = history[hist_s-1].seqnum;
                     if(sequence<lowest){
-                        fprintf(stderr,"error: command %d is no longer in the command history\n",sequence);
+                        fprintf(ERR,"error: command %d is no longer in the command history\n",sequence);
                     }
                     else if(sequence>highest){
-                        fprintf(stderr,"error: command %d has not yet been entered\n",sequence);
+                        fprintf(ERR,"error: command %d has not yet been entered\n",sequence);
                     }
                     else{
                         for(int entry=0;entry<hist_s;entry++){
-                            if(sequence==history[entry]->seqnum){
-                                printf("%s[%d] > %s\n",current_sec,seq,history[entry]->command);
-                                strncpy(buf,history[entry]->command,strlen(history[entry]->command)+1);                                
+                            if(sequence==history[entry].seqnum){
+                                print_prompt(ws,seq);
+                                fprintf(OUT,"%s\n",history[entry].command);
+                                strcpy(buf,history[entry].command);//both hold COMMAND_SIZE
                                 readin=0;
                             }
                         }
                     }
                 }
                 else{
-                    fprintf(stderr,"error: command %d has not yet been entered\n",sequence);
+                    fprintf(ERR,"error: command %d has not yet been entered\n",sequence);
+                }
+            }
+            else if(!strncmp(buf,"stats-content",13)&&(buf[13]=='\0'||buf[13]==' ')){
+                //opcode mix, entropy and zero runs of the sections
+                stat = STAT_CONTENT;
+                unsigned int min_run = 64;
+                if(buf[13]&&(sscanf(buf+13,"%u",&min_run)!=1||min_run<16)){
+                    fprintf(ERR,"error: the shortest zero run to report must be a number of at least 16 bytes\n");
+                }
+                else{
+                    print_content(MODULE,min_run);
+                }
+            }
+            else if(!strncmp(buf,"select",6)&&(buf[6]=='\0'||buf[6]==' ')){
+                //entries of a table that match every predicate
+                stat = STAT_SELECT;
+                select_entries(MODULE,buf+6);
+            }
+            else if(strstr(buf,":i=")){
+                //assemble an instruction into the word at the address
+                stat = STAT_ASSEMBLE;
+                if(!assemble_command(MODULE,buf,current_sec,x_command)&&edit_module(MODULE,x_command,current_sec)){
+                    s->changed=1;
+                    invalidate_indexes(MODULE,get_index(current_sec),0);
                 }
             }
             else{
-                if(!proccess_x_command(x_command,buf)){
+                uint64_t parsed = stats_now();
+                int bad = proccess_x_command(x_command,buf);
+                stats_record(STAT_PARSE,parsed);
+                if(!bad){
+                    stat = x_command[4]==1||x_command[4]==3?STAT_EDIT:STAT_EXAMINE;
                     if(edit_module(MODULE,x_command,current_sec)){
-                        changed=1;
+                        s->changed=1;
+                        invalidate_indexes(MODULE,get_index(current_sec),0);
                     }
                 }
             }
         }
+        if(stat!=STAT_NONE){
+            stats_record(stat,began);
+        }
         if(!da_flag&&readin==1){
             add_to_history(buf,seq,history,&hist_s);
         }
@@ -1143,188 +2254,145 @@ int run(module_t* MODULE,char* file){
     return 0;
 }
 
+///load a module file into a single arena
+///param: file to load
+///return: the module, NULL if it could not be loaded
+module_t* load_module(char* file){
+    uint64_t began = stats_now();
+    int little = 0;
+    FILE* mfp = open_module(file,&little);
+    if(!mfp){//if the file couldnt be opened or wasnt a R2K
+        return NULL;
+    }
+    //first populate header
+    exec_t header = {0};
+    header.magic = HDR_MAGIC;
+    int h = fread(&header.version,sizeof(uint16_t),1,mfp);//get next 16 bits for the version
+    int f = fread(&header.flags,sizeof(uint32_t),1,mfp);//get the flags so they can be written back
+    int e = fread(&header.entry,sizeof(uint32_t),1,mfp);//get the next 32 bits for the entry
+    int d = fread(header.data,sizeof(uint32_t),N_EH,mfp);//get the section sizes
+    if(!(h&&f&&e&&d==N_EH)){
+        fprintf(ERR,"error: %s: the header is truncated\n",file);
+        fclose(mfp);
+        return NULL;
+    }
+    if(little){//the header is kept big endian whatever the file is
+        swap_header(&header);
+    }
+    //make sure the file holds everything the header describes before allocating
+    struct stat st;
+    if(fstat(fileno(mfp),&st)){
+        fprintf(ERR,"error: %s: %s\n",file,strerror(errno));
+        fclose(mfp);
+        return NULL;
+    }
+    uint64_t offset[N_EH];
+    if(read_layout(fileno(mfp),file,&header,little,st.st_size,offset)){
+        fclose(mfp);
+        return NULL;
+    }
+    stats_record(STAT_LOAD_HEADER,began);
+    stats_io(HEADER_SIZE,0);
+    PROBE2(module__open,file,st.st_size);
+    began = stats_now();
+    module_t* MODULE = create_module(&header);
+    stats_record(STAT_LOAD_ARENA,began);
+    if(!MODULE){
+        fprintf(ERR,"error: not enough memory to load %s\n",file);
+        fclose(mfp);
+        return NULL;
+    }
+    MODULE->LENGTH = st.st_size;
+    MODULE->LITTLE = little;
+    MODULE->PATH = strdup(file);
+    MODULE->FD = dup(fileno(mfp));
+    fclose(mfp);
+    if(MODULE->FD<0){
+        fprintf(ERR,"error: %s: %s\n",file,strerror(errno));
+        destroy_module(MODULE);
+        return NULL;
+    }
+    //only note where each section is, load_sections reads or maps them when they are first used
+    //the zeros of SBSS and BSS are never read, the tables are laid out in the file as they are in memory
+    memcpy(MODULE->OFFSET,offset,sizeof(offset));
+    for(int sec=0;sec<N_EH;sec++){
+        if(ntohl(MODULE->HEADER->data[sec])&&sec!=EH_IX_SBSS&&sec!=EH_IX_BSS){
+            MODULE->LOADED &= ~SECTION_BIT(sec);
+        }
+    }
+    PROBE2(module__loaded,file,MODULE->LENGTH);
+    return MODULE;
+}
+
 int main(int argc, char* argv[]){
-    if(argc!=2){
-        fprintf(stderr,"usage: lmedit file\n");
+    if(argc>=3&&!strcmp(argv[1],"--daemon")){
+        if(getenv("LMEDIT_STATS")){
+            atexit(dump_stats);
+        }
+        return serve_modules(argv[2],&argv[3],argc-3);
+    }
+    if(argc>=3&&!strcmp(argv[1],"--summary")){
+        return scan_modules(&argv[2],argc-2)?EXIT_FAILURE:EXIT_SUCCESS;
+    }
+    if(argc==4&&(!strcmp(argv[1],"--to-elf")||!strcmp(argv[1],"--from-elf"))){
+        int failed = !strcmp(argv[1],"--to-elf")?module_to_elf(argv[2],argv[3]):elf_to_module(argv[2],argv[3]);
+        return failed?EXIT_FAILURE:EXIT_SUCCESS;
+    }
+    int validate = argc==3&&!strcmp(argv[1],"--validate");
+    int simulate = argc==3&&!strcmp(argv[1],"--run");
+    int graph = argc==3&&(!strcmp(argv[1],"--cfg-dot")||!strcmp(argv[1],"--cfg-json"));
+    int stream = argc==3&&!strcmp(argv[1],"--stream");
+    int edit = argc>=2&&argv[1][0]!='-';
+    if(!edit&&!validate&&!simulate&&!graph&&!stream){
+        fprintf(ERR,"usage: lmedit file...\n"
+                       "       lmedit --validate|--run|--cfg-dot|--cfg-json|--stream file\n"
+                       "       lmedit --to-elf file elf | --from-elf elf file\n"
+                       "       lmedit --daemon socket [file...]\n"
+                       "       lmedit --summary dir|file...\n");
         return 1;
     }
     else{
-        //data
-        module_t* MODULE = calloc(1,sizeof(module_t));
-        exec_t* header = calloc(1,sizeof(exec_t));
-        
-        //
-        FILE* mfp = open_module(argv[1]);
-        if(!mfp){//if the file couldnt be opened or wasnt a R2K
-            exit(EXIT_FAILURE);
-        }
-        else{
-            header->magic = HDR_MAGIC;
-        }
-        //begin load module into memory
-        //first populate header
-        fread(&(header->version),sizeof(uint16_t),1,mfp);//get next 16 bits for the version;
-        fseek(mfp,4,SEEK_CUR);//skip ahead 4 bytes
-        fread(&(header->entry),sizeof(uint32_t),1,mfp);//get the next 32 bits for the entry
-        //get the section sizes
-        for(int section=0;section<N_EH;section++){
-            if(!fread(&((header->data)[section]),sizeof(uint32_t),1,mfp)){//read in the section size
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }
-        //store the header in the MODULE
-        MODULE->HEADER = header;
-        //gather the TEXT, RDATA, DATA, SDATA, SBSS, and BSS and store in MODULE
-        //TEXT
-        if((header->data)[EH_IX_TEXT]!=0){
-            MODULE->TEXT = calloc(1,ntohl((header->data)[EH_IX_TEXT]));
-            if(!fread((MODULE->TEXT),ntohl((header->data)[EH_IX_TEXT]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }
-        else{
-            MODULE->TEXT = NULL;
-        }
-        //RDATA
-        if((header->data)[EH_IX_RDATA]!=0){
-            MODULE->RDATA = calloc(1,ntohl((header->data)[EH_IX_RDATA]));
-            if(!fread((MODULE->RDATA),ntohl((header->data)[EH_IX_RDATA]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }
-        else{
-            MODULE->RDATA = NULL;
-        }
-        //DATA
-        if((header->data)[EH_IX_DATA]!=0){
-            MODULE->DATA = calloc(1,ntohl((header->data)[EH_IX_DATA]));
-            if(!fread((MODULE->DATA),ntohl((header->data)[EH_IX_DATA]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }   
-        else{
-            MODULE->DATA = NULL;
-        }
-        //SDATA
-        if((header->data)[EH_IX_SDATA]!=0){
-            MODULE->SDATA = calloc(1,ntohl((header->data)[EH_IX_SDATA]));
-            if(!fread((MODULE->SDATA),ntohl((header->data)[EH_IX_SDATA]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }   
-        else{
-            MODULE->SDATA = NULL;
-        }
-        //SBSS
-        if((header->data)[EH_IX_SBSS]!=0){
-            MODULE->SBSS = calloc(1,ntohl((header->data)[EH_IX_SBSS]));
-            if(!fread((MODULE->SBSS),ntohl((header->data)[EH_IX_SBSS]),1,mfp)){
-               perror(argv[1]);
-               destroy_module(MODULE);
-               exit(EXIT_FAILURE);
-            }
-        }   
-        else{
-            MODULE->SBSS = NULL;
-        }
-        //BSS
-        if((header->data)[EH_IX_BSS]!=0){
-            MODULE->BSS = calloc(1,ntohl((header->data)[EH_IX_BSS]));
-            if(!fread((MODULE->BSS),ntohl((header->data)[EH_IX_BSS]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
-        }   
-        else{
-            MODULE->BSS = NULL;
-        }
-        //gather tables
-        //allocate memory
-        if((header->data)[EH_IX_REL]!=0){
-            MODULE->RELTAB = calloc(ntohl((header->data)[EH_IX_REL]),sizeof(relent_t));
-            for(unsigned int entry=0;entry<ntohl((header->data)[EH_IX_REL]);entry++){
-                int a = fread(&(((MODULE->RELTAB)[entry]).addr),sizeof(uint32_t),1,mfp);
-                int s = fread(&(((MODULE->RELTAB)[entry]).section),sizeof(uint8_t),1,mfp);
-                int t = fread(&(((MODULE->RELTAB)[entry]).type),sizeof(uint8_t),1,mfp);
-                if(!(a&&s&&t)){
-                    perror(argv[1]);
-                    destroy_module(MODULE);
+        char* file = argv[argc-1];
+        if(getenv("LMEDIT_STATS")){
+            atexit(dump_stats);
+        }
+        if(stream){
+            return stream_module(file)?EXIT_FAILURE:EXIT_SUCCESS;
+        }
+        if(edit){
+            //open every module named, printing the summary of each, then begin the command loop in the first
+            workspace_t ws = {0};
+            for(int f=1;f<argc;f++){
+                if(open_session(&ws,argv[f])){
+                    close_workspace(&ws);
                     exit(EXIT_FAILURE);
                 }
-                fseek(mfp,2,SEEK_CUR);
             }
+            ws.current = 0;
+            run(&ws);
+
+            //cleanup
+            close_workspace(&ws);
+            return 0;
         }
-        else{
-            MODULE->RELTAB = NULL;
-        }
-        if((header->data)[EH_IX_REF]!=0){
-            MODULE->REFTAB = calloc(ntohl((header->data)[EH_IX_REF]),sizeof(refent_t));
-            for(unsigned int entry=0;entry<ntohl((header->data)[EH_IX_REF]);entry++){
-                
-                int a = fread(&(((MODULE->REFTAB)[entry]).addr),sizeof(uint32_t),1,mfp);
-                int s = fread(&(((MODULE->REFTAB)[entry]).sym),sizeof(uint32_t),1,mfp);
-                fseek(mfp,1,SEEK_CUR);
-                int e = fread(&(((MODULE->REFTAB)[entry]).section),sizeof(uint8_t),1,mfp);
-                if(!(a&&s&&e)){
-                    perror(argv[1]);
-                    destroy_module(MODULE);
-                    exit(EXIT_FAILURE);
-                }
-                fseek(mfp,2,SEEK_CUR);
-            }
+        module_t* MODULE = load_module(file);
+        if(!MODULE){
+            exit(EXIT_FAILURE);
         }
-        else{
-            MODULE->REFTAB = NULL;
-        }
-        if((header->data)[EH_IX_SYM]!=0){
-            MODULE->SYMTAB = calloc(ntohl((header->data)[EH_IX_SYM]),sizeof(syment_t));
-            for(unsigned int entry=0;entry<ntohl((header->data)[EH_IX_SYM]);entry++){
-                int f = fread(&(((MODULE->SYMTAB)[entry]).flags),sizeof(uint32_t),1,mfp);
-                int v = fread(&(((MODULE->SYMTAB)[entry]).value),sizeof(uint32_t),1,mfp);
-                int s = fread(&(((MODULE->SYMTAB)[entry]).sym),sizeof(uint32_t),1,mfp);
-                if(!(f&&v&&s)){
-                    perror(argv[1]);
-                    destroy_module(MODULE);
-                    exit(EXIT_FAILURE);
-                }
-            }
+        if(validate){
+            unsigned int errors = validate_module(MODULE,file);
+            destroy_module(MODULE);
+            return errors?EXIT_FAILURE:EXIT_SUCCESS;
         }
-        else{
-            MODULE->SYMTAB = NULL;
-        }
-        //read in the text
-        if((header->data)[EH_IX_STR]!=0){
-            MODULE->STRINGS = calloc(1,ntohl((header->data)[EH_IX_STR]));
-            if(!fread((MODULE->STRINGS),ntohl((header->data)[EH_IX_STR]),1,mfp)){
-                perror(argv[1]);
-                destroy_module(MODULE);
-                exit(EXIT_FAILURE);
-            }
+        if(simulate){
+            int status = simulate_module(MODULE,0);
+            destroy_module(MODULE);
+            return status<0?EXIT_FAILURE:status;
         }
-        else{
-            MODULE->STRINGS = NULL;
+        if(graph){
+            int failed = export_cfg(MODULE,!strcmp(argv[1],"--cfg-json"),NULL);
+            destroy_module(MODULE);
+            return failed?EXIT_FAILURE:EXIT_SUCCESS;
         }
-        //finished loading in module
-        fflush(mfp);
-        fclose(mfp);
-        
-        //print the summary
-        print_summary(header,argv[1]);
-        //begin command loop
-        run(MODULE,argv[1]);
-
-        //cleanup
-        destroy_module(MODULE);
     }
 }
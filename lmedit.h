@@ -0,0 +1,223 @@
+///author: jmp1617
+///purpose: definitions shared by the parts of the l2k module editor
+#ifndef _LMEDIT_H
+#define _LMEDIT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <endian.h>
+#include <pthread.h>
+#include "exec.h"
+
+///size of the header and table entries as they are laid out in the file
+#define HEADER_SIZE 52
+#define RELENT_SIZE 8
+#define REFENT_SIZE 12
+#define SYMENT_SIZE 12
+///version 2 modules: the table of section offsets after the header, and the boundary each section starts on
+#define LAYOUT_SIZE (N_EH*4)
+#define MODULE_PAGE 4096
+///longest command that can be entered
+#define COMMAND_SIZE 128
+
+typedef struct xref xref_t;
+typedef struct reloc_index reloc_index_t;
+typedef struct symindex symindex_t;
+typedef struct snapshot snapshot_t;
+typedef struct columns columns_t;
+
+///masks of sections, for loading them
+#define SECTION_BIT(sec) (1u<<(sec))
+#define ALL_SECTIONS ((1u<<N_EH)-1)
+#define TABLE_SECTIONS (SECTION_BIT(EH_IX_REL)|SECTION_BIT(EH_IX_REF)|SECTION_BIT(EH_IX_SYM)|SECTION_BIT(EH_IX_STR))
+
+///a word of a section in host order, the sections of a module stay in its own byte order
+#define SECTION_WORD(little,word) ((little)?le32toh(word):be32toh(word))
+
+///loads and stores of one width in one byte order, chosen once per command with get_access
+typedef struct access{
+    uint32_t width;
+    char type;
+    uint64_t max;//largest value a unit holds
+    uint64_t (*load)(const uint8_t* at);
+    void (*fill)(uint8_t* at, uint64_t value, uint32_t count);
+    void (*gather)(const uint8_t* at, uint64_t* values, uint32_t count);
+}access_t;
+
+///what to do when an edit touches a field the reltab or reftab fixes up
+#define GUARD_REFUSE 0
+#define GUARD_WARN 1
+#define GUARD_OFF 2
+
+///commands and stages timed by stats.c, STAT_NONE is a line that dispatched no command and is not recorded
+enum stat_id{
+    STAT_NONE=-1,STAT_QUIT,STAT_SIZE,STAT_WRITE,STAT_COMPACT,STAT_VALIDATE,STAT_HISTORY,STAT_SECTION,STAT_RESIZE,STAT_RUN,STAT_CFG,
+    STAT_XREF,STAT_GUARD,STAT_FORMAT,STAT_STATS,STAT_CACHE,STAT_MODULE,STAT_COPY,STAT_SNAPSHOT,STAT_RESTORE,
+    STAT_BRANCH,STAT_RECALL,STAT_EXAMINE,STAT_EDIT,STAT_ASSEMBLE,STAT_SELECT,STAT_CONTENT,STAT_PARSE,STAT_CHECK,
+    STAT_LOAD_HEADER,STAT_LOAD_ARENA,STAT_LOAD_SECTIONS,STAT_LOAD_INDEX,STAT_SERIALIZE,STAT_WRITE_FILE,
+    N_STATS
+};
+
+///where commands print: stdout and stderr, or the connection of a daemon client
+extern __thread FILE* client_out;
+#define OUT (client_out?client_out:stdout)
+#define ERR (client_out?client_out:stderr)
+
+///struct to represent entire module in memory
+///the header and tables are kept in big endian byte order, little endian modules are swapped as they are read
+typedef struct module{
+    exec_t* HEADER;
+    uint8_t* TEXT;
+    uint8_t* RDATA;
+    uint8_t* DATA;
+    uint8_t* SDATA;
+    uint8_t* SBSS;
+    uint8_t* BSS;
+    relent_t* RELTAB;
+    refent_t* REFTAB;
+    syment_t* SYMTAB;
+    uint8_t* STRINGS;
+    uint64_t LENGTH;//length of the module file in bytes
+    uint8_t* ARENA;//single allocation holding this struct, the header and every section
+    size_t ARENA_SIZE;
+    xref_t* XREF;//data cross reference index, built by the first xref
+    reloc_index_t* RELOCS;//fields fixed up by the reltab and reftab, for the edit guard
+    int GUARD;//GUARD_REFUSE, GUARD_WARN or GUARD_OFF
+    symindex_t* SYMBOLS;//symtab by name and by value, built on first use
+    columns_t* COLUMNS[3];//reltab, reftab and symtab split into host order columns, built by the first select
+    uint8_t* CACHE;//mapping of the sidecar the indexes were adopted from
+    size_t CACHE_SIZE;
+    int INDEXED;//1 once the sidecar has been tried
+    char* PATH;//file the module was loaded from
+    int FD;//open on the file, sections are read from it the first time they are needed
+    uint64_t OFFSET[N_EH];//where each section starts in the file
+    uint32_t LOADED;//SECTION_BIT of every section in memory
+    uint32_t MAPPED;//SECTION_BIT of every section mapped from the file rather than read
+    pthread_mutex_t LOAD_LOCK;
+    snapshot_t** SNAPSHOTS;//oldest first, the newest saves the pages edits overwrite
+    int NSNAPSHOTS;
+    int LITTLE;//1 if the file is little endian, its sections are kept in that order
+}module_t;
+
+///lmedit.c
+module_t* load_module(char* file);
+module_t* create_module(exec_t* header);
+void destroy_module(module_t* MODULE);
+int load_sections(module_t* MODULE, uint32_t mask);
+void load_indexes(module_t* MODULE);
+int write_module(module_t* MODULE, char* filename);
+int open_replacement(char* file, char target[PATH_MAX], char tmpname[PATH_MAX+4]);
+int close_replacement(int fd, char* target, char* tmpname, int failed);
+int proccess_x_command(unsigned int command[6],char* buf);
+int edit_module(module_t* MODULE, unsigned int commands[6],char* section);
+int check_for_errors(unsigned int commands[6],char* section, module_t* MODULE);
+uint64_t module_length(exec_t* header);
+uint64_t module_layout(exec_t* header, uint64_t offset[N_EH]);
+int read_layout(int fd, char* file, exec_t* header, int little, uint64_t length, uint64_t offset[N_EH]);
+void invalidate_indexes(module_t* MODULE, int sec, int resized);
+int select_section(module_t* MODULE, char* sect);
+void print_size(module_t* MODULE, char* section);
+int get_index(char* section);
+int get_size(char* section, module_t* MODULE);
+unsigned int get_start(module_t* MODULE, char* section);
+void** get_section(module_t* MODULE, int sec);
+void release_section(module_t* MODULE, int sec);
+uint8_t* map_zero(size_t size);
+size_t get_unit(int sec);
+char* get_string(module_t* MODULE, uint32_t index);
+void print_rel_tab(unsigned int address,int count,relent_t* reltab);
+void print_ref_tab(unsigned int address,int count,refent_t* reftab,module_t* MODULE);
+void print_sym_tab(unsigned int address,int count,syment_t* symtab,module_t* MODULE);
+uint32_t hash_string(char* str, uint32_t len);
+
+///r2ksim.c
+int simulate_module(module_t* MODULE, uint64_t limit);
+
+///cfg.c
+typedef struct cfg cfg_t;
+cfg_t* build_cfg(module_t* MODULE);
+void write_cfg(cfg_t* cfg, int json, FILE* out);
+void print_cfg_summary(cfg_t* cfg);
+void destroy_cfg(cfg_t* cfg);
+
+///xref.c
+xref_t* build_xref(module_t* MODULE);
+int print_xref(module_t* MODULE, char* target);
+void destroy_xref(xref_t* xref);
+
+///reloc.c
+reloc_index_t* build_reloc_index(module_t* MODULE);
+uint32_t find_relocs(reloc_index_t* index, int sec, uint32_t offset, uint32_t length, char describe[64]);
+size_t reloc_spans(reloc_index_t* index, int sec, void** spans);
+reloc_index_t* adopt_reloc_index(void* spans[EH_IX_BSS+1], uint64_t bytes[EH_IX_BSS+1]);
+void destroy_reloc_index(reloc_index_t* index);
+
+///symbols.c
+symindex_t* build_symindex(module_t* MODULE);
+symindex_t* adopt_symindex(uint32_t nsyms, uint32_t* by_value, uint32_t nbuckets, uint32_t* buckets);
+uint32_t symindex_arrays(symindex_t* index, uint32_t** by_value, uint32_t* nbuckets, uint32_t** buckets);
+int64_t find_symbol(module_t* MODULE, char* name);
+uint32_t* symbols_by_value(module_t* MODULE, uint32_t* nsyms);
+void destroy_symindex(symindex_t* index);
+
+///cache.c
+struct stat;
+int has_cache(char* file);
+int load_cache(module_t* MODULE, char* file, struct stat* st);
+int check_cache(module_t* MODULE, char* file);
+int save_cache(module_t* MODULE, char* file);
+void release_cache(module_t* MODULE);
+
+///snapshot.c
+int find_snapshot(module_t* MODULE, char* name);
+int take_snapshot(module_t* MODULE, char* name);
+void snapshot_touch(module_t* MODULE, int sec, uint64_t offset, uint64_t bytes);
+void snapshot_whole(module_t* MODULE, int sec);
+int restore_snapshot(module_t* MODULE, char* name);
+module_t* branch_module(module_t* MODULE, char* name);
+void print_snapshots(module_t* MODULE);
+void destroy_snapshots(module_t* MODULE);
+
+///asm.c
+int assemble(module_t* MODULE, uint32_t address, char* text, uint32_t* word, int* relative);
+int assemble_command(module_t* MODULE, char* buf, char* section, unsigned int commands[6]);
+const char* instruction_name(uint32_t word);
+
+///access.c
+const access_t* get_access(char type, int little);
+uint32_t type_width(char type);
+void swap_header(exec_t* header);
+void swap_entries(void* entries, int sec, uint32_t count);
+
+///content.c
+int print_content(module_t* MODULE, uint32_t min_run);
+
+///select.c
+int select_entries(module_t* MODULE, char* args);
+void destroy_columns(columns_t* columns);
+
+///elf.c
+int module_to_elf(char* file, char* elf);
+int elf_to_module(char* elf, char* file);
+
+///stream.c
+int stream_module(char* file);
+
+///scan.c
+int scan_modules(char** paths, int npaths);
+
+///daemon.c
+int serve_modules(char* socket_path, char** files, int nfiles);
+
+///stats.c
+uint64_t stats_now(void);
+void stats_record(int stat, uint64_t began);
+void stats_io(uint64_t read, uint64_t written);
+void stats_alloc(uint64_t bytes);
+void print_stats(void);
+void write_stats_json(FILE* out);
+void dump_stats(void);
+
+#endif
@@ -0,0 +1,27 @@
+///author: jmp1617
+///purpose: static tracepoints for perf and bpftrace
+///the probes are USDT notes from sys/sdt.h and compile to nothing without it (or with -DLMEDIT_NO_PROBES)
+///    bpftrace -e 'usdt:./lmedit:lmedit:edit__return { @bytes[str(arg0)] = sum(arg3); }'
+#ifndef _PROBES_H
+#define _PROBES_H
+
+#if !defined(LMEDIT_NO_PROBES)&&defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LMEDIT_PROBES 1
+#endif
+#endif
+
+#ifdef LMEDIT_PROBES
+#define PROBE1(name,a) DTRACE_PROBE1(lmedit,name,a)
+#define PROBE2(name,a,b) DTRACE_PROBE2(lmedit,name,a,b)
+#define PROBE3(name,a,b,c) DTRACE_PROBE3(lmedit,name,a,b,c)
+#define PROBE4(name,a,b,c,d) DTRACE_PROBE4(lmedit,name,a,b,c,d)
+#else
+#define PROBE1(name,a) ((void)(a))
+#define PROBE2(name,a,b) ((void)(a),(void)(b))
+#define PROBE3(name,a,b,c) ((void)(a),(void)(b),(void)(c))
+#define PROBE4(name,a,b,c,d) ((void)(a),(void)(b),(void)(c),(void)(d))
+#endif
+
+#endif
@@ -0,0 +1,560 @@
+///author: jmp1617
+///purpose: R2000 instruction set simulator for load modules
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///simulated memory is 4KB pages in a two level table
+#define SIM_PAGE_BITS 12
+#define SIM_PAGE_SIZE (1u<<SIM_PAGE_BITS)
+#define SIM_L2_BITS 10
+#define SIM_L1_SIZE (1u<<(32-SIM_PAGE_BITS-SIM_L2_BITS))
+#define SIM_L2_SIZE (1u<<SIM_L2_BITS)
+
+///registers with a fixed use
+#define REG_V0 2
+#define REG_A0 4
+#define REG_A1 5
+#define REG_GP 28
+#define REG_SP 29
+#define REG_RA 31
+
+///predecoded operations, one per R2000 instruction
+enum sim_op{
+    OP_RESERVED,
+    OP_SLL, OP_SRL, OP_SRA, OP_SLLV, OP_SRLV, OP_SRAV,
+    OP_JR, OP_JALR, OP_SYSCALL, OP_BREAK,
+    OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO,
+    OP_MULT, OP_MULTU, OP_DIV, OP_DIVU,
+    OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_NOR, OP_SLT, OP_SLTU,
+    OP_BLTZ, OP_BGEZ, OP_BLTZAL, OP_BGEZAL,
+    OP_J, OP_JAL, OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ,
+    OP_ADDI, OP_ADDIU, OP_SLTI, OP_SLTIU, OP_ANDI, OP_ORI, OP_XORI, OP_LUI,
+    OP_LB, OP_LH, OP_LWL, OP_LW, OP_LBU, OP_LHU, OP_LWR,
+    OP_SB, OP_SH, OP_SWL, OP_SW, OP_SWR
+};
+
+///struct to hold one predecoded instruction
+typedef struct sim_insn{
+    uint8_t op;
+    uint8_t rs;
+    uint8_t rt;
+    uint8_t rd;
+    uint32_t imm;//sign or zero extended immediate, shift amount, branch offset or jump target
+}sim_insn_t;
+
+///struct to hold the state of a simulated program
+typedef struct sim{
+    uint32_t reg[32];
+    uint32_t hi;
+    uint32_t lo;
+    uint32_t pc;
+    uint32_t npc;//next pc, differs from pc+4 in a branch delay slot
+    uint32_t cur;//address of the instruction being executed
+    uint8_t** pages[SIM_L1_SIZE];
+    sim_insn_t* icache;
+    uint32_t ninsns;
+    uint32_t text_end;
+    uint32_t brk;//current end of the heap
+    uint64_t count;
+    int running;
+    int status;//exit status of the program
+    char fault[128];//why the program was stopped, empty if it exited
+}sim_t;
+
+///page every unwritten address reads from
+static const uint8_t zero_page[SIM_PAGE_SIZE];
+
+///stop the simulation with a fault
+///param: sim, format and arguments of the message
+static void sim_fault(sim_t* sim, const char* format, ...){
+    va_list args;
+    va_start(args,format);
+    vsnprintf(sim->fault,sizeof(sim->fault),format,args);
+    va_end(args);
+    sim->running = 0;
+}
+
+///get the page holding an address, creating it for writes
+///param: sim, addr to look up, write 1 if the page will be written
+///return: the page, the shared zero page for unwritten reads, NULL if out of memory
+static uint8_t* sim_page(sim_t* sim, uint32_t addr, int write){
+    uint8_t** l2 = sim->pages[addr>>(SIM_PAGE_BITS+SIM_L2_BITS)];
+    uint32_t index = (addr>>SIM_PAGE_BITS)&(SIM_L2_SIZE-1);
+    if(!l2||!l2[index]){
+        if(!write){
+            return (uint8_t*)zero_page;
+        }
+        if(!l2){
+            l2 = calloc(SIM_L2_SIZE,sizeof(uint8_t*));
+            if(!l2){
+                return NULL;
+            }
+            sim->pages[addr>>(SIM_PAGE_BITS+SIM_L2_BITS)] = l2;
+        }
+        l2[index] = calloc(1,SIM_PAGE_SIZE);
+    }
+    return l2[index];
+}
+
+///check that an access is aligned and in a part of memory the program may use
+///param: sim, addr of the access, size in bytes, write 1 for stores
+///return: 1 if the access may go ahead
+static int sim_check(sim_t* sim, uint32_t addr, uint32_t size, int write){
+    if(addr&(size-1)){
+        sim_fault(sim,"unaligned %u byte access to %#010x",size,addr);
+        return 0;
+    }
+    if(addr>=TEXT_BEGIN&&addr<sim->text_end){
+        if(write){
+            sim_fault(sim,"store to text at %#010x (pc %#010x)",addr,sim->cur);
+            return 0;
+        }
+        return 1;
+    }
+    if(addr<DATA_BEGIN||addr>STACK_END){
+        sim_fault(sim,"address error at %#010x (pc %#010x)",addr,sim->cur);
+        return 0;
+    }
+    return 1;
+}
+
+///read a big endian value from simulated memory
+///param: sim, addr, size 1, 2 or 4
+///return: the value, 0 after a fault
+static uint32_t sim_load(sim_t* sim, uint32_t addr, uint32_t size){
+    if(!sim_check(sim,addr,size,0)){
+        return 0;
+    }
+    uint8_t* p = sim_page(sim,addr,0)+(addr&(SIM_PAGE_SIZE-1));
+    switch(size){
+        case 1: return p[0];
+        case 2: return (p[0]<<8)|p[1];
+        default: return ((uint32_t)p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3];
+    }
+}
+
+///write a big endian value to simulated memory
+///param: sim, addr, size 1, 2 or 4, value
+static void sim_store(sim_t* sim, uint32_t addr, uint32_t size, uint32_t value){
+    if(!sim_check(sim,addr,size,1)){
+        return;
+    }
+    uint8_t* page = sim_page(sim,addr,1);
+    if(!page){
+        sim_fault(sim,"out of memory for the page at %#010x",addr);
+        return;
+    }
+    uint8_t* p = page+(addr&(SIM_PAGE_SIZE-1));
+    for(int byte=size-1;byte>=0;byte--){
+        p[byte] = value&0xff;
+        value >>= 8;
+    }
+}
+
+///copy a section of the module into simulated memory
+///param: sim, start address, data, size in bytes
+///return: 0 on success, 1 if out of memory
+static int sim_seed(sim_t* sim, uint32_t start, uint8_t* data, uint32_t size){
+    for(uint32_t byte=0;byte<size;){
+        uint32_t addr = start+byte;
+        uint32_t offset = addr&(SIM_PAGE_SIZE-1);
+        uint32_t chunk = SIM_PAGE_SIZE-offset;
+        if(chunk>size-byte){
+            chunk = size-byte;
+        }
+        uint8_t* page = sim_page(sim,addr,1);
+        if(!page){
+            return 1;
+        }
+        memcpy(page+offset,data+byte,chunk);
+        byte += chunk;
+    }
+    return 0;
+}
+
+///decode one instruction word
+///param: word the instruction
+///return: the predecoded instruction
+static sim_insn_t sim_decode(uint32_t word){
+    static const uint8_t special[64] = {
+        [0]=OP_SLL,[2]=OP_SRL,[3]=OP_SRA,[4]=OP_SLLV,[6]=OP_SRLV,[7]=OP_SRAV,
+        [8]=OP_JR,[9]=OP_JALR,[12]=OP_SYSCALL,[13]=OP_BREAK,
+        [16]=OP_MFHI,[17]=OP_MTHI,[18]=OP_MFLO,[19]=OP_MTLO,
+        [24]=OP_MULT,[25]=OP_MULTU,[26]=OP_DIV,[27]=OP_DIVU,
+        [32]=OP_ADD,[33]=OP_ADDU,[34]=OP_SUB,[35]=OP_SUBU,
+        [36]=OP_AND,[37]=OP_OR,[38]=OP_XOR,[39]=OP_NOR,[42]=OP_SLT,[43]=OP_SLTU
+    };
+    static const uint8_t opcode[64] = {
+        [2]=OP_J,[3]=OP_JAL,[4]=OP_BEQ,[5]=OP_BNE,[6]=OP_BLEZ,[7]=OP_BGTZ,
+        [8]=OP_ADDI,[9]=OP_ADDIU,[10]=OP_SLTI,[11]=OP_SLTIU,
+        [12]=OP_ANDI,[13]=OP_ORI,[14]=OP_XORI,[15]=OP_LUI,
+        [32]=OP_LB,[33]=OP_LH,[34]=OP_LWL,[35]=OP_LW,[36]=OP_LBU,[37]=OP_LHU,[38]=OP_LWR,
+        [40]=OP_SB,[41]=OP_SH,[42]=OP_SWL,[43]=OP_SW,[46]=OP_SWR
+    };
+    sim_insn_t in;
+    uint32_t op = word>>26;
+    in.rs = (word>>21)&0x1f;
+    in.rt = (word>>16)&0x1f;
+    in.rd = (word>>11)&0x1f;
+    in.imm = (uint32_t)(int32_t)(int16_t)(word&0xffff);
+    if(op==0){
+        in.op = special[word&0x3f];
+        in.imm = (word>>6)&0x1f;//shift amount
+    }
+    else if(op==1){//regimm branches
+        switch(in.rt){
+            case 0: in.op = OP_BLTZ; break;
+            case 1: in.op = OP_BGEZ; break;
+            case 16: in.op = OP_BLTZAL; break;
+            case 17: in.op = OP_BGEZAL; break;
+            default: in.op = OP_RESERVED; break;
+        }
+        in.imm <<= 2;
+    }
+    else{
+        in.op = opcode[op];
+        switch(in.op){
+            case OP_J:
+            case OP_JAL:
+                in.imm = (word&0x03ffffff)<<2;
+                break;
+            case OP_BEQ:
+            case OP_BNE:
+            case OP_BLEZ:
+            case OP_BGTZ:
+                in.imm <<= 2;
+                break;
+            case OP_ANDI:
+            case OP_ORI:
+            case OP_XORI:
+            case OP_LUI:
+                in.imm = word&0xffff;//zero extended
+                break;
+        }
+    }
+    return in;
+}
+
+///read a NUL terminated string out of simulated memory
+///param: sim, addr of the string, out to write it to
+static void sim_print_string(sim_t* sim, uint32_t addr, FILE* out){
+    for(;;){
+        uint32_t c = sim_load(sim,addr++,1);
+        if(!c||!sim->running){
+            break;
+        }
+        fputc(c,out);
+    }
+}
+
+///perform the syscall selected by $v0 (SPIM numbering)
+///param: sim
+static void sim_syscall(sim_t* sim){
+    uint32_t* reg = sim->reg;
+    char line[256];
+    switch(reg[REG_V0]){
+        case 1://print_int
+            printf("%d",(int32_t)reg[REG_A0]);
+            break;
+        case 4://print_string
+            sim_print_string(sim,reg[REG_A0],stdout);
+            break;
+        case 5://read_int
+            reg[REG_V0] = fgets(line,sizeof(line),stdin)?(uint32_t)strtol(line,NULL,0):0;
+            break;
+        case 8://read_string
+            if(reg[REG_A1]>0&&fgets(line,sizeof(line)<reg[REG_A1]?sizeof(line):reg[REG_A1],stdin)){
+                for(uint32_t c=0;c<=strlen(line)&&sim->running;c++){
+                    sim_store(sim,reg[REG_A0]+c,1,(uint8_t)line[c]);
+                }
+            }
+            break;
+        case 9://sbrk
+            if(sim->brk+reg[REG_A0]<sim->brk||sim->brk+reg[REG_A0]>STACK_BEGIN){
+                sim_fault(sim,"sbrk of %u bytes runs into the stack",reg[REG_A0]);
+            }
+            else{
+                uint32_t old = sim->brk;
+                sim->brk = (sim->brk+reg[REG_A0]+7)&~7u;
+                reg[REG_V0] = old;
+            }
+            break;
+        case 10://exit
+            sim->status = 0;
+            sim->running = 0;
+            break;
+        case 11://print_char
+            putchar(reg[REG_A0]&0xff);
+            break;
+        case 12://read_char
+            reg[REG_V0] = getchar();
+            break;
+        case 17://exit2
+            sim->status = (int32_t)reg[REG_A0];
+            sim->running = 0;
+            break;
+        default:
+            sim_fault(sim,"unsupported syscall %u at %#010x",reg[REG_V0],sim->cur);
+            break;
+    }
+}
+
+///execute instructions until the program exits, faults or reaches the limit
+///param: sim, limit on instructions executed, 0 for none
+static void sim_execute(sim_t* sim, uint64_t limit){
+    uint32_t* reg = sim->reg;
+    while(sim->running){
+        if(limit&&sim->count>=limit){
+            sim_fault(sim,"stopped after %llu instructions at %#010x",(unsigned long long)limit,sim->pc);
+            break;
+        }
+        uint32_t pc = sim->pc;
+        if(pc==0x0){//returned from the entry point
+            sim->status = (int32_t)reg[REG_V0];
+            break;
+        }
+        uint32_t index = (pc-TEXT_BEGIN)>>2;
+        if((pc&3)||index>=sim->ninsns||pc<TEXT_BEGIN){
+            sim_fault(sim,"pc %#010x is outside of the text section",pc);
+            break;
+        }
+        sim_insn_t in = sim->icache[index];
+        sim->cur = pc;
+        uint32_t s = reg[in.rs], t = reg[in.rt];
+        sim->pc = sim->npc;
+        sim->npc += 4;
+        switch(in.op){
+            case OP_SLL: reg[in.rd] = t<<in.imm; break;
+            case OP_SRL: reg[in.rd] = t>>in.imm; break;
+            case OP_SRA: reg[in.rd] = (int32_t)t>>in.imm; break;
+            case OP_SLLV: reg[in.rd] = t<<(s&0x1f); break;
+            case OP_SRLV: reg[in.rd] = t>>(s&0x1f); break;
+            case OP_SRAV: reg[in.rd] = (int32_t)t>>(s&0x1f); break;
+            case OP_JALR: reg[in.rd] = pc+8;
+                /* fall through */
+            case OP_JR: sim->npc = s; break;
+            case OP_SYSCALL: sim_syscall(sim); break;
+            case OP_BREAK: sim_fault(sim,"break at %#010x",pc); break;
+            case OP_MFHI: reg[in.rd] = sim->hi; break;
+            case OP_MTHI: sim->hi = s; break;
+            case OP_MFLO: reg[in.rd] = sim->lo; break;
+            case OP_MTLO: sim->lo = s; break;
+            case OP_MULT:{
+                int64_t product = (int64_t)(int32_t)s*(int32_t)t;
+                sim->hi = (uint64_t)product>>32;
+                sim->lo = (uint32_t)product;
+                break;
+            }
+            case OP_MULTU:{
+                uint64_t product = (uint64_t)s*t;
+                sim->hi = product>>32;
+                sim->lo = (uint32_t)product;
+                break;
+            }
+            case OP_DIV://the result of dividing by zero is undefined, leave hi and lo
+                if(t&&!(s==0x80000000&&t==0xffffffff)){
+                    sim->lo = (int32_t)s/(int32_t)t;
+                    sim->hi = (int32_t)s%(int32_t)t;
+                }
+                break;
+            case OP_DIVU:
+                if(t){
+                    sim->lo = s/t;
+                    sim->hi = s%t;
+                }
+                break;
+            case OP_ADD:
+                if(((s+t)^s)&((s+t)^t)&0x80000000){
+                    sim_fault(sim,"arithmetic overflow at %#010x",pc);
+                }
+                else{
+                    reg[in.rd] = s+t;
+                }
+                break;
+            case OP_ADDU: reg[in.rd] = s+t; break;
+            case OP_SUB:
+                if((s^t)&(s^(s-t))&0x80000000){
+                    sim_fault(sim,"arithmetic overflow at %#010x",pc);
+                }
+                else{
+                    reg[in.rd] = s-t;
+                }
+                break;
+            case OP_SUBU: reg[in.rd] = s-t; break;
+            case OP_AND: reg[in.rd] = s&t; break;
+            case OP_OR: reg[in.rd] = s|t; break;
+            case OP_XOR: reg[in.rd] = s^t; break;
+            case OP_NOR: reg[in.rd] = ~(s|t); break;
+            case OP_SLT: reg[in.rd] = (int32_t)s<(int32_t)t; break;
+            case OP_SLTU: reg[in.rd] = s<t; break;
+            case OP_BLTZAL: reg[REG_RA] = pc+8;
+                /* fall through */
+            case OP_BLTZ: if((int32_t)s<0) sim->npc = pc+4+in.imm; break;
+            case OP_BGEZAL: reg[REG_RA] = pc+8;
+                /* fall through */
+            case OP_BGEZ: if((int32_t)s>=0) sim->npc = pc+4+in.imm; break;
+            case OP_JAL: reg[REG_RA] = pc+8;
+                /* fall through */
+            case OP_J: sim->npc = ((pc+4)&0xf0000000)|in.imm; break;
+            case OP_BEQ: if(s==t) sim->npc = pc+4+in.imm; break;
+            case OP_BNE: if(s!=t) sim->npc = pc+4+in.imm; break;
+            case OP_BLEZ: if((int32_t)s<=0) sim->npc = pc+4+in.imm; break;
+            case OP_BGTZ: if((int32_t)s>0) sim->npc = pc+4+in.imm; break;
+            case OP_ADDI:
+                if(((s+in.imm)^s)&((s+in.imm)^in.imm)&0x80000000){
+                    sim_fault(sim,"arithmetic overflow at %#010x",pc);
+                }
+                else{
+                    reg[in.rt] = s+in.imm;
+                }
+                break;
+            case OP_ADDIU: reg[in.rt] = s+in.imm; break;
+            case OP_SLTI: reg[in.rt] = (int32_t)s<(int32_t)in.imm; break;
+            case OP_SLTIU: reg[in.rt] = s<in.imm; break;
+            case OP_ANDI: reg[in.rt] = s&in.imm; break;
+            case OP_ORI: reg[in.rt] = s|in.imm; break;
+            case OP_XORI: reg[in.rt] = s^in.imm; break;
+            case OP_LUI: reg[in.rt] = in.imm<<16; break;
+            case OP_LB: reg[in.rt] = (int32_t)(int8_t)sim_load(sim,s+in.imm,1); break;
+            case OP_LH: reg[in.rt] = (int32_t)(int16_t)sim_load(sim,s+in.imm,2); break;
+            case OP_LW: reg[in.rt] = sim_load(sim,s+in.imm,4); break;
+            case OP_LBU: reg[in.rt] = sim_load(sim,s+in.imm,1); break;
+            case OP_LHU: reg[in.rt] = sim_load(sim,s+in.imm,2); break;
+            case OP_LWL:{//bytes from the address to the end of its word, into the high end of rt
+                uint32_t addr = s+in.imm;
+                for(uint32_t byte=0;byte<=3-(addr&3)&&sim->running;byte++){
+                    uint32_t shift = 8*(3-byte);
+                    t = (t&~(0xffu<<shift))|(sim_load(sim,addr+byte,1)<<shift);
+                }
+                reg[in.rt] = t;
+                break;
+            }
+            case OP_LWR:{//bytes from the start of the word to the address, into the low end of rt
+                uint32_t addr = s+in.imm;
+                for(uint32_t byte=0;byte<=(addr&3)&&sim->running;byte++){
+                    uint32_t shift = 8*byte;
+                    t = (t&~(0xffu<<shift))|(sim_load(sim,addr-byte,1)<<shift);
+                }
+                reg[in.rt] = t;
+                break;
+            }
+            case OP_SB: sim_store(sim,s+in.imm,1,t); break;
+            case OP_SH: sim_store(sim,s+in.imm,2,t); break;
+            case OP_SW: sim_store(sim,s+in.imm,4,t); break;
+            case OP_SWL:{
+                uint32_t addr = s+in.imm;
+                for(uint32_t byte=0;byte<=3-(addr&3)&&sim->running;byte++){
+                    sim_store(sim,addr+byte,1,t>>(8*(3-byte)));
+                }
+                break;
+            }
+            case OP_SWR:{
+                uint32_t addr = s+in.imm;
+                for(uint32_t byte=0;byte<=(addr&3)&&sim->running;byte++){
+                    sim_store(sim,addr-byte,1,t>>(8*byte));
+                }
+                break;
+            }
+            default:
+                sim_fault(sim,"reserved instruction at %#010x",pc);
+                break;
+        }
+        reg[0] = 0;
+        sim->count++;
+    }
+}
+
+///free the simulated memory and instruction cache
+///param: sim
+static void sim_destroy(sim_t* sim){
+    for(uint32_t l1=0;l1<SIM_L1_SIZE;l1++){
+        if(sim->pages[l1]){
+            for(uint32_t l2=0;l2<SIM_L2_SIZE;l2++){
+                free(sim->pages[l1][l2]);
+            }
+            free(sim->pages[l1]);
+        }
+    }
+    free(sim->icache);
+    free(sim);
+}
+
+///run a load module from its entry point
+///text is predecoded into an instruction cache and the data sections are
+///copied into sparse paged memory, sbss, bss, heap and stack start as zero pages
+///param: MODULE to run, limit on instructions executed, 0 for none
+///return: exit status of the program, -1 if it faulted
+int simulate_module(module_t* MODULE, uint64_t limit){
+    char* sections[] = {"text","rdata","data","sdata","sbss","bss"};
+    if(MODULE->HEADER->entry==0x0){
+        fprintf(ERR,"error: object modules cannot be run, link them first\n");
+        return -1;
+    }
+    if(MODULE->LITTLE){
+        fprintf(ERR,"error: the simulator runs big endian modules only\n");
+        return -1;
+    }
+    if(load_sections(MODULE,ALL_SECTIONS)){
+        return -1;
+    }
+    sim_t* sim = calloc(1,sizeof(sim_t));
+    if(!sim){
+        fprintf(ERR,"error: not enough memory to run the module\n");
+        return -1;
+    }
+    uint32_t ninsns = get_size("text",MODULE)/4;
+    sim->icache = malloc((ninsns?ninsns:1)*sizeof(sim_insn_t));
+    if(!sim->icache){
+        fprintf(ERR,"error: not enough memory to run the module\n");
+        free(sim);
+        return -1;
+    }
+    //predecode text
+    for(uint32_t insn=0;insn<ninsns;insn++){
+        uint32_t word;
+        memcpy(&word,&MODULE->TEXT[insn*4],sizeof(uint32_t));
+        sim->icache[insn] = sim_decode(ntohl(word));
+    }
+    sim->ninsns = ninsns;
+    sim->text_end = TEXT_BEGIN+ninsns*4;
+    //seed memory
+    for(int sec=EH_IX_TEXT;sec<=EH_IX_SDATA;sec++){
+        uint32_t size = get_size(sections[sec],MODULE);
+        if(size&&sim_seed(sim,get_start(MODULE,sections[sec]),*get_section(MODULE,sec),size)){
+            fprintf(ERR,"error: not enough memory to run the module\n");
+            sim_destroy(sim);
+            return -1;
+        }
+    }
+    sim->brk = get_start(MODULE,"bss")+((get_size("bss",MODULE)+7)&~7u);
+    sim->reg[REG_SP] = (STACK_END&~7u)-4;
+    sim->reg[REG_GP] = get_start(MODULE,"sdata")+0x8000;
+    sim->pc = ntohl(MODULE->HEADER->entry);
+    sim->npc = sim->pc+4;
+    sim->running = 1;
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC,&begin);
+    sim_execute(sim,limit);
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    fflush(stdout);
+
+    double seconds = (end.tv_sec-begin.tv_sec)+(end.tv_nsec-begin.tv_nsec)/1e9;
+    int status = sim->status;
+    if(sim->fault[0]){
+        fprintf(ERR,"error: %s\n",sim->fault);
+        status = -1;
+    }
+    else{
+        fprintf(OUT,"\nProgram exited with status %d\n",status);
+    }
+    fprintf(OUT,"Executed %llu instructions in %.6f seconds (%.2f MIPS)\n",
+            (unsigned long long)sim->count,seconds,seconds>0?sim->count/seconds/1e6:0.0);
+    sim_destroy(sim);
+    return status;
+}
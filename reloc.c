@@ -0,0 +1,163 @@
+///author: jmp1617
+///purpose: index of the fields the reltab and reftab fix up, to guard edits
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///longest field a table entry covers (REL_IMM_2 spans two instructions)
+#define RELOC_MAX_SPAN 8
+
+///struct to hold the bytes one table entry fixes up
+typedef struct reloc_span{
+    uint32_t start;//offset within the section
+    uint32_t end;//one past the last byte
+    uint32_t entry;//index in its table
+    uint8_t table;//EH_IX_REL or EH_IX_REF
+    uint8_t type;
+}reloc_span_t;
+
+///struct to hold the spans of each section sorted by start
+struct reloc_index{
+    reloc_span_t* spans[EH_IX_BSS+1];
+    uint32_t nspans[EH_IX_BSS+1];
+    int mapped;//1 if the spans belong to the cache
+};
+
+///get the number of bytes a relocation type fixes up
+///param: type from the entry
+///return: the width in bytes
+static uint32_t reloc_width(uint8_t type){
+    return (type&0x0f)==REL_IMM_2?8:4;//immediates and jump targets are fixed inside the instruction word
+}
+
+///compare two spans by start
+static int compare_spans(const void* a, const void* b){
+    const reloc_span_t* x = a;
+    const reloc_span_t* y = b;
+    return x->start<y->start?-1:x->start>y->start;
+}
+
+///add the entries of one table to the index
+///param: MODULE, index, table EH_IX_REL or EH_IX_REF, counts of spans already placed per section
+static void add_spans(module_t* MODULE, reloc_index_t* index, int table, uint32_t* placed){
+    static char* sections[] = {"text","rdata","data","sdata","sbss","bss"};
+    uint32_t nentries = get_size(table==EH_IX_REL?"reltab":"reftab",MODULE);
+    for(uint32_t entry=0;entry<nentries;entry++){
+        uint8_t section, type;
+        uint32_t addr;
+        if(table==EH_IX_REL){
+            section = MODULE->RELTAB[entry].section;
+            type = MODULE->RELTAB[entry].type;
+            addr = ntohl(MODULE->RELTAB[entry].addr);
+        }
+        else{
+            section = MODULE->REFTAB[entry].section;
+            type = MODULE->REFTAB[entry].type;
+            addr = ntohl(MODULE->REFTAB[entry].addr);
+        }
+        if(section<1||section>EH_IX_BSS+1){
+            continue;//validate reports these
+        }
+        int sec = section-1;
+        if(!index->spans[sec]){//first pass counts
+            index->nspans[sec]++;
+            continue;
+        }
+        if(MODULE->HEADER->entry!=0x0){
+            addr -= get_start(MODULE,sections[sec]);
+        }
+        reloc_span_t* span = &index->spans[sec][placed[sec]++];
+        span->start = addr;
+        span->end = addr+reloc_width(type);
+        span->entry = entry;
+        span->table = table;
+        span->type = type;
+    }
+}
+
+///build the index of fixed up fields for every section
+///param: MODULE
+///return: the index
+reloc_index_t* build_reloc_index(module_t* MODULE){
+    reloc_index_t* index = calloc(1,sizeof(reloc_index_t));
+    uint32_t placed[EH_IX_BSS+1] = {0};
+    add_spans(MODULE,index,EH_IX_REL,placed);//count
+    add_spans(MODULE,index,EH_IX_REF,placed);
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        index->spans[sec] = malloc((index->nspans[sec]+1)*sizeof(reloc_span_t));
+    }
+    add_spans(MODULE,index,EH_IX_REL,placed);//fill
+    add_spans(MODULE,index,EH_IX_REF,placed);
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        qsort(index->spans[sec],index->nspans[sec],sizeof(reloc_span_t),compare_spans);
+    }
+    return index;
+}
+
+///find the fixed up fields an edit overlaps, in O(log n + hits)
+///param: index, sec the EH_IX_ index of the section, offset and length of the edit within it,
+///       describe set to a description of the first field hit (may be NULL)
+///return: number of fields the edit overlaps
+uint32_t find_relocs(reloc_index_t* index, int sec, uint32_t offset, uint32_t length, char describe[64]){
+    if(sec<0||sec>EH_IX_BSS||!length){
+        return 0;
+    }
+    reloc_span_t* spans = index->spans[sec];
+    uint32_t n = index->nspans[sec];
+    uint32_t from = offset>RELOC_MAX_SPAN?offset-RELOC_MAX_SPAN+1:0;
+    uint32_t lo = 0, hi = n;//first span that could reach the edit
+    while(lo<hi){
+        uint32_t mid = (lo+hi)/2;
+        if(spans[mid].start<from){
+            lo = mid+1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    uint32_t hits = 0;
+    for(uint32_t span=lo;span<n&&spans[span].start<(uint64_t)offset+length;span++){
+        if(spans[span].end>offset){
+            if(!hits&&describe){
+                snprintf(describe,64,"%s entry %u, type %u",spans[span].table==EH_IX_REL?"reltab":"reftab",
+                        spans[span].entry,spans[span].type);
+            }
+            hits++;
+        }
+    }
+    return hits;
+}
+
+///get the spans of one section so they can be cached
+///param: index, sec the EH_IX_ index of the section, spans set to the array
+///return: the size of the array in bytes
+size_t reloc_spans(reloc_index_t* index, int sec, void** spans){
+    *spans = index->spans[sec];
+    return (size_t)index->nspans[sec]*sizeof(reloc_span_t);
+}
+
+///make an index from spans in the cache
+///param: spans of each section, bytes of each array
+///return: the index, which does not free the spans
+reloc_index_t* adopt_reloc_index(void* spans[EH_IX_BSS+1], uint64_t bytes[EH_IX_BSS+1]){
+    reloc_index_t* index = calloc(1,sizeof(reloc_index_t));
+    for(int sec=0;sec<=EH_IX_BSS;sec++){
+        index->spans[sec] = spans[sec];
+        index->nspans[sec] = bytes[sec]/sizeof(reloc_span_t);
+    }
+    index->mapped = 1;
+    return index;
+}
+
+///free the index
+///param: index
+void destroy_reloc_index(reloc_index_t* index){
+    if(index){
+        for(int sec=0;sec<=EH_IX_BSS&&!index->mapped;sec++){
+            free(index->spans[sec]);
+        }
+        free(index);
+    }
+}
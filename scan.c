@@ -0,0 +1,360 @@
+///author: jmp1617
+///purpose: summarize every module under some directories from their headers alone
+///headers are read in batches through io_uring, or by a pool of threads where it is not available
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+#if !defined(LMEDIT_NO_URING)&&defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define SCAN_URING 1
+#endif
+#endif
+
+///files whose headers are read together, and most threads reading them without io_uring
+#define SCAN_BATCH 256
+#define SCAN_MAX_THREADS 64
+
+///struct to hold one file of a batch
+typedef struct scan_file{
+    char* path;
+    int fd;
+    int result;//bytes of the header read, or -errno
+    uint8_t raw[HEADER_SIZE];
+}scan_file_t;
+
+///struct to hold the files found so far and the totals
+typedef struct scan{
+    scan_file_t files[SCAN_BATCH];
+    int n;
+    uint64_t nfiles;
+    uint64_t nmodules;
+    int failed;
+#ifdef SCAN_URING
+    struct uring* ring;//NULL when io_uring could not be set up
+#endif
+}scan_t;
+
+#ifdef SCAN_URING
+///struct to hold the rings shared with the kernel
+typedef struct uring{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_size, cq_size, sqes_size;
+}uring_t;
+
+///set up a ring big enough for a batch
+///return: the ring, NULL if the kernel does not have io_uring or it is not allowed
+static uring_t* uring_setup(void){
+    struct io_uring_params params = {0};
+    int fd = syscall(__NR_io_uring_setup,SCAN_BATCH,&params);
+    if(fd<0){
+        return NULL;
+    }
+    if(!(params.features&IORING_FEAT_RW_CUR_POS)){//openat, read and close came in the same release
+        close(fd);
+        return NULL;
+    }
+    uring_t* ring = calloc(1,sizeof(uring_t));
+    ring->fd = fd;
+    ring->sq_size = params.sq_off.array+params.sq_entries*sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    if(params.features&IORING_FEAT_SINGLE_MMAP){
+        ring->sq_size = ring->cq_size = ring->sq_size>ring->cq_size?ring->sq_size:ring->cq_size;
+    }
+    ring->sq_ring = mmap(NULL,ring->sq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+    ring->cq_ring = params.features&IORING_FEAT_SINGLE_MMAP?ring->sq_ring:
+                    mmap(NULL,ring->cq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL,ring->sqes_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES);
+    if(ring->sq_ring==MAP_FAILED||ring->cq_ring==MAP_FAILED||ring->sqes==MAP_FAILED){
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+    uint8_t* sq = ring->sq_ring;
+    uint8_t* cq = ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq+params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq+params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq+params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq+params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq+params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq+params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq+params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq+params.cq_off.cqes);
+    return ring;
+}
+
+///tear down a ring
+///param: ring
+static void uring_destroy(uring_t* ring){
+    if(ring){
+        munmap(ring->sqes,ring->sqes_size);
+        if(ring->cq_ring!=ring->sq_ring){
+            munmap(ring->cq_ring,ring->cq_size);
+        }
+        munmap(ring->sq_ring,ring->sq_size);
+        close(ring->fd);
+        free(ring);
+    }
+}
+
+///run one operation on every file of the batch and wait for all of them
+///param: ring, scan holding the batch, op IORING_OP_OPENAT, IORING_OP_READ or IORING_OP_CLOSE
+static void uring_batch(uring_t* ring, scan_t* scan, int op){
+    unsigned tail = *ring->sq_tail, queued = 0;
+    for(int f=0;f<scan->n;f++){
+        scan_file_t* file = &scan->files[f];
+        if(op!=IORING_OP_OPENAT&&file->fd<0){
+            continue;//the open failed
+        }
+        unsigned slot = tail&*ring->sq_mask;
+        struct io_uring_sqe* sqe = &ring->sqes[slot];
+        memset(sqe,0,sizeof(*sqe));
+        sqe->opcode = op;
+        sqe->user_data = f;
+        if(op==IORING_OP_OPENAT){
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)file->path;
+            sqe->open_flags = O_RDONLY|O_CLOEXEC;
+        }
+        else{
+            sqe->fd = file->fd;
+            if(op==IORING_OP_READ){
+                sqe->addr = (uintptr_t)file->raw;
+                sqe->len = HEADER_SIZE;
+            }
+        }
+        ring->sq_array[slot] = slot;
+        tail++;
+        queued++;
+    }
+    __atomic_store_n(ring->sq_tail,tail,__ATOMIC_RELEASE);
+    unsigned submitted = 0, reaped = 0;
+    while(reaped<queued){
+        int n = syscall(__NR_io_uring_enter,ring->fd,queued-submitted,queued-reaped,IORING_ENTER_GETEVENTS,NULL,0);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+        submitted += n;
+        unsigned head = *ring->cq_head;
+        while(head!=__atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE)){
+            struct io_uring_cqe* cqe = &ring->cqes[head&*ring->cq_mask];
+            scan_file_t* file = &scan->files[cqe->user_data];
+            if(op==IORING_OP_OPENAT){
+                file->fd = cqe->res;
+                file->result = cqe->res<0?cqe->res:0;
+            }
+            else if(op==IORING_OP_READ){
+                file->result = cqe->res;
+            }
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+    }
+}
+#endif
+
+///struct to hold the batch shared by the reading threads
+typedef struct scan_pool{
+    scan_t* scan;
+    int next;//next file to claim
+}scan_pool_t;
+
+///open a file of the batch, read its header and close it
+///param: file
+static void read_header(scan_file_t* file){
+    file->fd = open(file->path,O_RDONLY|O_CLOEXEC);
+    if(file->fd<0){
+        file->result = -errno;
+        return;
+    }
+    ssize_t got = pread(file->fd,file->raw,HEADER_SIZE,0);
+    file->result = got<0?-errno:got;
+    close(file->fd);
+}
+
+///thread to read headers until the batch is claimed
+///param: arg the pool
+static void* scan_worker(void* arg){
+    scan_pool_t* pool = arg;
+    int f;
+    while((f=__atomic_fetch_add(&pool->next,1,__ATOMIC_RELAXED))<pool->scan->n){
+        read_header(&pool->scan->files[f]);
+    }
+    return NULL;
+}
+
+///read the headers of the batch with a pool of threads
+///param: scan holding the batch
+static void pool_batch(scan_t* scan){
+    scan_pool_t pool = {scan,0};
+    int nthreads = get_nprocs()*4;//the threads mostly wait on the disk
+    if(nthreads>SCAN_MAX_THREADS){
+        nthreads = SCAN_MAX_THREADS;
+    }
+    if(nthreads>scan->n){
+        nthreads = scan->n;
+    }
+    pthread_t threads[SCAN_MAX_THREADS];
+    int started = 0;
+    for(;started<nthreads-1;started++){
+        if(pthread_create(&threads[started],NULL,scan_worker,&pool)){
+            break;
+        }
+    }
+    scan_worker(&pool);
+    for(int t=0;t<started;t++){
+        pthread_join(threads[t],NULL);
+    }
+}
+
+///read the headers of every file in the batch, print a row for each module and empty the batch
+///param: scan
+static void flush_batch(scan_t* scan){
+    if(!scan->n){
+        return;
+    }
+#ifdef SCAN_URING
+    if(scan->ring){
+        uring_batch(scan->ring,scan,IORING_OP_OPENAT);
+        uring_batch(scan->ring,scan,IORING_OP_READ);
+        uring_batch(scan->ring,scan,IORING_OP_CLOSE);
+    }
+    else{
+        pool_batch(scan);
+    }
+#else
+    pool_batch(scan);
+#endif
+    for(int f=0;f<scan->n;f++){
+        scan_file_t* file = &scan->files[f];
+        exec_t header;
+        scan->nfiles++;
+        if(file->result<0){
+            fprintf(ERR,"error: %s: %s\n",file->path,strerror(-file->result));
+            scan->failed = 1;
+        }
+        else if(file->result==HEADER_SIZE&&(memcpy(&header,file->raw,HEADER_SIZE),
+                ntohs(header.magic)==HDR_MAGIC||le16toh(header.magic)==HDR_MAGIC)){
+            if(ntohs(header.magic)!=HDR_MAGIC){//little endian, the fields are printed from big endian
+                swap_header(&header);
+            }
+            uint16_t version = ntohs(header.version);
+            scan->nmodules++;
+            fprintf(OUT,"%-6s 0x%08x %d/%02d/%02d",header.entry?"load":"object",ntohl(header.entry),
+                    (version>>9)+2000,(version>>5)&0xf,version&0x1f);
+            for(int sec=0;sec<N_EH;sec++){
+                fprintf(OUT," %10u",ntohl(header.data[sec]));
+            }
+            fprintf(OUT," %s\n",file->path);
+        }
+        free(file->path);
+    }
+    scan->n = 0;
+}
+
+///add a file to the batch, reading the batch when it is full
+///param: scan, path of the file, taken over by the batch
+static void add_file(scan_t* scan, char* path){
+    scan->files[scan->n].path = path;
+    scan->files[scan->n].fd = -1;
+    scan->files[scan->n].result = 0;
+    if(++scan->n==SCAN_BATCH){
+        flush_batch(scan);
+    }
+}
+
+///add every regular file under a directory, symbolic links to directories are not followed
+///param: scan, dir to walk
+static void walk_dir(scan_t* scan, char* dir){
+    DIR* dp = opendir(dir);
+    if(!dp){
+        perror(dir);
+        scan->failed = 1;
+        return;
+    }
+    struct dirent* ent;
+    while((ent=readdir(dp))){
+        if(!strcmp(ent->d_name,".")||!strcmp(ent->d_name,"..")){
+            continue;
+        }
+        size_t len = strlen(dir)+strlen(ent->d_name)+2;
+        char* path = malloc(len);
+        snprintf(path,len,"%s/%s",dir,ent->d_name);
+        int type = ent->d_type;
+        struct stat st;
+        if(type==DT_UNKNOWN&&!lstat(path,&st)){//the file system does not say
+            type = S_ISREG(st.st_mode)?DT_REG:S_ISDIR(st.st_mode)?DT_DIR:S_ISLNK(st.st_mode)?DT_LNK:DT_UNKNOWN;
+        }
+        if(type==DT_LNK){//only links to files are followed
+            type = !stat(path,&st)&&S_ISREG(st.st_mode)?DT_REG:DT_UNKNOWN;
+        }
+        if(type==DT_REG){
+            add_file(scan,path);
+        }
+        else{
+            if(type==DT_DIR){
+                walk_dir(scan,path);
+            }
+            free(path);
+        }
+    }
+    closedir(dp);
+}
+
+///print one row for every module found in some directories or files, reading only their headers
+///param: paths of directories and files, npaths
+///return: 0 on success, 1 if something could not be read
+int scan_modules(char** paths, int npaths){
+    scan_t* scan = calloc(1,sizeof(scan_t));
+#ifdef SCAN_URING
+    scan->ring = uring_setup();
+#endif
+    fprintf(OUT,"%-6s %-10s %-10s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s %s\n","kind","entry","version",
+            "text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings","file");
+    for(int p=0;p<npaths;p++){
+        struct stat st;
+        if(stat(paths[p],&st)){
+            perror(paths[p]);
+            scan->failed = 1;
+        }
+        else if(S_ISDIR(st.st_mode)){
+            walk_dir(scan,paths[p]);
+        }
+        else{
+            add_file(scan,strdup(paths[p]));
+        }
+    }
+    flush_batch(scan);
+    fprintf(ERR,"Scanned %llu files, found %llu modules\n",(unsigned long long)scan->nfiles,
+            (unsigned long long)scan->nmodules);
+    int failed = scan->failed;
+#ifdef SCAN_URING
+    uring_destroy(scan->ring);
+#endif
+    free(scan);
+    return failed;
+}
@@ -0,0 +1,337 @@
+///author: jmp1617
+///purpose: select entries of the reltab, reftab and symtab by their fields
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///rows filtered at a time, so a block's match bytes stay in the cache while every predicate runs over it
+#define SELECT_BLOCK 4096
+#define SELECT_MAX_PREDICATES 16
+
+///columns a table is split into
+#define COL_ADDR 0//addr, or the value of a symbol
+#define COL_FLAGS 1
+#define COL_SECTION 2
+#define COL_TYPE 3//low 4 bits, how the field is fixed up
+#define COL_NAME 4//string index
+#define N_COLS 5
+
+static char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+
+///struct to hold a table in host order, one array per field, padded to a whole block
+struct columns{
+    uint32_t rows;
+    uint32_t* col[N_COLS];//NULL for the fields the table does not have
+};
+
+///struct to hold the fields select knows for each table
+typedef struct select_field{
+    char* name;
+    int table;
+    int column;
+}select_field_t;
+
+static const select_field_t fields[] = {
+    {"addr",EH_IX_REL,COL_ADDR},{"section",EH_IX_REL,COL_SECTION},{"type",EH_IX_REL,COL_TYPE},
+    {"addr",EH_IX_REF,COL_ADDR},{"section",EH_IX_REF,COL_SECTION},{"type",EH_IX_REF,COL_TYPE},
+    {"name",EH_IX_REF,COL_NAME},
+    {"value",EH_IX_SYM,COL_ADDR},{"flags",EH_IX_SYM,COL_FLAGS},{"name",EH_IX_SYM,COL_NAME}
+};
+
+///struct to hold one parsed predicate
+typedef struct predicate{
+    int column;
+    int mask;//1 if any of the bits in lo must be set
+    int negate;
+    uint32_t lo;//range of matching values, inclusive
+    uint32_t hi;
+    char* name;//for COL_NAME, the name or prefix
+    size_t length;
+    int prefix;//1 if the name ended in *
+}predicate_t;
+
+///split a table into columns
+///param: MODULE, table EH_IX_ index
+///return: the columns
+static columns_t* build_columns(module_t* MODULE, int table){
+    columns_t* columns = calloc(1,sizeof(columns_t));
+    uint32_t rows = get_size(sections[table],MODULE);
+    size_t padded = ((size_t)rows+SELECT_BLOCK-1)/SELECT_BLOCK*SELECT_BLOCK;
+    columns->rows = rows;
+    for(int c=0;c<N_COLS;c++){
+        int used = 0;
+        for(size_t f=0;f<sizeof(fields)/sizeof(fields[0]);f++){
+            used |= fields[f].table==table&&fields[f].column==c;
+        }
+        if(used){
+            columns->col[c] = calloc(padded?padded:1,sizeof(uint32_t));
+            stats_alloc(padded*sizeof(uint32_t));
+        }
+    }
+    for(uint32_t row=0;row<rows;row++){
+        switch(table){
+            case EH_IX_REL:
+                columns->col[COL_ADDR][row] = ntohl(MODULE->RELTAB[row].addr);
+                columns->col[COL_SECTION][row] = MODULE->RELTAB[row].section;
+                columns->col[COL_TYPE][row] = MODULE->RELTAB[row].type&0x0f;
+                break;
+            case EH_IX_REF:
+                columns->col[COL_ADDR][row] = ntohl(MODULE->REFTAB[row].addr);
+                columns->col[COL_SECTION][row] = MODULE->REFTAB[row].section;
+                columns->col[COL_TYPE][row] = MODULE->REFTAB[row].type&0x0f;
+                columns->col[COL_NAME][row] = ntohl(MODULE->REFTAB[row].sym);
+                break;
+            case EH_IX_SYM:
+                columns->col[COL_ADDR][row] = ntohl(MODULE->SYMTAB[row].value);
+                columns->col[COL_FLAGS][row] = ntohl(MODULE->SYMTAB[row].flags);
+                columns->col[COL_NAME][row] = ntohl(MODULE->SYMTAB[row].sym);
+                break;
+        }
+    }
+    return columns;
+}
+
+///free the columns of a table
+///param: columns
+void destroy_columns(columns_t* columns){
+    if(columns){
+        for(int c=0;c<N_COLS;c++){
+            free(columns->col[c]);
+        }
+        free(columns);
+    }
+}
+
+///narrow a block to the rows whose value is in a range
+///param: col the block of the column, lo and hi the range, negate 1 to keep the rows outside it, match per row
+static void filter_range(const uint32_t* restrict col, uint32_t lo, uint32_t hi, uint8_t negate, uint8_t* restrict match){
+    uint32_t span = hi-lo;
+    for(int row=0;row<SELECT_BLOCK;row++){
+        match[row] &= (uint8_t)((col[row]-lo<=span)^negate);
+    }
+}
+
+///narrow a block to the rows with any of the bits of a mask set
+///param: col the block of the column, mask, negate 1 to keep the rows with none set, match per row
+static void filter_mask(const uint32_t* restrict col, uint32_t mask, uint8_t negate, uint8_t* restrict match){
+    for(int row=0;row<SELECT_BLOCK;row++){
+        match[row] &= (uint8_t)(((col[row]&mask)!=0)^negate);
+    }
+}
+
+///count the rows of a block that matched
+///param: match per row, rows in the block
+///return: the count
+static uint32_t count_matches(const uint8_t* match, uint32_t rows){
+    uint32_t count = 0;
+    for(uint32_t row=0;row<rows;row++){
+        count += match[row];
+    }
+    return count;
+}
+
+///parse a number, or a section or relocation type name
+///param: text, column it is compared with, value set to the number
+///return: 0 on success 1 if it is not understood
+static int parse_operand(char* text, int column, uint32_t* value){
+    static char* types[] = {"imm","imm2","word","jump"};
+    if(column==COL_SECTION){
+        int sec = get_index(text);
+        if(sec>=0&&sec<=EH_IX_BSS){
+            *value = sec+1;//tables number the sections from 1
+            return 0;
+        }
+    }
+    if(column==COL_TYPE){
+        for(int type=0;type<4;type++){
+            if(!strcmp(text,types[type])){
+                *value = type+1;
+                return 0;
+            }
+        }
+    }
+    char* end;
+    unsigned long long number = strtoull(text,&end,0);
+    if(end==text||*end!='\0'||number>0xffffffffull){
+        fprintf(ERR,"error: '%s' is not a 32 bit number%s\n",text,
+                column==COL_SECTION?" or a section":column==COL_TYPE?" or imm, imm2, word or jump":"");
+        return 1;
+    }
+    *value = number;
+    return 0;
+}
+
+///parse one predicate, field op value
+///param: text of the predicate, table, pred to fill in
+///return: 0 on success 1 if it is not understood
+static int parse_predicate(char* text, int table, predicate_t* pred){
+    static char* ops[] = {"!=","<=",">=","=","<",">","&"};//two character operators first
+    size_t length = strcspn(text,"!<>=&");
+    int op = -1;
+    for(int o=0;o<7&&op<0;o++){
+        if(!strncmp(text+length,ops[o],strlen(ops[o]))){
+            op = o;
+        }
+    }
+    if(op<0||!length){
+        fprintf(ERR,"error: '%s' is not a predicate, use field=value, !=, <, <=, >, >= or &\n",text);
+        return 1;
+    }
+    char* operand = text+length+strlen(ops[op]);
+    memset(pred,0,sizeof(predicate_t));
+    pred->column = -1;
+    for(size_t f=0;f<sizeof(fields)/sizeof(fields[0]);f++){
+        if(fields[f].table==table&&strlen(fields[f].name)==length&&!strncmp(text,fields[f].name,length)){
+            pred->column = fields[f].column;
+        }
+    }
+    if(pred->column<0){
+        fprintf(ERR,"error: %s entries have no field '%.*s'\n",sections[table],(int)length,text);
+        return 1;
+    }
+    if(pred->column==COL_NAME){
+        if(op>0&&op!=3){
+            fprintf(ERR,"error: names are compared with = or !=\n");
+            return 1;
+        }
+        pred->negate = op==0;
+        pred->name = operand;
+        pred->length = strlen(operand);
+        if(pred->length&&operand[pred->length-1]=='*'){
+            pred->prefix = 1;
+            pred->length--;
+        }
+        return 0;
+    }
+    uint32_t value;
+    if(parse_operand(operand,pred->column,&value)){
+        return 1;
+    }
+    pred->lo = 0;
+    pred->hi = 0xffffffff;
+    switch(op){
+        case 0://!= is = negated
+        case 3: pred->negate = op==0; pred->lo = pred->hi = value; break;
+        case 1: pred->hi = value; break;
+        case 2: pred->lo = value; break;
+        case 4://nothing is below 0, so keep nothing
+            if(value==0){ pred->negate = 1; }
+            else{ pred->hi = value-1; }
+            break;
+        case 5:
+            if(value==0xffffffff){ pred->negate = 1; }
+            else{ pred->lo = value+1; }
+            break;
+        case 6: pred->mask = 1; pred->lo = value; break;
+    }
+    return 0;
+}
+
+///check a name predicate against one row
+///param: MODULE, pred, index of the name in the string table
+///return: 1 if the row is kept
+static int match_name(module_t* MODULE, predicate_t* pred, uint32_t index){
+    char* name = get_string(MODULE,index);
+    int same = pred->prefix?!strncmp(name,pred->name,pred->length):!strcmp(name,pred->name);
+    return same^pred->negate;
+}
+
+///print the entries of a table that match every predicate
+///param: MODULE, args the table and predicates, "count" prints only the number that match
+///return: 0 on success 1 if the query was not understood
+int select_entries(module_t* MODULE, char* args){
+    char line[256];//split a copy, the command goes into the history as it was typed
+    char* words[SELECT_MAX_PREDICATES+2];
+    int nwords = 0;
+    snprintf(line,sizeof(line),"%s",args);
+    for(char* word=strtok(line," ");word;word=strtok(NULL," ")){
+        if(nwords==SELECT_MAX_PREDICATES+2){
+            fprintf(ERR,"error: select takes at most %d predicates\n",SELECT_MAX_PREDICATES);
+            return 1;
+        }
+        words[nwords++] = word;
+    }
+    int table = -1;
+    for(int t=0;nwords&&t<3;t++){
+        if(!strcmp(words[0],sections[EH_IX_REL+t])||(!strncmp(words[0],sections[EH_IX_REL+t],3)&&!words[0][3])){
+            table = EH_IX_REL+t;
+        }
+    }
+    if(table<0){
+        fprintf(ERR,"error: use select reltab|reftab|symtab [field op value]... [count]\n");
+        return 1;
+    }
+    int count_only = nwords>1&&!strcmp(words[nwords-1],"count");
+    predicate_t preds[SELECT_MAX_PREDICATES];
+    int npreds = 0, nnames = 0;
+    for(int w=1;w<nwords-count_only;w++){
+        if(npreds==SELECT_MAX_PREDICATES){
+            fprintf(ERR,"error: select takes at most %d predicates\n",SELECT_MAX_PREDICATES);
+            return 1;
+        }
+        if(parse_predicate(words[w],table,&preds[npreds])){
+            return 1;
+        }
+        nnames += preds[npreds].column==COL_NAME;
+        npreds++;
+    }
+    if(load_sections(MODULE,SECTION_BIT(table)|SECTION_BIT(EH_IX_STR))){
+        return 1;
+    }
+    columns_t** slot = &MODULE->COLUMNS[table-EH_IX_REL];
+    if(!*slot){
+        *slot = build_columns(MODULE,table);
+    }
+    columns_t* columns = *slot;
+    uint32_t matched = 0;
+    uint8_t match[SELECT_BLOCK];
+    for(uint32_t first=0;first<columns->rows;first+=SELECT_BLOCK){
+        memset(match,1,sizeof(match));
+        for(int p=0;p<npreds;p++){//the numeric predicates run over the whole block
+            predicate_t* pred = &preds[p];
+            if(pred->column==COL_NAME){
+                continue;
+            }
+            if(pred->mask){
+                filter_mask(columns->col[pred->column]+first,pred->lo,pred->negate,match);
+            }
+            else{
+                filter_range(columns->col[pred->column]+first,pred->lo,pred->hi,pred->negate,match);
+            }
+        }
+        uint32_t rows = columns->rows-first<SELECT_BLOCK?columns->rows-first:SELECT_BLOCK;
+        if(count_only&&!nnames){//nothing is printed or compared by name, so the block is only counted
+            matched += count_matches(match,rows);
+            continue;
+        }
+        for(uint32_t row=0;row<rows;row++){
+            if(!match[row]){
+                continue;
+            }
+            uint32_t entry = first+row;
+            int kept = 1;
+            for(int p=0;nnames&&kept&&p<npreds;p++){//names are only looked at for the rows left
+                if(preds[p].column==COL_NAME){
+                    kept = match_name(MODULE,&preds[p],columns->col[COL_NAME][entry]);
+                }
+            }
+            if(!kept){
+                continue;
+            }
+            matched++;
+            if(count_only){
+                continue;
+            }
+            fprintf(OUT,"%10u",entry);
+            switch(table){
+                case EH_IX_REL: print_rel_tab(entry,1,MODULE->RELTAB); break;
+                case EH_IX_REF: print_ref_tab(entry,1,MODULE->REFTAB,MODULE); break;
+                case EH_IX_SYM: print_sym_tab(entry,1,MODULE->SYMTAB,MODULE); break;
+            }
+        }
+    }
+    fprintf(OUT,"%u of %u %s entries match\n",matched,columns->rows,sections[table]);
+    return 0;
+}
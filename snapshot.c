@@ -0,0 +1,306 @@
+///author: jmp1617
+///purpose: copy-on-write snapshots of a module, a page of a section is copied only the first time it changes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///granularity of the copies, independent of the system page size
+#define SNAPSHOT_PAGE 4096
+#define SNAPSHOT_NAME 32
+
+///struct to hold one snapshot: the header when it was taken and the pages changed before the next was taken
+///a page missing here had then what it has in the next snapshot, or in the module after the newest
+struct snapshot{
+    char name[SNAPSHOT_NAME];
+    exec_t header;
+    uint32_t npages[N_EH];//pages of each section when the snapshot was taken
+    uint8_t** pages[N_EH];//saved copies, NULL until a page of the section changes
+    int whole[N_EH];//1 once every page is saved, which a resize or compact needs first
+    uint64_t saved;//bytes saved
+};
+
+///get the size in bytes of a section as a header has it
+///param: header, sec the EH_IX_ index
+///return: the size
+static uint64_t section_bytes(exec_t* header, int sec){
+    return (uint64_t)ntohl(header->data[sec])*get_unit(sec);
+}
+
+///get the length of one page of a section
+///param: bytes in the section, page
+///return: SNAPSHOT_PAGE, or less for the last page
+static size_t page_length(uint64_t bytes, uint32_t page){
+    uint64_t left = bytes-(uint64_t)page*SNAPSHOT_PAGE;
+    return left<SNAPSHOT_PAGE?left:SNAPSHOT_PAGE;
+}
+
+///find a snapshot by name
+///param: MODULE, name
+///return: its position, oldest first, -1 if there is none
+int find_snapshot(module_t* MODULE, char* name){
+    for(int s=0;s<MODULE->NSNAPSHOTS;s++){
+        if(!strcmp(MODULE->SNAPSHOTS[s]->name,name)){
+            return s;
+        }
+    }
+    return -1;
+}
+
+///take a snapshot, which copies nothing but the header until a section changes
+///param: MODULE, name of the snapshot, NULL to number it
+///return: 0 on success, 1 if the name is taken
+int take_snapshot(module_t* MODULE, char* name){
+    char number[SNAPSHOT_NAME];
+    if(!name){
+        int n = MODULE->NSNAPSHOTS+1;
+        do{
+            snprintf(number,sizeof(number),"%d",n++);
+        }while(find_snapshot(MODULE,number)>=0);
+        name = number;
+    }
+    if(strlen(name)>=SNAPSHOT_NAME){
+        fprintf(ERR,"error: snapshot names are at most %d characters\n",SNAPSHOT_NAME-1);
+        return 1;
+    }
+    if(find_snapshot(MODULE,name)>=0){
+        fprintf(ERR,"error: there is already a snapshot named '%s'\n",name);
+        return 1;
+    }
+    snapshot_t* snap = calloc(1,sizeof(snapshot_t));
+    strcpy(snap->name,name);
+    memcpy(&snap->header,MODULE->HEADER,sizeof(exec_t));
+    for(int sec=0;sec<N_EH;sec++){
+        snap->npages[sec] = (section_bytes(&snap->header,sec)+SNAPSHOT_PAGE-1)/SNAPSHOT_PAGE;
+    }
+    MODULE->SNAPSHOTS = realloc(MODULE->SNAPSHOTS,(MODULE->NSNAPSHOTS+1)*sizeof(snapshot_t*));
+    MODULE->SNAPSHOTS[MODULE->NSNAPSHOTS++] = snap;
+    stats_alloc(sizeof(snapshot_t));
+    fprintf(OUT,"Snapshot %s taken\n",name);
+    return 0;
+}
+
+///save the pages a change is about to overwrite into the newest snapshot, call before changing a section
+///param: MODULE, sec the EH_IX_ index, offset and bytes of the change
+void snapshot_touch(module_t* MODULE, int sec, uint64_t offset, uint64_t bytes){
+    if(!MODULE->NSNAPSHOTS||!bytes){
+        return;
+    }
+    snapshot_t* snap = MODULE->SNAPSHOTS[MODULE->NSNAPSHOTS-1];
+    if(snap->whole[sec]||sec==EH_IX_SBSS||sec==EH_IX_BSS){//zero sections are all in the header
+        return;
+    }
+    //not whole, so the section has the size it had when the snapshot was taken
+    uint8_t* data = *get_section(MODULE,sec);
+    uint64_t size = section_bytes(MODULE->HEADER,sec);
+    if(!snap->pages[sec]){
+        snap->pages[sec] = calloc(snap->npages[sec]?snap->npages[sec]:1,sizeof(uint8_t*));
+    }
+    uint32_t last = (offset+bytes-1)/SNAPSHOT_PAGE;
+    for(uint32_t page=offset/SNAPSHOT_PAGE;page<=last&&page<snap->npages[sec];page++){
+        if(!snap->pages[sec][page]){
+            size_t length = page_length(size,page);
+            snap->pages[sec][page] = malloc(length);
+            memcpy(snap->pages[sec][page],data+(uint64_t)page*SNAPSHOT_PAGE,length);
+            snap->saved += length;
+            stats_alloc(length);
+        }
+    }
+}
+
+///save every page of a section into the newest snapshot, call before it is resized or replaced
+///param: MODULE, sec the EH_IX_ index
+void snapshot_whole(module_t* MODULE, int sec){
+    if(!MODULE->NSNAPSHOTS){
+        return;
+    }
+    snapshot_touch(MODULE,sec,0,section_bytes(MODULE->HEADER,sec));
+    MODULE->SNAPSHOTS[MODULE->NSNAPSHOTS-1]->whole[sec] = 1;
+}
+
+///find what a page of a section held when a snapshot was taken
+///param: MODULE, s position of the snapshot, sec, page
+///return: the saved copy, NULL if the page has not changed since and the module still holds it
+static uint8_t* saved_page(module_t* MODULE, int s, int sec, uint32_t page){
+    //a snapshot that is not whole has the size of the one before, so the page is in range of each
+    for(;s<MODULE->NSNAPSHOTS;s++){
+        snapshot_t* snap = MODULE->SNAPSHOTS[s];
+        if(snap->pages[sec]&&page<snap->npages[sec]&&snap->pages[sec][page]){
+            return snap->pages[sec][page];
+        }
+    }
+    return NULL;
+}
+
+///check whether a section has changed since a snapshot was taken
+///param: MODULE, s position of the snapshot, sec
+///return: 1 if it has
+static int section_changed(module_t* MODULE, int s, int sec){
+    if(s<MODULE->NSNAPSHOTS&&MODULE->SNAPSHOTS[s]->header.data[sec]!=MODULE->HEADER->data[sec]){
+        return 1;
+    }
+    for(;s<MODULE->NSNAPSHOTS;s++){
+        if(MODULE->SNAPSHOTS[s]->pages[sec]){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+///copy a section as it was when a snapshot was taken
+///param: MODULE with the section loaded, s position of the snapshot, or NSNAPSHOTS for now, sec, to
+static void copy_section(module_t* MODULE, int s, int sec, uint8_t* to){
+    exec_t* header = s<MODULE->NSNAPSHOTS?&MODULE->SNAPSHOTS[s]->header:MODULE->HEADER;
+    uint64_t bytes = section_bytes(header,sec);
+    uint8_t* data = *get_section(MODULE,sec);
+    for(uint32_t page=0;(uint64_t)page*SNAPSHOT_PAGE<bytes;page++){
+        uint8_t* saved = saved_page(MODULE,s,sec,page);
+        memcpy(to+(uint64_t)page*SNAPSHOT_PAGE,saved?saved:data+(uint64_t)page*SNAPSHOT_PAGE,page_length(bytes,page));
+    }
+}
+
+///free the pages a snapshot saved
+///param: snap
+static void clear_snapshot(snapshot_t* snap){
+    for(int sec=0;sec<N_EH;sec++){
+        if(snap->pages[sec]){
+            for(uint32_t page=0;page<snap->npages[sec];page++){
+                free(snap->pages[sec][page]);
+            }
+            free(snap->pages[sec]);
+            snap->pages[sec] = NULL;
+        }
+        snap->whole[sec] = 0;
+    }
+    snap->saved = 0;
+}
+
+///put a module back the way it was when a snapshot was taken
+///the snapshots taken after it are dropped, the snapshot itself is kept to go back to again
+///param: MODULE, name of the snapshot
+///return: 0 on success, 1 if there is no such snapshot or memory ran out
+int restore_snapshot(module_t* MODULE, char* name){
+    int s = find_snapshot(MODULE,name);
+    if(s<0){
+        fprintf(ERR,"error: there is no snapshot named '%s'\n",name);
+        return 1;
+    }
+    snapshot_t* snap = MODULE->SNAPSHOTS[s];
+    uint32_t restored = 0;
+    for(int sec=0;sec<N_EH;sec++){
+        if(!section_changed(MODULE,s,sec)){
+            continue;
+        }
+        void** slot = get_section(MODULE,sec);
+        uint64_t bytes = section_bytes(&snap->header,sec);
+        if(sec==EH_IX_SBSS||sec==EH_IX_BSS){
+            uint8_t* zero = NULL;
+            if(bytes&&!(zero = map_zero(bytes))){
+                fprintf(ERR,"error: not enough memory to restore %s\n",name);
+                return 1;
+            }
+            release_section(MODULE,sec);//sized from the header, which still has the current size
+            *slot = zero;
+        }
+        else if(snap->header.data[sec]==MODULE->HEADER->data[sec]){
+            //same size, so only the pages that changed are copied back
+            for(uint32_t page=0;page<snap->npages[sec];page++){
+                uint8_t* saved = saved_page(MODULE,s,sec,page);
+                if(saved){
+                    memcpy((uint8_t*)*slot+(uint64_t)page*SNAPSHOT_PAGE,saved,page_length(bytes,page));
+                }
+            }
+        }
+        else{
+            //resized since, so a snapshot from then on holds every page
+            uint8_t* data = NULL;
+            if(bytes&&!(data = malloc(bytes))){
+                fprintf(ERR,"error: not enough memory to restore %s\n",name);
+                return 1;
+            }
+            stats_alloc(bytes);
+            if(bytes){
+                copy_section(MODULE,s,sec,data);
+            }
+            release_section(MODULE,sec);
+            *slot = data;
+        }
+        MODULE->HEADER->data[sec] = snap->header.data[sec];//so release_section sizes the zero sections right
+        restored++;
+    }
+    memcpy(MODULE->HEADER,&snap->header,sizeof(exec_t));
+    //the module is the snapshot again, so it has nothing saved and nothing after it
+    for(int later=s+1;later<MODULE->NSNAPSHOTS;later++){
+        clear_snapshot(MODULE->SNAPSHOTS[later]);
+        free(MODULE->SNAPSHOTS[later]);
+    }
+    MODULE->NSNAPSHOTS = s+1;
+    clear_snapshot(snap);
+    invalidate_indexes(MODULE,EH_IX_STR,1);
+    fprintf(OUT,"Restored %u section%s\n",restored,restored==1?"":"s");
+    return 0;
+}
+
+///make a new module holding a module as it is, or as it was when a snapshot was taken
+///sections that were never read are left for the branch to read from the same file
+///param: MODULE, name of the snapshot, NULL for the module as it is
+///return: the branch, NULL on error
+module_t* branch_module(module_t* MODULE, char* name){
+    int s = MODULE->NSNAPSHOTS;
+    if(name&&(s = find_snapshot(MODULE,name))<0){
+        fprintf(ERR,"error: there is no snapshot named '%s'\n",name);
+        return NULL;
+    }
+    exec_t* header = s<MODULE->NSNAPSHOTS?&MODULE->SNAPSHOTS[s]->header:MODULE->HEADER;
+    module_t* BRANCH = create_module(header);
+    if(!BRANCH){
+        fprintf(ERR,"error: not enough memory to branch\n");
+        return NULL;
+    }
+    BRANCH->GUARD = MODULE->GUARD;
+    BRANCH->LITTLE = MODULE->LITTLE;
+    BRANCH->PATH = MODULE->PATH?strdup(MODULE->PATH):NULL;
+    BRANCH->FD = MODULE->FD>=0?dup(MODULE->FD):-1;
+    memcpy(BRANCH->OFFSET,MODULE->OFFSET,sizeof(BRANCH->OFFSET));
+    for(int sec=0;sec<N_EH;sec++){
+        if(sec==EH_IX_SBSS||sec==EH_IX_BSS||!section_bytes(header,sec)){
+            continue;
+        }
+        if(!(MODULE->LOADED&SECTION_BIT(sec))&&!section_changed(MODULE,s,sec)){
+            BRANCH->LOADED &= ~SECTION_BIT(sec);
+            continue;
+        }
+        if(load_sections(MODULE,SECTION_BIT(sec))){
+            destroy_module(BRANCH);
+            return NULL;
+        }
+        copy_section(MODULE,s,sec,*get_section(BRANCH,sec));
+    }
+    return BRANCH;
+}
+
+///list the snapshots of a module, oldest first
+///param: MODULE
+void print_snapshots(module_t* MODULE){
+    if(!MODULE->NSNAPSHOTS){
+        fprintf(OUT,"There are no snapshots\n");
+    }
+    for(int s=0;s<MODULE->NSNAPSHOTS;s++){
+        snapshot_t* snap = MODULE->SNAPSHOTS[s];
+        fprintf(OUT,"%-16s %llu bytes saved\n",snap->name,(unsigned long long)snap->saved);
+    }
+}
+
+///free every snapshot of a module
+///param: MODULE
+void destroy_snapshots(module_t* MODULE){
+    for(int s=0;s<MODULE->NSNAPSHOTS;s++){
+        clear_snapshot(MODULE->SNAPSHOTS[s]);
+        free(MODULE->SNAPSHOTS[s]);
+    }
+    free(MODULE->SNAPSHOTS);
+    MODULE->SNAPSHOTS = NULL;
+    MODULE->NSNAPSHOTS = 0;
+}
@@ -0,0 +1,148 @@
+///author: jmp1617
+///purpose: counters and latency timers for commands, loading and writing
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lmedit.h"
+
+///latency buckets: exact below 8ns, then 8 per power of two
+#define STAT_BUCKETS 496
+
+///struct to hold the counters of one command or stage
+typedef struct stat{
+    uint64_t count;
+    uint64_t total;//nanoseconds
+    uint64_t max;
+    uint32_t buckets[STAT_BUCKETS];
+}stat_t;
+
+static stat_t stats[N_STATS];
+static uint64_t bytes_read;
+static uint64_t bytes_written;
+static uint64_t allocations;
+static uint64_t allocated;
+
+///names of the commands and stages, in stat_id order
+static char* stat_names[N_STATS] = {
+    "quit","size","write","compact","validate","history","section","resize","run","cfg",
+    "xref","guard","format","stats","cache","module","copy","snapshot","restore",
+    "branch","recall","examine","edit","assemble","select","content","parse","check",
+    "load_header","load_arena","load_sections","load_index","serialize","write_file"
+};
+
+///get a monotonic timestamp
+///return: nanoseconds from an arbitrary point
+uint64_t stats_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (uint64_t)now.tv_sec*1000000000ull+now.tv_nsec;
+}
+
+///get the bucket for a latency
+///param: ns latency
+///return: the bucket index
+static int stat_bucket(uint64_t ns){
+    if(ns<8){
+        return ns;
+    }
+    int e = 63-__builtin_clzll(ns);
+    return (e-2)*8+((ns>>(e-3))&7);
+}
+
+///get the largest latency in a bucket
+///param: bucket index
+///return: nanoseconds
+static uint64_t stat_bucket_top(int bucket){
+    if(bucket<8){
+        return bucket;
+    }
+    int e = bucket/8+2;
+    return ((uint64_t)(8+bucket%8+1)<<(e-3))-1;
+}
+
+///record one run of a command or stage
+///param: stat the stat_id, began timestamp from stats_now
+void stats_record(int stat, uint64_t began){
+    uint64_t ns = stats_now()-began;
+    uint64_t max = __atomic_load_n(&stats[stat].max,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats[stat].count,1,__ATOMIC_RELAXED);//daemon clients record at the same time
+    __atomic_add_fetch(&stats[stat].total,ns,__ATOMIC_RELAXED);
+    while(ns>max&&!__atomic_compare_exchange_n(&stats[stat].max,&max,ns,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+    __atomic_add_fetch(&stats[stat].buckets[stat_bucket(ns)],1,__ATOMIC_RELAXED);
+}
+
+///count bytes moved to or from module files
+///param: read bytes read, written bytes written
+void stats_io(uint64_t read, uint64_t written){
+    __atomic_add_fetch(&bytes_read,read,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&bytes_written,written,__ATOMIC_RELAXED);
+}
+
+///count an allocation made for module data
+///param: bytes allocated
+void stats_alloc(uint64_t bytes){
+    __atomic_add_fetch(&allocations,1,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&allocated,bytes,__ATOMIC_RELAXED);
+}
+
+///get the 99th percentile latency of a stat
+///param: stat
+///return: nanoseconds, the top of the bucket holding it
+static uint64_t stat_p99(stat_t* stat){
+    uint64_t rank = (stat->count*99+99)/100, seen = 0;
+    for(int bucket=0;bucket<STAT_BUCKETS;bucket++){
+        seen += stat->buckets[bucket];
+        if(seen>=rank){
+            uint64_t top = stat_bucket_top(bucket);
+            return top<stat->max?top:stat->max;
+        }
+    }
+    return stat->max;
+}
+
+///print the counters of every command and stage that has run
+void print_stats(void){
+    fprintf(OUT,"%-14s %10s %12s %10s %10s\n","command","count","total ms","mean us","p99 us");
+    for(int stat=0;stat<N_STATS;stat++){
+        stat_t* s = &stats[stat];
+        if(s->count){
+            fprintf(OUT,"%-14s %10llu %12.3f %10.1f %10.1f\n",stat_names[stat],(unsigned long long)s->count,
+                    s->total/1e6,s->total/1e3/s->count,stat_p99(s)/1e3);
+        }
+    }
+    fprintf(OUT,"Read %llu bytes, wrote %llu bytes, %llu allocations (%llu bytes)\n",(unsigned long long)bytes_read,
+            (unsigned long long)bytes_written,(unsigned long long)allocations,(unsigned long long)allocated);
+}
+
+///write every counter as JSON
+///param: out
+void write_stats_json(FILE* out){
+    fprintf(out,"{\"commands\":{");
+    for(int stat=0,first=1;stat<N_STATS;stat++){
+        stat_t* s = &stats[stat];
+        if(s->count){
+            fprintf(out,"%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"mean_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}",
+                    first?"":",",stat_names[stat],(unsigned long long)s->count,(unsigned long long)s->total,
+                    (unsigned long long)(s->total/s->count),(unsigned long long)stat_p99(s),(unsigned long long)s->max);
+            first = 0;
+        }
+    }
+    fprintf(out,"},\"bytes_read\":%llu,\"bytes_written\":%llu,\"allocations\":%llu,\"allocated_bytes\":%llu}\n",
+            (unsigned long long)bytes_read,(unsigned long long)bytes_written,
+            (unsigned long long)allocations,(unsigned long long)allocated);
+}
+
+///write the counters to the file named by LMEDIT_STATS, registered with atexit
+void dump_stats(void){
+    char* path = getenv("LMEDIT_STATS");
+    FILE* out = path?fopen(path,"w"):NULL;
+    if(!out){
+        if(path){
+            perror(path);
+        }
+        return;
+    }
+    write_stats_json(out);
+    fclose(out);
+}
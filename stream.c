@@ -0,0 +1,499 @@
+///author: jmp1617
+///purpose: run a script of commands on a module through one fixed size window, for modules larger than memory
+///nothing but the header is kept, sections are read a window at a time and edits are applied while copying
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///window used when LMEDIT_WINDOW does not give one, and the smallest allowed
+#define STREAM_WINDOW (1<<20)
+#define STREAM_MIN_WINDOW 4096
+///longest pattern search takes, and longest name read from the string table
+#define STREAM_MAX_PATTERN 64
+#define STREAM_MAX_NAME 4096
+
+///struct to hold an edit waiting to be written: width bytes of value every stride bytes from start to end
+typedef struct patch{
+    uint64_t start;//file offset of the first field
+    uint64_t end;//one past the last byte of the last field
+    uint32_t stride;
+    uint32_t width;
+    uint8_t value[8];//in file byte order
+    uint32_t seq;//order in the script, later edits win where they overlap
+}patch_t;
+
+///struct to hold the open module
+typedef struct stream{
+    char* file;
+    int fd;
+    uint64_t length;
+    exec_t header;//big endian, whatever the file is
+    module_t shell;//holds only the header, for the checks shared with the editor
+    uint64_t offset[N_EH];//where each section starts in the file
+    uint8_t* window;
+    size_t window_size;
+    patch_t* patches;
+    uint32_t npatches;
+    uint32_t cap;
+}stream_t;
+
+///read part of the module, asking the kernel to start on the window after it
+///param: stream, offset in the file, buf, len
+///return: 0 on success 1 on error
+static int stream_read(stream_t* stream, uint64_t offset, void* buf, size_t len){
+    posix_fadvise(stream->fd,offset+len,stream->window_size,POSIX_FADV_WILLNEED);
+    for(size_t done=0;done<len;){
+        ssize_t got = pread(stream->fd,(uint8_t*)buf+done,len-done,offset+done);
+        if(got<0&&errno==EINTR){
+            continue;
+        }
+        if(got<=0){
+            fprintf(ERR,"error: %s could not be read: %s\n",stream->file,got?strerror(errno):"the file is truncated");
+            return 1;
+        }
+        done += got;
+    }
+    stats_io(len,0);
+    return 0;
+}
+
+///read part of a section, the sbss and bss that version 2 modules do not store read as zeros
+///param: stream, sec the EH_IX_ index, from offset in the section, buf, len
+///return: 0 on success 1 on error
+static int stream_section(stream_t* stream, int sec, uint64_t from, void* buf, size_t len){
+    if(!stream->offset[sec]){
+        memset(buf,0,len);
+        return 0;
+    }
+    return stream_read(stream,stream->offset[sec]+from,buf,len);
+}
+
+///open the module and read its header
+///param: stream to fill in, file
+///return: 0 on success 1 on error
+static int stream_open(stream_t* stream, char* file){
+    struct stat st;
+    stream->file = file;
+    stream->fd = open(file,O_RDONLY|O_CLOEXEC);
+    if(stream->fd<0||fstat(stream->fd,&st)){
+        perror(file);
+        return 1;
+    }
+    stream->length = st.st_size;
+    if(st.st_size<HEADER_SIZE||stream_read(stream,0,&stream->header,HEADER_SIZE)){
+        fprintf(ERR,"error: %s: the header is truncated\n",file);
+        return 1;
+    }
+    stream->shell.LITTLE = le16toh(stream->header.magic)==HDR_MAGIC;
+    if(ntohs(stream->header.magic)!=HDR_MAGIC&&!stream->shell.LITTLE){
+        fprintf(ERR,"error: %s is not an R2K object module (magic number 0x%x)\n",file,ntohs(stream->header.magic));
+        return 1;
+    }
+    if(stream->shell.LITTLE){//only read, the header is copied to the new file as it is in the old
+        swap_header(&stream->header);
+    }
+    if(read_layout(stream->fd,file,&stream->header,stream->shell.LITTLE,stream->length,stream->offset)){
+        return 1;
+    }
+    stream->shell.HEADER = &stream->header;
+    posix_fadvise(stream->fd,0,0,POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+///get a name from the string table
+///param: stream, index into the table, name set to the string
+static void stream_string(stream_t* stream, uint32_t index, char name[STREAM_MAX_NAME]){
+    uint32_t size = ntohl(stream->header.data[EH_IX_STR]);
+    size_t len = size>index?size-index:0;
+    if(len>STREAM_MAX_NAME-1){
+        len = STREAM_MAX_NAME-1;//longer names are cut short
+    }
+    if(!len||stream_read(stream,stream->offset[EH_IX_STR]+index,name,len)
+       ||(!memchr(name,'\0',len)&&len<STREAM_MAX_NAME-1)){
+        strcpy(name,"(bad string index)");
+        return;
+    }
+    name[len] = '\0';
+}
+
+///print entries or units of a section a window at a time, in the editor's format
+///param: stream, sec the EH_IX_ index, commands from proccess_x_command
+static void stream_examine(stream_t* stream, int sec, unsigned int commands[6]){
+    static char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    char name[STREAM_MAX_NAME];
+    int little = stream->shell.LITTLE;
+    const access_t* access = get_access(commands[2],little);
+    uint32_t width = get_unit(sec)>1?get_unit(sec):access->width;
+    uint32_t address = commands[0];
+    uint32_t start = get_unit(sec)>1||!stream->header.entry?0:get_start(&stream->shell,sections[sec]);
+    uint64_t remaining = commands[1];
+    while(remaining){
+        uint64_t units = stream->window_size/width;
+        if(units>remaining){
+            units = remaining;
+        }
+        uint64_t from = (uint64_t)(address-start)*(get_unit(sec)>1?width:1);
+        if(stream_section(stream,sec,from,stream->window,units*width)){
+            return;
+        }
+        for(uint64_t unit=0;unit<units;unit++){
+            uint8_t* at = stream->window+unit*width;
+            uint32_t word0 = 0, word1, word2;
+            memcpy(&word0,at,4<width?4:width);
+            if(sec==EH_IX_REL){
+                relent_t* rel = (relent_t*)at;
+                char* to = rel->section>=1&&rel->section<=EH_IX_BSS+1?sections[rel->section-1]:"bad section";
+                fprintf(OUT,"   0x%08x (%s) type %#06x\n",SECTION_WORD(little,word0),to,rel->type);
+            }
+            else if(sec==EH_IX_REF){
+                refent_t* ref = (refent_t*)at;
+                stream_string(stream,SECTION_WORD(little,ref->sym),name);
+                fprintf(OUT,"   0x%08x type %#06x symbol %s\n",SECTION_WORD(little,word0),ref->type,name);
+            }
+            else if(sec==EH_IX_SYM){
+                memcpy(&word1,at+4,4);
+                memcpy(&word2,at+8,4);
+                stream_string(stream,SECTION_WORD(little,word2),name);
+                fprintf(OUT,"   value 0x%08x flags %#010x symbol %s\n",SECTION_WORD(little,word1),
+                        SECTION_WORD(little,word0),name);
+            }
+            else{
+                fprintf(OUT,"   0x%08x = 0x%0*llx\n",address,(int)width*2,(unsigned long long)access->load(at));
+            }
+            address += get_unit(sec)>1?1:width;
+        }
+        remaining -= units;
+    }
+}
+
+///queue an edit to be applied by the next write
+///check_for_errors has made sure the value fits in the field
+///param: stream, sec the EH_IX_ index, commands from proccess_x_command
+static void stream_edit(stream_t* stream, int sec, unsigned int commands[6]){
+    static char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    patch_t patch = {0};
+    uint32_t field = 0;//offset of the field in a table entry
+    uint64_t change = (uint64_t)commands[5]<<32|commands[3];
+    if(get_unit(sec)>1){
+        switch(commands[2]){
+            case 's': field = sec==EH_IX_REL?4:8; patch.width = 1; break;
+            case 't': field = sec==EH_IX_REL?5:9; patch.width = 1; break;
+            case 'y': field = sec==EH_IX_REF?4:8; patch.width = 4; break;
+            case 'v': field = 4; patch.width = 4; break;
+            default: field = 0; patch.width = 4; break;//a (addr) and f (flags)
+        }
+        patch.stride = get_unit(sec);
+        patch.start = stream->offset[sec]+(uint64_t)commands[0]*patch.stride+field;
+    }
+    else{
+        uint32_t start = stream->header.entry?get_start(&stream->shell,sections[sec]):0;
+        patch.width = patch.stride = type_width(commands[2]);
+        patch.start = stream->offset[sec]+commands[0]-start;
+    }
+    //the value is stored once, in the module's byte order, and copied into every field on write
+    char type = get_unit(sec)>1?(patch.width==4?'w':'b'):commands[2];
+    get_access(type,stream->shell.LITTLE)->fill(patch.value,change,1);
+    patch.end = patch.start+(uint64_t)(commands[1]-1)*patch.stride+patch.width;
+    patch.seq = stream->npatches;
+    if(stream->npatches==stream->cap){
+        stream->cap = stream->cap?stream->cap*2:64;
+        stream->patches = realloc(stream->patches,stream->cap*sizeof(patch_t));
+    }
+    stream->patches[stream->npatches++] = patch;
+    fprintf(OUT,"   %#x,%u is now %#llx (on write)\n",commands[0],commands[1],(unsigned long long)change);
+}
+
+///compare two patches by start then order in the script
+static int compare_patch_start(const void* a, const void* b){
+    const patch_t* x = a;
+    const patch_t* y = b;
+    if(x->start!=y->start){
+        return x->start<y->start?-1:1;
+    }
+    return x->seq<y->seq?-1:x->seq>y->seq;
+}
+
+///compare two patches by order in the script
+static int compare_patch_seq(const void* a, const void* b){
+    uint32_t x = (*(patch_t* const*)a)->seq, y = (*(patch_t* const*)b)->seq;
+    return x<y?-1:x>y;
+}
+
+///apply the part of a patch that falls in a window
+///param: patch, window, from offset of the window in the file, len of the window
+static void apply_patch(patch_t* patch, uint8_t* window, uint64_t from, uint64_t len){
+    uint64_t first = from>patch->start?(from-patch->start)/patch->stride:0;
+    for(uint64_t at=patch->start+first*patch->stride;at<patch->end&&at<from+len;at+=patch->stride){
+        for(uint32_t byte=0;byte<patch->width;byte++){
+            if(at+byte>=from&&at+byte<from+len){
+                window[at+byte-from] = patch->value[byte];
+            }
+        }
+    }
+}
+
+///copy the module to a temporary file a window at a time with the queued edits applied, then replace it
+///param: stream
+///return: 0 on success 1 on error
+static int stream_write(stream_t* stream){
+    char target[PATH_MAX], tmpname[PATH_MAX+4];
+    int out = open_replacement(stream->file,target,tmpname);
+    if(out<0){
+        return 1;
+    }
+    //patches are taken in order of start and applied to each window in script order
+    qsort(stream->patches,stream->npatches,sizeof(patch_t),compare_patch_start);
+    patch_t** active = malloc((stream->npatches+1)*sizeof(patch_t*));
+    uint32_t nactive = 0, next = 0;
+    int failed = 0;
+    for(uint64_t from=0;from<stream->length&&!failed;from+=stream->window_size){
+        uint64_t len = stream->length-from<stream->window_size?stream->length-from:stream->window_size;
+        failed = stream_read(stream,from,stream->window,len);
+        uint32_t kept = 0;
+        for(uint32_t p=0;p<nactive;p++){
+            if(active[p]->end>from){
+                active[kept++] = active[p];
+            }
+        }
+        nactive = kept;
+        while(next<stream->npatches&&stream->patches[next].start<from+len){
+            active[nactive++] = &stream->patches[next++];
+        }
+        qsort(active,nactive,sizeof(patch_t*),compare_patch_seq);
+        for(uint32_t p=0;p<nactive;p++){
+            apply_patch(active[p],stream->window,from,len);
+        }
+        for(uint64_t done=0;done<len&&!failed;){
+            ssize_t put = write(out,stream->window+done,len-done);
+            if(put<0&&errno==EINTR){
+                continue;
+            }
+            failed = put<=0;
+            done += put;
+        }
+    }
+    free(active);
+    if(close_replacement(out,target,tmpname,failed)){
+        return 1;
+    }
+    stats_io(0,stream->length);
+    //later commands read the new file
+    close(stream->fd);
+    stream->fd = open(stream->file,O_RDONLY|O_CLOEXEC);
+    if(stream->fd<0){
+        fprintf(ERR,"error: %s could not be reopened: %s\n",stream->file,strerror(errno));
+        return 1;
+    }
+    stream->npatches = 0;
+    return 0;
+}
+
+///parse a search pattern: hex digits, or text in double quotes
+///param: arg, pattern set to the bytes
+///return: length of the pattern, 0 if it is not understood
+static size_t parse_pattern(char* arg, uint8_t pattern[STREAM_MAX_PATTERN]){
+    size_t len = 0;
+    if(arg[0]=='"'){
+        char* end = strrchr(arg+1,'"');
+        if(!end||end==arg+1||end-arg-1>STREAM_MAX_PATTERN){
+            return 0;
+        }
+        len = end-arg-1;
+        memcpy(pattern,arg+1,len);
+        return len;
+    }
+    if(!strncmp(arg,"0x",2)){
+        arg += 2;
+    }
+    for(;arg[0]&&arg[1]&&len<STREAM_MAX_PATTERN;arg+=2){
+        unsigned int byte;
+        if(sscanf(arg,"%2x",&byte)!=1){
+            return 0;
+        }
+        pattern[len++] = byte;
+    }
+    return arg[0]?0:len;
+}
+
+///print the address of every match of a pattern in a section
+///windows overlap by one byte less than the pattern so matches across them are found
+///param: stream, sec the EH_IX_ index, pattern, len
+static void stream_search(stream_t* stream, int sec, uint8_t* pattern, size_t len){
+    static char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    uint64_t size = (uint64_t)ntohl(stream->header.data[sec])*get_unit(sec);
+    uint32_t start = get_unit(sec)==1&&stream->header.entry?get_start(&stream->shell,sections[sec]):0;
+    uint64_t matches = 0;
+    for(uint64_t from=0;from+len<=size;from+=stream->window_size-(len-1)){
+        uint64_t n = size-from<stream->window_size?size-from:stream->window_size;
+        if(stream_section(stream,sec,from,stream->window,n)){
+            return;
+        }
+        for(uint8_t* at=stream->window;(at=memchr(at,pattern[0],stream->window+n-at));at++){
+            if(at+len>stream->window+n){
+                break;
+            }
+            if(!memcmp(at,pattern,len)){
+                uint64_t offset = from+(at-stream->window);
+                if(get_unit(sec)>1){
+                    fprintf(OUT,"   entry %llu byte %llu\n",(unsigned long long)(offset/get_unit(sec)),
+                            (unsigned long long)(offset%get_unit(sec)));
+                }
+                else{
+                    fprintf(OUT,"   0x%08x\n",(uint32_t)(start+offset));
+                }
+                matches++;
+            }
+        }
+        if(from+n>=size){
+            break;
+        }
+    }
+    fprintf(OUT,"%llu match%s in %s\n",(unsigned long long)matches,matches==1?"":"es",sections[sec]);
+}
+
+///hash the bytes of a section in the file with FNV-1a
+///param: stream, sec the EH_IX_ index, hash set to the result
+///return: 0 on success 1 on error
+static int stream_hash(stream_t* stream, int sec, uint64_t* hash){
+    uint64_t size = (uint64_t)ntohl(stream->header.data[sec])*get_unit(sec);
+    *hash = 0xcbf29ce484222325ull;
+    for(uint64_t from=0;from<size;from+=stream->window_size){
+        uint64_t n = size-from<stream->window_size?size-from:stream->window_size;
+        if(stream_section(stream,sec,from,stream->window,n)){
+            return 1;
+        }
+        for(uint64_t byte=0;byte<n;byte++){
+            *hash = (*hash^stream->window[byte])*0x100000001b3ull;
+        }
+    }
+    return 0;
+}
+
+///copy the bytes of a section to a file
+///param: stream, sec the EH_IX_ index, path of the file
+static void stream_dump(stream_t* stream, int sec, char* path){
+    uint64_t size = (uint64_t)ntohl(stream->header.data[sec])*get_unit(sec);
+    FILE* out = fopen(path,"w");
+    if(!out){
+        perror(path);
+        return;
+    }
+    int failed = 0;
+    for(uint64_t from=0;from<size&&!failed;from+=stream->window_size){
+        uint64_t n = size-from<stream->window_size?size-from:stream->window_size;
+        failed = stream_section(stream,sec,from,stream->window,n)||fwrite(stream->window,1,n,out)!=n;
+    }
+    if(fclose(out)||failed){
+        perror(path);
+        return;
+    }
+    fprintf(OUT,"Wrote %llu bytes to %s\n",(unsigned long long)size,path);
+}
+
+///run a script of commands read from stdin on a module without loading it
+///param: file of the module
+///return: 0 on success, 1 if the module could not be opened or edits were left unwritten
+int stream_module(char* file){
+    static char* sections[] = {"text","rdata","data","sdata","sbss","bss","reltab","reftab","symtab","strings"};
+    stream_t stream = {0};
+    char* window = getenv("LMEDIT_WINDOW");
+    stream.window_size = window?strtoull(window,NULL,0):STREAM_WINDOW;
+    if(stream.window_size<STREAM_MIN_WINDOW){
+        stream.window_size = STREAM_MIN_WINDOW;
+    }
+    stream.window_size -= stream.window_size%24;//a whole number of entries of every table
+    if(stream_open(&stream,file)||!(stream.window = malloc(stream.window_size))){
+        if(stream.fd>=0){
+            close(stream.fd);
+        }
+        return 1;
+    }
+    stats_alloc(stream.window_size);
+    char section[10] = "text";
+    char buf[COMMAND_SIZE];
+    char arg[COMMAND_SIZE], path[COMMAND_SIZE];
+    while(fgets(buf,sizeof(buf),stdin)){
+        buf[strcspn(buf,"\r\n")] = '\0';
+        unsigned int x_command[6] = {0};
+        uint8_t pattern[STREAM_MAX_PATTERN];
+        if(!buf[0]){
+            continue;
+        }
+        if(!strcmp(buf,"quit")){
+            break;
+        }
+        if(!strcmp(buf,"size")){
+            print_size(&stream.shell,section);
+        }
+        else if(sscanf(buf,"section %31s",arg)==1){
+            if(!select_section(&stream.shell,arg)){
+                strcpy(section,arg);
+            }
+        }
+        else if(!strcmp(buf,"write")){
+            if(!stream.npatches){
+                fprintf(OUT,"There have been no changes: nothing to write\n");
+            }
+            else{
+                stream_write(&stream);
+            }
+        }
+        else if(!strncmp(buf,"hash",4)&&(buf[4]=='\0'||buf[4]==' ')){
+            int only = sscanf(buf,"hash %31s",arg)==1?get_index(arg):-1;
+            if(buf[4]&&only<0){
+                fprintf(ERR,"error: '%s' is not a valid section name\n",arg);
+                continue;
+            }
+            for(int sec=0;sec<N_EH;sec++){
+                uint64_t hash;
+                if((only<0&&stream.header.data[sec])||sec==only){
+                    if(stream_hash(&stream,sec,&hash)){
+                        break;
+                    }
+                    fprintf(OUT,"%-8s 0x%016llx\n",sections[sec],(unsigned long long)hash);
+                }
+            }
+        }
+        else if(sscanf(buf,"search %127s",arg)==1){
+            size_t len = parse_pattern(buf+7,pattern);
+            if(!len){
+                fprintf(ERR,"error: '%s' is not a pattern, use hex digits or \"text\" (at most %d bytes)\n",
+                        buf+7,STREAM_MAX_PATTERN);
+            }
+            else{
+                stream_search(&stream,get_index(section),pattern,len);
+            }
+        }
+        else if(sscanf(buf,"dump %127s",path)==1){
+            stream_dump(&stream,get_index(section),path);
+        }
+        else if(strstr(buf,":i=")){//only the header is resident, so symbols cannot be used
+            if(!assemble_command(NULL,buf,section,x_command)&&!check_for_errors(x_command,section,&stream.shell)){
+                stream_edit(&stream,get_index(section),x_command);
+            }
+        }
+        else if(!proccess_x_command(x_command,buf)&&!check_for_errors(x_command,section,&stream.shell)){
+            if(x_command[4]==1||x_command[4]==3){
+                stream_edit(&stream,get_index(section),x_command);
+            }
+            else{
+                stream_examine(&stream,get_index(section),x_command);
+            }
+        }
+        fflush(OUT);
+    }
+    if(stream.npatches){
+        fprintf(ERR,"error: %u edit%s were not written\n",stream.npatches,stream.npatches==1?"":"s");
+    }
+    int failed = stream.npatches!=0;
+    close(stream.fd);
+    free(stream.window);
+    free(stream.patches);
+    return failed;
+}
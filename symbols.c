@@ -0,0 +1,158 @@
+///author: jmp1617
+///purpose: symtab indexes by name and by value
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///struct to hold the symbol indexes, either allocated or pointing into a cache mapping
+struct symindex{
+    uint32_t nsyms;
+    uint32_t* by_value;//symtab entries sorted by value, NULL until first needed
+    uint32_t nbuckets;//power of two
+    uint32_t* buckets;//symtab entry + 1 hashed by name, 0 when empty
+    int mapped;//1 if the arrays belong to the cache, whose values are checked before they are used
+    int checked;//1 once the order by value from the cache has been checked
+};
+
+///symtab being sorted, qsort has no context argument
+static __thread syment_t* sorting;
+
+///compare two symtab entries by value then entry
+static int compare_values(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    uint32_t vx = ntohl(sorting[x].value), vy = ntohl(sorting[y].value);
+    if(vx!=vy){
+        return vx<vy?-1:1;
+    }
+    return x<y?-1:x>y;
+}
+
+///get the bucket count for a number of symbols, at most half full
+///param: nsyms
+///return: a power of two
+static uint32_t symindex_buckets(uint32_t nsyms){
+    uint32_t buckets = 16;
+    while(buckets<2ull*nsyms){
+        buckets <<= 1;
+    }
+    return buckets;
+}
+
+///build the index of the symtab by name, the order by value is sorted the first time it is asked for
+///param: MODULE
+///return: the index
+symindex_t* build_symindex(module_t* MODULE){
+    symindex_t* index = calloc(1,sizeof(symindex_t));
+    index->nsyms = get_size("symtab",MODULE);
+    index->nbuckets = symindex_buckets(index->nsyms);
+    index->buckets = calloc(index->nbuckets,sizeof(uint32_t));
+    for(uint32_t entry=0;entry<index->nsyms;entry++){
+        char* name = get_string(MODULE,ntohl(MODULE->SYMTAB[entry].sym));
+        uint32_t bucket = hash_string(name,strlen(name))&(index->nbuckets-1);
+        while(index->buckets[bucket]){
+            if(!strcmp(get_string(MODULE,ntohl(MODULE->SYMTAB[index->buckets[bucket]-1].sym)),name)){
+                break;//the first entry with a name wins
+            }
+            bucket = (bucket+1)&(index->nbuckets-1);
+        }
+        if(!index->buckets[bucket]){
+            index->buckets[bucket] = entry+1;
+        }
+    }
+    return index;
+}
+
+///make an index from arrays in the cache
+///param: nsyms, by_value, nbuckets, buckets
+///return: the index, which does not free the arrays
+symindex_t* adopt_symindex(uint32_t nsyms, uint32_t* by_value, uint32_t nbuckets, uint32_t* buckets){
+    symindex_t* index = calloc(1,sizeof(symindex_t));
+    index->nsyms = nsyms;
+    index->by_value = by_value;
+    index->nbuckets = nbuckets;
+    index->buckets = buckets;
+    index->mapped = 1;
+    return index;
+}
+
+///get the arrays of an index so they can be cached
+///param: index, by_value, nbuckets, buckets set to the arrays and bucket count
+///return: number of symbols
+uint32_t symindex_arrays(symindex_t* index, uint32_t** by_value, uint32_t* nbuckets, uint32_t** buckets){
+    *by_value = index->by_value;
+    *nbuckets = index->nbuckets;
+    *buckets = index->buckets;
+    return index->nsyms;
+}
+
+///get the symbol indexes of a module, building them the first time
+///param: MODULE
+///return: the index
+static symindex_t* get_symindex(module_t* MODULE){
+    load_indexes(MODULE);
+    if(!MODULE->SYMBOLS){
+        MODULE->SYMBOLS = build_symindex(MODULE);
+    }
+    return MODULE->SYMBOLS;
+}
+
+///find a symbol by name
+///a probe visits each bucket at most once and stops at an entry past the symtab, for buckets from a cache
+///param: MODULE, name
+///return: the symtab entry, -1 if there is none
+int64_t find_symbol(module_t* MODULE, char* name){
+    symindex_t* index = get_symindex(MODULE);
+    uint32_t bucket = hash_string(name,strlen(name))&(index->nbuckets-1);
+    for(uint32_t probe=0;probe<index->nbuckets&&index->buckets[bucket];probe++){
+        uint32_t entry = index->buckets[bucket]-1;
+        if(entry>=index->nsyms){
+            break;
+        }
+        if(!strcmp(get_string(MODULE,ntohl(MODULE->SYMTAB[entry].sym)),name)){
+            return entry;
+        }
+        bucket = (bucket+1)&(index->nbuckets-1);
+    }
+    return -1;
+}
+
+///get the symtab entries in value order
+///param: MODULE, nsyms set to the number of entries
+///return: the entries, owned by the index
+uint32_t* symbols_by_value(module_t* MODULE, uint32_t* nsyms){
+    symindex_t* index = get_symindex(MODULE);
+    if(index->mapped&&!index->checked){
+        index->checked = 1;
+        for(uint32_t entry=0;entry<index->nsyms;entry++){
+            if(index->by_value[entry]>=index->nsyms){//a damaged cache, build the indexes instead
+                destroy_symindex(index);
+                index = MODULE->SYMBOLS = build_symindex(MODULE);
+                break;
+            }
+        }
+    }
+    if(!index->by_value){
+        index->by_value = malloc((index->nsyms+1)*sizeof(uint32_t));
+        for(uint32_t entry=0;entry<index->nsyms;entry++){
+            index->by_value[entry] = entry;
+        }
+        sorting = MODULE->SYMTAB;
+        qsort(index->by_value,index->nsyms,sizeof(uint32_t),compare_values);
+    }
+    *nsyms = index->nsyms;
+    return index->by_value;
+}
+
+///free the index
+///param: index
+void destroy_symindex(symindex_t* index){
+    if(index){
+        if(!index->mapped){
+            free(index->by_value);
+            free(index->buckets);
+        }
+        free(index);
+    }
+}
@@ -0,0 +1,383 @@
+///author: jmp1617
+///purpose: index of the instructions that reference each data address
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "lmedit.h"
+
+///register holding the global pointer
+#define GP_REG 28
+
+///how an instruction references data
+enum xref_kind{
+    XREF_ADDRESS,//forms the address, e.g. the ori of a lui/ori pair
+    XREF_READ,
+    XREF_WRITE
+};
+
+///struct to hold one reference as an interval of data addresses
+typedef struct xref_ent{
+    uint32_t start;//first data address referenced
+    uint32_t end;//one past the last data address referenced
+    uint32_t max;//largest end in this node's subtree of the implicit interval tree
+    uint32_t site;//text address of the instruction
+    uint32_t addr;//address the instruction computes
+    uint8_t kind;
+    uint8_t width;
+}xref_ent_t;
+
+///struct to hold the index, sorted by start with subtree maxima laid out as an implicit tree
+struct xref{
+    xref_ent_t* ents;
+    uint32_t n;
+    uint32_t cap;
+    int max_level;
+};
+
+///struct to hold the data address range and symbol bounds used while scanning
+typedef struct xref_scan{
+    uint32_t data_begin;
+    uint32_t data_end;
+    uint32_t* syms;//sorted symtab values
+    uint32_t nsyms;
+}xref_scan_t;
+
+///find the end of the object an address points into
+///the object runs to the next symbol or the end of its section
+///param: MODULE, scan state, addr
+///return: one past the last address of the object
+static uint32_t object_end(module_t* MODULE, xref_scan_t* scan, uint32_t addr){
+    static char* data_secs[] = {"rdata","data","sdata","sbss","bss"};
+    uint32_t end = scan->data_end;
+    for(int sec=0;sec<5;sec++){
+        uint32_t start = get_start(MODULE,data_secs[sec]);
+        uint32_t size = get_size(data_secs[sec],MODULE);
+        if(addr>=start&&addr-start<size){
+            end = start+size;
+            break;
+        }
+    }
+    uint32_t lo = 0, hi = scan->nsyms;//first symbol above addr
+    while(lo<hi){
+        uint32_t mid = (lo+hi)/2;
+        if(scan->syms[mid]<=addr){
+            lo = mid+1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    if(lo<scan->nsyms&&scan->syms[lo]<end){
+        end = scan->syms[lo];
+    }
+    return end;
+}
+
+///add a reference to the index if it lands in the data sections
+///param: MODULE, xref index, scan state, site, addr, kind, width in bytes (0 for an address)
+static void add_xref(module_t* MODULE, xref_t* xref, xref_scan_t* scan, uint32_t site, uint32_t addr, int kind, int width){
+    if(addr<scan->data_begin||addr>=scan->data_end){
+        return;
+    }
+    if(xref->n==xref->cap){
+        xref->cap = xref->cap?xref->cap*2:256;
+        xref->ents = realloc(xref->ents,xref->cap*sizeof(xref_ent_t));
+    }
+    xref_ent_t* ent = &xref->ents[xref->n++];
+    ent->site = site;
+    ent->addr = addr;
+    ent->kind = kind;
+    ent->width = width;
+    if(width){
+        ent->start = width==4?addr&~3u:addr;//lwl and friends touch the aligned word
+        ent->end = ent->start+width;
+    }
+    else{
+        ent->start = addr;
+        ent->end = object_end(MODULE,scan,addr);
+    }
+}
+
+///compare two references by start then site
+static int compare_xref(const void* a, const void* b){
+    const xref_ent_t* x = a;
+    const xref_ent_t* y = b;
+    if(x->start!=y->start){
+        return x->start<y->start?-1:1;
+    }
+    return x->site<y->site?-1:x->site>y->site;
+}
+
+///fill in the subtree maxima of the implicit interval tree
+///param: xref sorted by start
+static void index_xref(xref_t* xref){
+    xref_ent_t* a = xref->ents;
+    uint32_t n = xref->n;
+    uint32_t last_i = 0, last = 0;
+    int k;
+    if(!n){
+        xref->max_level = -1;
+        return;
+    }
+    for(uint32_t i=0;i<n;i+=2){//leaves
+        last_i = i;
+        last = a[i].max = a[i].end;
+    }
+    for(k=1;(1ull<<k)<=n;k++){
+        uint64_t x = 1ull<<(k-1), step = x<<2;
+        for(uint64_t i=(x<<1)-1;i<n;i+=step){
+            uint32_t el = a[i-x].max;
+            uint32_t er = i+x<n?a[i+x].max:last;
+            uint32_t e = a[i].end;
+            e = e>el?e:el;
+            e = e>er?e:er;
+            a[i].max = e;
+        }
+        last_i = (last_i>>k)&1?last_i-x:last_i+x;
+        if(last_i<n&&a[last_i].max>last){
+            last = a[last_i].max;
+        }
+    }
+    xref->max_level = k-1;
+}
+
+///build the data cross reference index by tracking constant registers through the text
+///lui/addiu and lui/ori pairs (marked REL_IMM_2 when the module has text relocations)
+///and gp-relative accesses give the data addresses
+///param: MODULE
+///return: the index
+xref_t* build_xref(module_t* MODULE){
+    xref_t* xref = calloc(1,sizeof(xref_t));
+    xref_scan_t scan = {0};
+    uint32_t ntext = get_size("text",MODULE)/4;
+    uint32_t base = TEXT_BEGIN;
+    uint32_t nrel = get_size("reltab",MODULE);
+    scan.data_begin = get_start(MODULE,"rdata");
+    scan.data_end = get_start(MODULE,"bss")+get_size("bss",MODULE);
+    uint32_t* by_value = symbols_by_value(MODULE,&scan.nsyms);
+    scan.syms = malloc((scan.nsyms+1)*sizeof(uint32_t));
+    for(uint32_t entry=0;entry<scan.nsyms;entry++){
+        scan.syms[entry] = ntohl(MODULE->SYMTAB[by_value[entry]].value);
+    }
+    //with text relocations only the marked lui instructions start an address
+    uint8_t* hi_hint = NULL;
+    for(uint32_t entry=0;entry<nrel;entry++){
+        relent_t* rel = &MODULE->RELTAB[entry];
+        uint32_t addr = ntohl(rel->addr);
+        if(MODULE->HEADER->entry==0x0){
+            addr += base;
+        }
+        if(rel->section==EH_IX_TEXT+1&&rel->type==REL_IMM_2&&addr>=base&&(addr-base)/4<ntext){
+            if(!hi_hint){
+                hi_hint = calloc(ntext,1);
+            }
+            hi_hint[(addr-base)/4] = 1;
+        }
+    }
+    uint32_t value[32] = {0};
+    uint32_t known = 1u|1u<<GP_REG;//$zero and $gp
+    uint32_t reset_at = UINT32_MAX;
+    value[GP_REG] = get_start(MODULE,"sdata")+0x8000;
+    for(uint32_t index=0;index<ntext;index++){
+        uint32_t word;
+        memcpy(&word,&MODULE->TEXT[index*4],sizeof(uint32_t));
+        word = SECTION_WORD(MODULE->LITTLE,word);
+        uint32_t op = word>>26, rs = (word>>21)&0x1f, rt = (word>>16)&0x1f, rd = (word>>11)&0x1f;
+        uint32_t simm = (uint32_t)(int32_t)(int16_t)(word&0xffff);
+        uint32_t site = base+index*4;
+        uint32_t written = 0;//registers written with an unknown value
+        if(index==reset_at){//past the delay slot of an unconditional transfer, reached only by a jump
+            known = 1u|1u<<GP_REG;
+        }
+        switch(op){
+            case 0x00://special
+                if((word&0x3f)!=0x08&&(word&0x3f)!=0x0c&&(word&0x3f)!=0x0d&&
+                        ((word&0x3f)<0x18||(word&0x3f)>0x1b)&&(word&0x3f)!=0x11&&(word&0x3f)!=0x13){
+                    written = 1u<<rd;
+                }
+                if((word&0x3f)==0x08){//jr
+                    reset_at = index+2;
+                }
+                break;
+            case 0x02://j
+                reset_at = index+2;
+                break;
+            case 0x03://jal
+                written = 1u<<31;
+                break;
+            case 0x04://b is beq $0,$0
+                if(rs==0&&rt==0){
+                    reset_at = index+2;
+                }
+                break;
+            case 0x0f://lui
+                if(!hi_hint||hi_hint[index]){
+                    value[rt] = (word&0xffff)<<16;
+                    known |= 1u<<rt;
+                }
+                else{
+                    written = 1u<<rt;
+                }
+                break;
+            case 0x08: case 0x09: case 0x0d://addi addiu ori
+                if(known&1u<<rs){
+                    uint32_t addr = op==0x0d?value[rs]|(word&0xffff):value[rs]+simm;
+                    if(rs!=0){//small constants from $zero are not addresses
+                        add_xref(MODULE,xref,&scan,site,addr,XREF_ADDRESS,0);
+                    }
+                    value[rt] = addr;
+                    known |= 1u<<rt;
+                }
+                else{
+                    written = 1u<<rt;
+                }
+                break;
+            case 0x20: case 0x24: case 0x21: case 0x25: case 0x22: case 0x23: case 0x26://loads
+                if(known&1u<<rs){
+                    int width = op==0x20||op==0x24?1:op==0x21||op==0x25?2:4;
+                    add_xref(MODULE,xref,&scan,site,value[rs]+simm,XREF_READ,width);
+                }
+                written = 1u<<rt;
+                break;
+            case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2e://stores
+                if(known&1u<<rs){
+                    int width = op==0x28?1:op==0x29?2:4;
+                    add_xref(MODULE,xref,&scan,site,value[rs]+simm,XREF_WRITE,width);
+                }
+                break;
+            case 0x31: case 0x39://lwc1 swc1
+                if(known&1u<<rs){
+                    add_xref(MODULE,xref,&scan,site,value[rs]+simm,op==0x31?XREF_READ:XREF_WRITE,4);
+                }
+                break;
+            default:
+                if(op>=0x0a&&op<=0x0e){//slti sltiu andi xori
+                    written = 1u<<rt;
+                }
+                break;
+        }
+        known &= ~(written&~(1u|1u<<GP_REG));
+        value[0] = 0;
+    }
+    free(hi_hint);
+    free(scan.syms);
+    qsort(xref->ents,xref->n,sizeof(xref_ent_t),compare_xref);
+    index_xref(xref);
+    return xref;
+}
+
+///find the references whose interval holds an address, in O(log n + hits)
+///param: xref, addr, hits set to an array of entries to be freed by the caller
+///return: number of hits
+static uint32_t query_xref(xref_t* xref, uint32_t addr, xref_ent_t*** hits){
+    xref_ent_t* a = xref->ents;
+    uint64_t n = xref->n;
+    uint32_t nhits = 0, cap = 16;
+    struct{uint64_t x; int k; int w;} stack[64];
+    int top = 0;
+    *hits = malloc(cap*sizeof(xref_ent_t*));
+    if(xref->max_level<0){
+        return 0;
+    }
+    stack[top].x = (1ull<<xref->max_level)-1;
+    stack[top].k = xref->max_level;
+    stack[top++].w = 0;
+    while(top){
+        top--;
+        uint64_t x = stack[top].x;
+        int k = stack[top].k, w = stack[top].w;
+        if(k<=3){//small subtree: scan it
+            uint64_t i0 = x>>k<<k, i1 = i0+(1ull<<(k+1))-1;
+            if(i1>n){
+                i1 = n;
+            }
+            for(uint64_t i=i0;i<i1&&a[i].start<=addr;i++){
+                if(a[i].end>addr){
+                    if(nhits==cap){
+                        cap *= 2;
+                        *hits = realloc(*hits,cap*sizeof(xref_ent_t*));
+                    }
+                    (*hits)[nhits++] = &a[i];
+                }
+            }
+        }
+        else if(w==0){//visit the left child first
+            uint64_t y = x-(1ull<<(k-1));
+            stack[top].x = x;
+            stack[top].k = k;
+            stack[top++].w = 1;
+            if(y>=n||a[y].max>addr){
+                stack[top].x = y;
+                stack[top].k = k-1;
+                stack[top++].w = 0;
+            }
+        }
+        else if(x<n&&a[x].start<=addr){
+            if(a[x].end>addr){
+                if(nhits==cap){
+                    cap *= 2;
+                    *hits = realloc(*hits,cap*sizeof(xref_ent_t*));
+                }
+                (*hits)[nhits++] = &a[x];
+            }
+            stack[top].x = x+(1ull<<(k-1));
+            stack[top].k = k-1;
+            stack[top++].w = 0;
+        }
+    }
+    return nhits;
+}
+
+///free the index
+///param: xref
+void destroy_xref(xref_t* xref){
+    if(xref){
+        free(xref->ents);
+        free(xref);
+    }
+}
+
+///compare two hits by the text address of the instruction
+static int compare_hits(const void* a, const void* b){
+    uint32_t x = (*(xref_ent_t* const*)a)->site, y = (*(xref_ent_t* const*)b)->site;
+    return x<y?-1:x>y;
+}
+
+///print the instructions that reference an address or symbol, building the index on first use
+///param: MODULE, target address (as the module's instructions see it) or symbol name
+///return: 0 on success 1 if the target was not understood
+int print_xref(module_t* MODULE, char* target){
+    char* end;
+    uint32_t addr = strtoul(target,&end,0);
+    if(*end!='\0'){//not a number, look for the symbol
+        int64_t entry = find_symbol(MODULE,target);
+        if(entry<0){
+            fprintf(ERR,"error: '%s' is not an address or a symbol in the symtab\n",target);
+            return 1;
+        }
+        addr = ntohl(MODULE->SYMTAB[entry].value);
+    }
+    if(!MODULE->XREF){
+        if(load_sections(MODULE,SECTION_BIT(EH_IX_TEXT)|TABLE_SECTIONS)){
+            return 1;
+        }
+        MODULE->XREF = build_xref(MODULE);
+    }
+    xref_ent_t** hits;
+    uint32_t nhits = query_xref(MODULE->XREF,addr,&hits);
+    qsort(hits,nhits,sizeof(xref_ent_t*),compare_hits);
+    fprintf(OUT,"Address %#010x is referenced by %u instruction%s\n",addr,nhits,nhits==1?"":"s");
+    for(uint32_t hit=0;hit<nhits;hit++){
+        xref_ent_t* ent = hits[hit];
+        if(ent->kind==XREF_ADDRESS){
+            fprintf(OUT,"   %#010x: address of %#010x\n",ent->site,ent->addr);
+        }
+        else{
+            fprintf(OUT,"   %#010x: %s %u byte%s at %#010x\n",ent->site,ent->kind==XREF_READ?"reads":"writes",
+                    ent->width,ent->width==1?"":"s",ent->addr);
+        }
+    }
+    free(hits);
+    return 0;
+}